@@ -56,6 +56,10 @@ NETWORK_LIB_FILEPATH = $$NETWORK_BIN_DIR/$$NETWORK_LIB_FILENAME
 equals(NETWORK_COMPILE_MODE,SRC) {
     HEADERS *= \
         $$PWD/include/foundation.h \
+        $$PWD/include/metrics.h \
+        $$PWD/include/tracer.h \
+        $$PWD/include/future.h \
+        $$PWD/include/awaitable.h \
         $$PWD/include/package.h \
         $$PWD/include/connect.h \
         $$PWD/include/connectpool.h \
@@ -65,6 +69,9 @@ equals(NETWORK_COMPILE_MODE,SRC) {
         $$PWD/include/lan.h
     SOURCES *= \
         $$PWD/src/foundation.cpp \
+        $$PWD/src/metrics.cpp \
+        $$PWD/src/tracer.cpp \
+        $$PWD/src/future.cpp \
         $$PWD/src/package.cpp \
         $$PWD/src/connect.cpp \
         $$PWD/src/connectpool.cpp \
@@ -0,0 +1,77 @@
+﻿#ifndef NETWORK_INCLUDE_NETWORK_AWAITABLE_H_
+#define NETWORK_INCLUDE_NETWORK_AWAITABLE_H_
+
+#include "future.h"
+
+// Coroutine support, only compiled where the compiler runs in C++20 mode or later
+#ifdef __cpp_impl_coroutine
+
+#include <coroutine>
+#include <exception>
+
+#include <QFutureWatcher>
+
+// Runs right away and frees itself when its body ends. Meant for handlers and event loop code that
+// co_await network calls, the result is delivered from inside the body, e.g. by a reply
+struct NetworkTask {
+	struct promise_type {
+		inline NetworkTask get_return_object() {
+			return {};
+		}
+
+		inline std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+
+		inline std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+
+		inline void return_void() {
+		}
+
+		inline void unhandled_exception() {
+			std::terminate();
+		}
+	};
+};
+
+// Parks the coroutine without a thread until the future settles, then resumes it on the thread that awaited,
+// which needs a running event loop. A future settled without a result resumes with T()
+template<typename T>
+class NetworkFutureAwaiter {
+public:
+	explicit NetworkFutureAwaiter(const QFuture<T>& future) :
+		m_future(future) {
+	}
+
+	inline bool await_ready() const {
+		return m_future.isFinished();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		// The watcher lives on the awaiting thread, deleteLater since it is released from its own signal
+		m_watcher.reset(new QFutureWatcher<T>, &QObject::deleteLater);
+		QObject::connect(m_watcher.data(), &QFutureWatcherBase::finished, m_watcher.data(), [handle]() {
+			handle.resume();
+		});
+		m_watcher->setFuture(m_future);
+	}
+
+	inline T await_resume() const {
+		return (m_future.resultCount()) ? (m_future.result()) : (T());
+	}
+
+private:
+	QFuture<T> m_future;
+	QSharedPointer<QFutureWatcher<T>> m_watcher;
+};
+
+template<typename T>
+inline NetworkFutureAwaiter<T> operator co_await(const QFuture<T>& future) {
+	return NetworkFutureAwaiter<T>(future);
+}
+
+#endif
+
+#endif//NETWORK_INCLUDE_NETWORK_AWAITABLE_H_
@@ -2,12 +2,20 @@
 #ifndef NETWORK_INCLUDE_NETWORK_CLIENG_H_
 #define NETWORK_INCLUDE_NETWORK_CLIENG_H_
 
+#include <QHash>
+
 #include "foundation.h"
+#include "future.h"
 
 struct ClientSettings {
 	QString dutyMark;
 	int maximumAutoConnectToHostWaitTime = 10 * 1000;
 	bool autoCreateConnect = true;
+	bool autoReconnect = false; // reconnect dropped hosts in the background and queue sends instead of blocking in getConnect
+	int reconnectInitialBackoff = 100; // ms, doubled on every failed attempt, each wait is a random pick below it
+	int reconnectMaximumBackoff = 30 * 1000; // ms
+	int reconnectMaximumAttemptCount = -1; // -1: retry forever, otherwise the queued sends fail once exhausted
+	int reconnectQueueSize = 1024; // sends held per host while it is down, beyond that they fail at once
 	std::function<void(const QPointer<Connect>&, const QString& hostName, const quint16& port)> connectToHostErrorCallback = nullptr;
 	std::function<void(const QPointer<Connect>&, const QString& hostName, const quint16& port)> connectToHostTimeoutCallback = nullptr;
 	std::function<void(const QPointer<Connect>&, const QString& hostName, const quint16& port)> connectToHostSucceedCallback = nullptr;
@@ -59,13 +67,23 @@ public:
 		return QSet<QString>(l.begin(), l.end());
 	}
 
-	void createConnect(const QString& hostName, const quint16& port);
+	void createConnect(const QString& hostName, const quint16& port, const int& connectIndex = 0);
 
 	bool waitForCreateConnect(
 		const QString& hostName,
 		const quint16& port,
-		const int& maximumConnectToHostWaitTime = -1);
+		const int& maximumConnectToHostWaitTime = -1,
+		const int& connectIndex = 0);
+
+	// waitForCreateConnect without parking the caller, settles with false on error or after the wait time
+	QFuture<bool> createConnectAsync(
+		const QString& hostName,
+		const quint16& port,
+		const int& maximumConnectToHostWaitTime = -1,
+		const int& connectIndex = 0);
 
+	// With autoReconnect a send to a host that is down is held, it still returns the randomFlag it will go out
+	// with, see pendingSendCount
 	qint32 sendPayloadData(
 		const QString& hostName,
 		const quint16& port,
@@ -73,7 +91,8 @@ public:
 		const QByteArray& payloadData,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 
 	inline qint32 sendPayloadData(
@@ -120,7 +139,8 @@ public:
 		const QVariantMap& variantMap,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	inline qint32 sendVariantMapData(
 		const QString& hostName,
@@ -161,7 +181,8 @@ public:
 		const QFileInfo& fileInfo,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
 
 	inline qint32 sendFileData(
 		const QString& hostName,
@@ -196,6 +217,76 @@ public:
 			failCallback);
 	}
 
+	// See Connect::sendBatch, batches are not held for autoReconnect and fail while the host is down
+	QList<qint32> sendBatch(
+		const QString& hostName,
+		const quint16& port,
+		const QList<NetworkBatchMessage>& messages,
+		const ConnectPointerAndPackageSharedPointerListFunction& batchSucceedCallback = nullptr,
+		const ConnectPointerFunction& batchFailCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	// Same sends settling a future instead of calling back, the future holds a null package on failure.
+	// Fan out with NetworkFuture::whenAll, nothing blocks while the requests are in flight
+	NetworkReplyFuture sendPayloadDataAsync(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	NetworkReplyFuture sendVariantMapDataAsync(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QVariantMap& variantMap,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	NetworkReplyFuture sendFileDataAsync(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	// Split one file into stripeCount ranges sent over as many connects to the same host and port,
+	// the receiver reports it once as a whole file, callbacks and the returned randomFlag belong to stripe 0
+	qint32 sendFileDataStriped(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData,
+		const int& stripeCount,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	// Many small files in streaming bundles, see Connect::sendFileBundle
+	qint32 sendFileBundle(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QDir& baseDir,
+		const QList<QFileInfo>& fileInfos,
+		const QVariantMap& appendData,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	qint32 sendDirectory(
+		const QString& hostName,
+		const quint16& port,
+		const QString& targetActionFlag,
+		const QDir& dir,
+		const QVariantMap& appendData,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
 	qint32 waitForSendPayloadData(
 		const QString& hostName,
 		const quint16& port,
@@ -322,9 +413,12 @@ public:
 			failCallback);
 	}
 
-	QPointer<Connect> getConnect(const QString& hostName, const quint16& port);
+	QPointer<Connect> getConnect(const QString& hostName, const quint16& port, const int& connectIndex = 0);
 
-	bool containsConnect(const QString& hostName, const quint16& port);
+	bool containsConnect(const QString& hostName, const quint16& port, const int& connectIndex = 0);
+
+	// Sends held for autoReconnect until the host is connected again
+	int pendingSendCount(const QString& hostName, const quint16& port);
 
 private:
 	void onConnectToHostError(const QPointer<Connect>& connect, const QPointer<ConnectPool>& connectPool);
@@ -369,7 +463,46 @@ private:
 		const QPointer<ConnectPool>& connectPool,
 		const ConnectPointerFunction& failCallback);
 
-	void releaseWaitConnectSucceedSemaphore(const QString& hostName, const quint16& port, const bool& succeed);
+	void releaseWaitConnectSucceedSemaphore(
+		const QString& hostName,
+		const quint16& port,
+		const int& connectIndex,
+		const bool& succeed);
+
+	struct PendingSend {
+		qint32 randomFlag;
+		QString targetActionFlag;
+		QByteArray payloadData;
+		QVariantMap appendData;
+		ConnectPointerAndPackageSharedPointerFunction succeedCallback;
+		ConnectPointerFunction failCallback;
+		NetworkPriority priority;
+	};
+
+	struct ReconnectState {
+		QList<PendingSend> pendingSends;
+		qint32 nextReservedRandomFlag = 0;
+		int failedAttemptCount = 0;
+		bool connected = false;
+		bool reconnectScheduled = false;
+		bool flushing = false;
+	};
+
+	static inline QString reconnectKey(const QString& hostName, const quint16& port) {
+		return QString("%1:%2").arg(hostName, QString::number(port));
+	}
+
+	// Call with m_mutexForReconnect held, returns -1 if an attempt is already on its way
+	int reserveReconnectAttempt(ReconnectState& state);
+
+	// Call with m_mutexForReconnect held, the randomFlag a held send goes out with
+	static qint32 reserveRandomFlag(ReconnectState& state);
+
+	void scheduleReconnect(const QString& hostName, const quint16& port, const int& delay);
+
+	void flushPendingSends(const QPointer<Connect>& connect, const QString& hostName, const quint16& port);
+
+	void failPendingSends(const QList<PendingSend>& pendingSends);
 
 private:
 	// Thread pool
@@ -390,7 +523,12 @@ private:
 	// Other
 	QString m_nodeMarkSummary;
 	QMutex m_mutex;
-	QMap<QString, QWeakPointer<QSemaphore>> m_waitConnectSucceedSemaphore; // "127.0.0.1:34543" -> SemaphoreForConnect
+	QMap<QString, QWeakPointer<QSemaphore>> m_waitConnectSucceedSemaphore; // "127.0.0.1:34543#connectIndex" -> SemaphoreForConnect
+	QMap<QString, QList<QSharedPointer<QPromise<bool>>>> m_waitConnectSucceedPromises; // "127.0.0.1:34543#connectIndex" -> PromisesForConnect
+	// Reconnect
+	QMutex m_mutexForReconnect;
+	QHash<QString, ReconnectState> m_reconnectStates; // "127.0.0.1:34543" -> ReconnectState, connectIndex 0 only
+	bool m_reconnectStopped = false;
 };
 
 #endif // NETWORK_INCLUDE_NETWORK_CLIENG_H_
@@ -2,7 +2,12 @@
 #ifndef NETWORK_INCLUDE_NETWORK_CONNECT_H_
 #define NETWORK_INCLUDE_NETWORK_CONNECT_H_
 
+#include <QSet>
+
 #include "foundation.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "future.h"
 
 struct ConnectSettings {
 	bool longConnection = true;
@@ -11,6 +16,11 @@ struct ConnectSettings {
 	qint64 cutPackageSize = NETWORKPACKAGE_ADVISE_CUTPACKAGESIZE;
 	qint64 packageCompressionMinimumBytes = 1024;
 	int packageCompressionThresholdForConnectSucceedElapsed = 500;
+	bool writeCoalescingEnabled = false;
+	int writeCoalescingWindow = 0; // us, 0: flush when the current event loop iteration ends
+	qint64 writeCoalescingMaximumBytes = 64 * 1024; // flush at once when the pending buffer reaches this size
+	qint64 sendSchedulerWatermark = 256 * 1024; // hold non-control packages while the socket has this many bytes queued, -1: never hold
+	qint64 bulkCutPackageSize = -1; // cut size for NetworkPriority::Bulk messages, -1: same as cutPackageSize
 	qint64 maximumSendForTotalByteCount = -1;	 // reserve
 	qint64 maximumSendPackageByteCount = -1;	 // reserve
 	int maximumSendSpeed = -1;					 // Byte/s reserve
@@ -18,12 +28,37 @@ struct ConnectSettings {
 	qint64 maximumReceivePackageByteCount = -1;	 // reserve
 	int maximumReceiveSpeed = -1;				 // Byte/s reserve
 	bool fileTransferEnabled = false;
+	bool fileZeroCopyEnabled = true; // Linux, send uncompressed file chunks with sendfile while the socket buffer is empty
+	bool fileTransferResumeEnabled = false; // keep a "<file>.resume" sidecar so an interrupted receive can continue
+	qint64 maximumCorruptedBytes = 1024 * 1024; // bytes skipped to find the next package after corrupt framing within corruptedBytesWindow before the connect is closed, -1: no limit
+	qint64 corruptedBytesWindow = 60 * 1000; // ms
+	QSharedPointer<NetworkMetrics> metrics; // totals of every connect using these settings, a Server always sets one
+	QSharedPointer<NetworkTracer> tracer; // lifecycle events of sampled messages, null: off
+	bool packageChecksumEnabled = false; // CRC32C on every sent package and over the data of every sent file, verified by any receiver
+	qint64 fileDeltaMinimumBytes = -1; // send files at least this big as a delta against the receiver's copy, -1: off
+	qint64 chunkDeduplicationMinimumBytes = -1; // sent payloads and files at least this big only ship chunks the receiver lacks, -1: off
+	QString chunkStoreDir; // receiver, content addressed store of received chunks, empty: no store, every chunk is wanted
+	qint64 fileBundleMaximumBytes = 4 * 1024 * 1024; // sendFileBundle packs small files into bundles up to this size
+	int fileBundleMaximumFileCount = 1024; // and up to this many files per bundle
 	qint32 randomFlagRangeStart = -1;
 	qint32 randomFlagRangeEnd = -1;
+	QHostAddress localAddress; // outgoing connects bind to this source address first, null: chosen by the system
+	bool localTransportEnabled = false; // Linux, outgoing connects to a loopback host use the Unix domain socket of a server of the same user listening on one, TCP if there is none
+	int heartbeatInterval = -1; // ms without a received byte before a heartbeat goes out, the peer answers it, -1: off
+	int heartbeatTimeout = -1; // ms without a received byte before the connect is closed as dead, -1: 3 heartbeatIntervals, only once the peer has answered a heartbeat
+	int idleReleaseDelay = 10 * 1000; // ms with nothing in flight before a connect frees its read buffer and emptied pools, -1: never
+	int tcpKeepAliveIdle = -1; // s idle before the kernel probes the peer, turns SO_KEEPALIVE on, -1: off
+	int tcpKeepAliveInterval = -1; // Linux, s between two keepalive probes, -1: system default
+	int tcpKeepAliveCount = -1; // Linux, unanswered keepalive probes before the kernel drops the connect, -1: system default
+	int tcpUserTimeout = -1; // Linux, ms sent data may stay unacknowledged before the kernel drops the connect, -1: system default
+	int socketSendBufferSize = -1; // bytes of the kernel send buffer of outgoing connects, SO_SNDBUF, -1: system default
 	int maximumConnectToHostWaitTime = 15 * 1000;
 	int maximumSendPackageWaitTime = 30 * 1000;
 	int maximumReceivePackageWaitTime = 30 * 1000;
 	int maximumFileWriteWaitTime = 30 * 1000;
+	int fileWriteThreadCount = 0; // > 0: write received file chunks on a shared writer pool instead of the socket thread
+	qint64 maximumPendingFileWriteBytes = 16 * 1024 * 1024; // per connect, delay the next file data request above this
+	qint64 fileWriteSyncRangeMinimumBytes = -1; // Linux, start writeback after every chunk of files at least this big, -1: off
 	int maximumConnectionTime = -1;
 	std::function<void(const QPointer<Connect>&)> connectToHostErrorCallback = nullptr;
 	std::function<void(const QPointer<Connect>&)> connectToHostTimeoutCallback = nullptr;
@@ -46,10 +81,109 @@ class Connect : public QObject {
 private:
 	struct ReceivedCallbackPackage {
 		qint64 sendTime;
+		qint64 sendMicroseconds; // NetworkMetrics::nowMicroseconds, for the reply latency
 		ConnectPointerAndPackageSharedPointerFunction succeedCallback;
 		ConnectPointerFunction failCallback;
 	};
 
+	// Block signatures of the receiver's copy, defined in connect.cpp
+	struct FileDeltaSignatures;
+
+	// One timer per socket thread drives the heartbeat and idle release checks of all its connects, defined in connect.cpp
+	struct TimerWheel;
+
+	struct WaitForSendFile {
+		QSharedPointer<QFile> file;
+		NetworkPriority priority;
+		qint64 endOffset; // file size, or the end of the stripe
+		bool fileDelta = false;
+		QSharedPointer<FileDeltaSignatures> fileDeltaSignatures; // arrive with the first data request
+		QSharedPointer<QCryptographicHash> fileDeltaHash; // SHA-256 of the file covered by the delta so far
+		quint32 fileChecksum = 0; // CRC32C of the data sent so far, when package checksums are on
+	};
+
+	// Shared by the callbacks of the bundles of one sendFileBundle, they may run on any thread
+	struct FileBundleProgress {
+		std::atomic<int> pendingBundleCount = { 0 };
+		std::atomic<bool> failed = { false };
+		ConnectPointerFunction failCallback; // the caller's, run on the first failure only
+	};
+
+	struct WaitForSendFileBundle {
+		QString targetActionFlag;
+		QVariantMap appendData;
+		QString baseDirPath;
+		QList<QStringList> bundles; // not read yet, the file paths of each bundle
+		int bundleCount = 0;
+		qint32 firstRandomFlag = 0;
+		ConnectPointerAndPackageSharedPointerFunction succeedCallback; // every bundle, see sendFileBundle
+		ConnectPointerFunction failCallback;
+		QSharedPointer<FileBundleProgress> progress;
+		NetworkPriority priority;
+	};
+
+	struct ReadySendPackages {
+		qint32 randomFlag;
+		QList<QSharedPointer<Package>> packages;
+		ConnectPointerAndPackageSharedPointerFunction succeedCallback;
+		ConnectPointerFunction failCallback;
+	};
+
+	struct WaitForSendChunkedData {
+		QSharedPointer<QIODevice> source; // the file, or a buffer around the payload
+		qint8 packageFlag;
+		NetworkPriority priority;
+		QVector<qint64> chunkOffsets; // the last chunk ends with the source
+		QByteArray chunkWants; // one bit per chunk, arrives with the first data request
+		bool chunkWantsReceived = false;
+		int chunkIndex = 0;
+		qint64 chunkDataOffset = 0; // already sent part of the chunk at chunkIndex
+	};
+
+	struct ReceivedChunkedData {
+		QSharedPointer<Package> firstPackage;
+		bool callbackOnFinish = false;
+		QByteArray chunkManifest; // per chunk: sha256, qint32 size
+		QByteArray chunkWants;
+		int chunkIndex = 0; // next chunk to place
+		QByteArray pendingChunkData; // wanted chunk data not placed yet
+		QSharedPointer<QFile> file; // file transfers are rebuilt here
+		QByteArray payloadData; // payload transfers are rebuilt here
+		qint64 receivedOffset = 0;
+		quint32 fileChecksum = 0; // CRC32C of the chunks placed so far, stored ones included
+	};
+
+	struct ReceivedFile {
+		QSharedPointer<Package> firstPackage;
+		QSharedPointer<QFile> file;
+		bool callbackOnFinish = false;
+		qint64 receivedOffset = 0; // where the next received chunk goes
+		qint64 endOffset = 0; // file size, or the end of the stripe
+		QString stripeId;
+		qint64 resumeOffset = -1;
+		QByteArray resumeChecksum;
+		qint64 pendingWriteBytes = 0; // queued on the writer pool, not yet on disk
+		int writeThreadIndex = -1;
+		bool dataRequestDeferred = false;
+		QSharedPointer<QFile> fileDeltaBaseFile; // the previous copy, copy instructions read from it
+		qint64 fileDeltaBlockSize = 0; // > 0: file is rebuilt from a delta into "<file>.delta"
+		QSharedPointer<QCryptographicHash> fileDeltaHash; // SHA-256 of the rebuilt file written so far, shared with the writer
+		QByteArray fileHash; // the sender's, arrives with the last delta package
+		quint32 fileChecksum = 0; // CRC32C of the data received so far, when the sender sends checksums
+		// Shared with the writes queued on the writer pool, set when the file is aborted so they are skipped
+		QSharedPointer<std::atomic<bool>> writeAborted = QSharedPointer<std::atomic<bool>>::create(false);
+	};
+
+	// Shared by the connects receiving the stripes of one file, which may live on different threads
+	struct StripedReceivedFile {
+		int stripeCount = 0;
+		int finishedStripeCount = 0;
+		QPointer<Connect> firstStripeConnect;
+		std::function<void(std::function<void()>)> runOnFirstStripeConnectThreadCallback;
+		QSharedPointer<Package> firstStripePackage;
+		bool callbackOnFinish = false;
+	};
+
 private:
 	Connect(const QSharedPointer<ConnectSettings>& connectSettings);
 
@@ -72,6 +206,15 @@ public:
 		return m_tcpSocket.toWeakRef();
 	}
 
+	// Unix domain socket in the runtime dir of the user a server with ServerSettings::localListenEnabled accepts
+	// same host connects of port on
+	static QString localServerName(const quint16& port);
+
+	// Over a Unix domain socket instead of TCP loopback, the QTcpSocket wraps its descriptor
+	inline bool isLocalTransport() const {
+		return m_localTransport;
+	}
+
 	inline bool onceConnectSucceed() const {
 		return m_onceConnectSucceed;
 	}
@@ -80,6 +223,11 @@ public:
 		return m_isAbandonTcpSocket;
 	}
 
+	// Unique in the process, tells apart the messages of connects that share a randomFlag range
+	inline quint64 connectId() const {
+		return m_connectId;
+	}
+
 	inline qint64 connectCreateTime() const {
 		return m_connectCreateTime;
 	}
@@ -96,6 +244,27 @@ public:
 		return m_alreadyWrittenBytes;
 	}
 
+	inline qint64 sentPackageCount() const {
+		return m_sentPackageCount.load(std::memory_order_relaxed);
+	}
+
+	inline qint64 socketWriteCount() const {
+		return m_socketWriteCount.load(std::memory_order_relaxed);
+	}
+
+	inline qint64 corruptedBytes() const {
+		return m_corruptedBytes;
+	}
+
+	// This connect's share of the NetworkMetrics counters, safe to read from any thread
+	inline qint64 metricCounter(const NetworkMetrics::Counter& counter) const {
+		return m_metricCounters[counter].load(std::memory_order_relaxed);
+	}
+
+	inline qint64 pendingFileWriteBytes() const {
+		return m_pendingFileWriteBytes;
+	}
+
 	inline qint64 connectSucceedElapsed() const {
 		if (!m_connectSucceedTime) {
 			return -1;
@@ -104,12 +273,28 @@ public:
 	}
 
 	void close();
+
+	// Write out packages held back by write coalescing, can be called from any thread
+	void flush();
+
 	qint32 sendPayloadData(
 		const QString& targetActionFlag,
 		const QByteArray& payloadData,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	// Same with a randomFlag taken in advance, e.g. by Client for a send held until its host is reconnected.
+	// The flag must not be in use on this connect
+	qint32 sendPayloadDataWithRandomFlag(
+		const qint32& randomFlag,
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	inline qint32 sendPayloadData(
 		const QByteArray& payloadData,
@@ -128,7 +313,8 @@ public:
 		const QVariantMap& variantMap,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	inline qint32 sendVariantMapData(
 		const QVariantMap& variantMap,
@@ -147,7 +333,8 @@ public:
 		const QFileInfo& fileInfo,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
-		const ConnectPointerFunction& failCallback = nullptr);
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
 
 	inline qint32 sendFileData(
 		const QFileInfo& fileInfo,
@@ -161,25 +348,111 @@ public:
 			failCallback);
 	}
 
+	// Many messages in one pass: their packages are built on the calling thread, cross to the connect thread
+	// as one task and the first package of every message leaves in a single socket write.
+	// The batch callbacks run once, after every reply arrived or at the first failure, next to the callbacks
+	// of each message. Returns the randomFlags in message order, empty on failure after the fail callbacks ran
+	QList<qint32> sendBatch(
+		const QList<NetworkBatchMessage>& messages,
+		const ConnectPointerAndPackageSharedPointerListFunction& batchSucceedCallback = nullptr,
+		const ConnectPointerFunction& batchFailCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	// Same batching for messages that want no reply, see putPayloadData. Every message takes its own randomFlag so
+	// messages above cutPackageSize keep their chunks apart, a reply the peer sends anyway is dropped
+	bool putBatch(
+		const QList<NetworkBatchMessage>& messages,
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	// Queue a package encoded once for many connects (Package::encodeFrame), see Server::broadcast, call on
+	// the connect thread. It goes through the send scheduler at its sendPriority. Returns false if the connect
+	// was left out as a slow consumer
+	bool writeSharedFrame(
+		const QSharedPointer<Package>& frame,
+		const qint64& slowConsumerBytes,
+		const NetworkSlowConsumerPolicy& slowConsumerPolicy);
+
+	// Same sends settling a future instead of calling back, the future holds a null package on failure
+	NetworkReplyFuture sendPayloadDataAsync(
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	NetworkReplyFuture sendVariantMapDataAsync(
+		const QString& targetActionFlag,
+		const QVariantMap& variantMap,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Interactive);
+
+	NetworkReplyFuture sendFileDataAsync(
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData = {},
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	// Send one range of a striped transfer, see Client::sendFileDataStriped, only stripe 0 should carry callbacks
+	qint32 sendFileDataStripe(
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData,
+		const QString& stripeId,
+		const int& stripeIndex,
+		const int& stripeCount,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	// Give up a send, its fail callback is called and the remote drops what it has received of it
+	void cancelSend(const qint32& randomFlag);
+
+	// Pack many small files below baseDir into bundles, each bundle is one payload transfer carrying a compact
+	// manifest and the file contents, and is reported to the receiver as its own package. A file bigger than
+	// fileBundleMaximumBytes goes as a file transfer of its own and counts as a bundle. Bundles are read one
+	// at a time while the socket drains. The callbacks hear once about the whole send: succeed when every
+	// bundle was answered, fail on the first bundle that fails, the rest is not sent then. Returns the first
+	// bundle's randomFlag
+	qint32 sendFileBundle(
+		const QString& targetActionFlag,
+		const QDir& baseDir,
+		const QList<QFileInfo>& fileInfos,
+		const QVariantMap& appendData,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
+	// sendFileBundle with every file below dir, recursively
+	qint32 sendDirectory(
+		const QString& targetActionFlag,
+		const QDir& dir,
+		const QVariantMap& appendData,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback = nullptr,
+		const ConnectPointerFunction& failCallback = nullptr,
+		const NetworkPriority& priority = NetworkPriority::Bulk);
+
 	qint32 replyPayloadData(
 		const qint32& receivedPackageRandomFlag,
 		const QByteArray& payloadData,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	qint32 replyVariantMapData(
 		const qint32& receivedPackageRandomFlag,
 		const QVariantMap& variantMap,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	qint32 replyFile(
 		const qint32& receivedPackageRandomFlag,
 		const QFileInfo& fileInfo,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Bulk);
 
 	bool putPayloadData(
 		const QString& targetActionFlag,
 		const QByteArray& payloadData,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	inline bool putPayloadData(
 		const QByteArray& payloadData,
@@ -193,7 +466,8 @@ public:
 	bool putVariantMapData(
 		const QString& targetActionFlag,
 		const QVariantMap& variantMap,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Interactive);
 
 	inline bool putVariantMapData(
 		const QVariantMap& variantMap,
@@ -207,7 +481,8 @@ public:
 	bool putFile(
 		const QString& targetActionFlag,
 		const QFileInfo& fileInfo,
-		const QVariantMap& appendData = QVariantMap());
+		const QVariantMap& appendData = QVariantMap(),
+		const NetworkPriority& priority = NetworkPriority::Bulk);
 
 	inline bool putFile(
 		const QFileInfo& fileInfo,
@@ -229,17 +504,106 @@ private Q_SLOTS:
 
 	void onSendPackageCheck();
 
+	void onWriteCoalescingTimeOut();
+
 private:
 	void startTimerForConnectToHostTimeOut();
 
 	void startTimerForSendPackageCheck();
 
+	void startTimerForWriteCoalescing();
+
 	void onDataTransportPackageReceived(const QSharedPointer<Package>& package);
 
+	void onFileBundleReceived(const QSharedPointer<Package>& package);
+
+	bool onChunkedDataReceived(const QSharedPointer<Package>& package, const bool& callbackOnFinish);
+
+	bool openChunkedData(const QSharedPointer<Package>& package, const bool& callbackOnFinish);
+
+	bool placeReceivedChunks(const qint32& randomFlag, ReceivedChunkedData& receivedChunkedData);
+
+	void sendNextChunkedData(const qint32& randomFlag, const QSharedPointer<Package>& requestPackage);
+
+	QString chunkStorePath(const QByteArray& chunkHash) const;
+
+	// Also sums up the CRC32C of the whole source, the manifest is the only full read of it
+	static QByteArray computeChunkManifest(QIODevice* source, QVector<qint64>& chunkOffsets, quint32& sourceChecksum);
+
+	static qint64 nextChunkSize(const uchar* data, const qint64& size);
+
+	static bool writeFileBundle(const QSharedPointer<Package>& package);
+
 	bool onFileDataTransportPackageReceived(
 		const QSharedPointer<Package>& package,
 		const bool& callbackOnFinish);
 
+	bool checkReceivedFileChecksum(
+		const qint32& randomFlag,
+		ReceivedFile& receivedFile,
+		const QSharedPointer<Package>& package,
+		const QByteArray& fileData);
+
+	bool writeReceivedFileData(const qint32& randomFlag, ReceivedFile& receivedFile, const QByteArray& fileData);
+
+	bool openFileDelta(const QSharedPointer<Package>& package, const bool& callbackOnFinish);
+
+	bool writeReceivedFileDelta(const qint32& randomFlag, ReceivedFile& receivedFile, const QByteArray& deltaData);
+
+	void sendNextFileDelta(const qint32& randomFlag, WaitForSendFile& waitForSendFile);
+
+	static QByteArray computeFileDeltaSignatures(QFile* file, const qint64& blockSize);
+
+	static QSharedPointer<FileDeltaSignatures> readFileDeltaSignatures(
+		const qint64& blockSize,
+		const QByteArray& signatures);
+
+	static QByteArray generateFileDelta(
+		QFile* file,
+		const qint64& endOffset,
+		const FileDeltaSignatures& fileDeltaSignatures,
+		const qint64& maximumSize);
+
+	static qint64 fileDeltaOutputSize(const QByteArray& deltaData, const qint64& blockSize);
+
+	static bool applyFileDelta(ReceivedFile& receivedFile, const QByteArray& deltaData);
+
+	void onReceivedFileDataWritten(const qint32& randomFlag, const qint64& dataSize, const bool& succeed);
+
+	void requestNextFileData(const qint32& randomFlag, ReceivedFile& receivedFile);
+
+	bool finishReceivedFile(const qint32& randomFlag);
+
+	// The rebuilt file did not match, receive the whole file into its place instead
+	void restartFileDelta(const qint32& randomFlag, const ReceivedFile& deltaFile);
+
+	// Drop a received file, writes still queued for it are skipped and the file is removed when removeFile
+	// is set. A striped file fails as a whole, its sender hears about it on the connect of stripe 0. The
+	// remote of this connect is not told, see sendTransferAbortToRemote
+	void abortReceivedFile(const qint32& randomFlag, const bool& removeFile);
+
+	// Drop chunked data being received, a file rebuilt from it is removed. The remote is not told either
+	void abortReceivedChunkedData(const qint32& randomFlag);
+
+	void sendTransferAbortToRemote(const qint8& packageFlag, const qint32& randomFlag);
+
+	// The remote gave up the transfer of randomFlag, whether this side sends or receives it
+	void onTransferAborted(const qint32& randomFlag);
+
+	void completeReceivedFile(const QSharedPointer<Package>& firstPackage, const bool& callbackOnFinish);
+
+	bool openFileStripe(const QSharedPointer<Package>& package, const bool& callbackOnFinish, QFile* file);
+
+	qint64 fileResumeOffset(const QSharedPointer<Package>& package, const QString& localFilePath);
+
+	static void saveFileResumeSidecar(const QSharedPointer<Package>& firstPackage, QFile* file);
+
+	static QByteArray fileResumeChecksum(QFile* file, const qint64& offset);
+
+	static bool preallocateFile(QFile* file, const qint64& fileSize);
+
+	static bool writeFileData(QFile* file, const qint64& offset, const QByteArray& fileData, const bool& syncRange);
+
 	void onReadyToDelete();
 
 	qint32 nextRandomFlag();
@@ -258,13 +622,26 @@ private:
 		return compressionPayloadData;
 	}
 
+	inline bool useFileZeroCopy(const int& fileDataSize) {
+		return m_connectSettings->fileZeroCopyEnabled && !m_connectSettings->packageChecksumEnabled &&
+			!this->needCompressionPayloadData(fileDataSize);
+	}
+
+	inline qint64 cutPackageSizeForPriority(const NetworkPriority& priority) const {
+		if ((priority == NetworkPriority::Bulk) && (m_connectSettings->bulkCutPackageSize != -1)) {
+			return m_connectSettings->bulkCutPackageSize;
+		}
+		return m_connectSettings->cutPackageSize;
+	}
+
 	bool readySendPayloadData(
 		const qint32& randomFlag,
 		const QString& targetActionFlag,
 		const QByteArray& payloadData,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-		const ConnectPointerFunction& failCallback);
+		const ConnectPointerFunction& failCallback,
+		const NetworkPriority& priority);
 
 	bool readySendFileData(
 		const qint32& randomFlag,
@@ -272,46 +649,172 @@ private:
 		const QFileInfo& fileInfo,
 		const QVariantMap& appendData,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+		const ConnectPointerFunction& failCallback,
+		const NetworkPriority& priority,
+		const QVariantMap& fileStripe = QVariantMap(),
+		const QVariantMap& fileBundle = QVariantMap());
+
+	bool readySendChunkedData(
+		const qint32& randomFlag,
+		const qint8& packageFlag,
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData,
+		const QSharedPointer<QIODevice>& source,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+		const ConnectPointerFunction& failCallback,
+		const NetworkPriority& priority);
+
+	// On the connect thread, once the manifest is computed, a null manifestPackage fails the send
+	void startSendChunkedData(
+		const qint32& randomFlag,
+		const WaitForSendChunkedData& waitForSendChunkedData,
+		const QSharedPointer<Package>& manifestPackage,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
 		const ConnectPointerFunction& failCallback);
 
+	void readySendFileBundle(const WaitForSendFileBundle& waitForSendFileBundle);
+
+	void readySendNextFileBundle();
+
 	void readySendPackages(
 		const qint32& randomFlag,
 		QList<QSharedPointer<Package>>& packages,
 		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
 		const ConnectPointerFunction& failCallback);
 
+	bool appendReadySendPackages(
+		QList<ReadySendPackages>& batch,
+		const qint32& randomFlag,
+		const NetworkBatchMessage& message,
+		const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+		const ConnectPointerFunction& failCallback,
+		const NetworkPriority& priority);
+
+	void readySendPackageBatch(QList<ReadySendPackages>& batch);
+
 	void sendDataRequestToRemote(const QSharedPointer<Package>& package);
 
+	inline void addMetric(const NetworkMetrics::Counter& counter, const qint64& value = 1) {
+		// Only the connect thread writes its own counters, a load and a store is enough for readers elsewhere
+		auto& metricCounter = m_metricCounters[counter];
+		metricCounter.store(metricCounter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		if (m_connectSettings->metrics) {
+			m_connectSettings->metrics->add(counter, value);
+		}
+	}
+
+	inline void traceMessage(const NetworkTracer::Stage& stage, const qint32& randomFlag) {
+		if (m_connectSettings->tracer) {
+			m_connectSettings->tracer->trace(stage, randomFlag, m_connectId);
+		}
+	}
+
+	inline void traceReassemblyComplete(const qint32& randomFlag) {
+		if (m_connectSettings->tracer) {
+			m_tracedReceivingMessages.remove(randomFlag);
+			m_connectSettings->tracer->trace(NetworkTracer::ReassemblyComplete, randomFlag, m_connectId);
+		}
+	}
+
+	void traceWrittenPackage(const QSharedPointer<Package>& package);
+
+	// The last package of a pulled file or chunked transfer was handed to sendPackageToRemote
+	void traceSendFinished(const qint32& randomFlag);
+
+	void traceReceivedPackage(const QSharedPointer<Package>& package);
+
 	void sendPackageToRemote(const QSharedPointer<Package>& package);
 
+	bool sendSchedulerHasRoom() const;
+
+	void runSendScheduler();
+
+	void writePackageToRemote(const QSharedPointer<Package>& package);
+
+	bool writeFileRangeToRemote(const QSharedPointer<Package>& package);
+
+	void flushWriteCoalescingBuffer();
+
+	void writeToTcpSocket(const QByteArray& buffer);
+
+	// Nothing is in flight right now, release the idle state once it stays like this for idleReleaseDelay
+	void scheduleIdleRelease();
+
+	// Frees the read buffer, and once nothing is in flight the allocations of the emptied pools
+	void releaseIdleState();
+
+	void applySocketOptions();
+
+	// Called by the TimerWheel, returns ms until the next check, -1: no more checks
+	qint64 onHeartbeatCheck(const qint64& currentTime);
+
+	// Called by the TimerWheel, same return value
+	qint64 onIdleReleaseCheck();
+
 private:
 	// Settings
 	QSharedPointer<ConnectSettings> m_connectSettings;
 	std::function<void(std::function<void()>)> m_runOnConnectThreadCallback;
+	static QMutex m_mutexForGlobalFileWriteThreadPool;
+	static QWeakPointer<NetworkThreadPool> m_globalFileWriteThreadPool;
+	QSharedPointer<NetworkThreadPool> m_fileWriteThreadPool;
 	// Socket
 	QSharedPointer<QTcpSocket> m_tcpSocket;
 	bool m_onceConnectSucceed = false;
 	bool m_isAbandonTcpSocket = false;
+	bool m_localTransport = false;
 	QByteArray m_tcpSocketBuffer;
+	QByteArray m_writeCoalescingBuffer;
+	bool m_batchWriting = false; // coalesce until readySendPackageBatch flushes, whatever writeCoalescingEnabled says
 	// Timer
 	QSharedPointer<QTimer> m_timerForConnectToHostTimeOut;
 	QSharedPointer<QTimer> m_timerForSendPackageCheck;
+	QSharedPointer<QTimer> m_timerForWriteCoalescing;
 	// Package
 	QMutex m_mutexForSend;
 	qint32 m_sendRandomFlagRotaryIndex = 0;
 	QMap<qint32, ReceivedCallbackPackage> m_onReceivedCallbacks; // randomFlag -> package
+	// Send scheduler, packages waiting for room in the socket write buffer, one queue per NetworkPriority
+	QList<QSharedPointer<Package>> m_sendSchedulerQueues[NETWORK_PRIORITYCOUNT];
+	int m_sendSchedulerQueuedCount = 0;
 	// Payload
 	QMap<qint32, QList<QSharedPointer<Package>>> m_sendPayloadPackagePool; // randomFlag -> package
 	QMap<qint32, QSharedPointer<Package>> m_receivePayloadPackagePool;	  // randomFlag -> package
 	// File
-	QMap<qint32, QSharedPointer<QFile>> m_waitForSendFiles; // randomFlag -> file
-	QMap<qint32, QPair<QSharedPointer<Package>, QSharedPointer<QFile>>> m_receivedFilePackagePool;
-	// randomFlag -> { package, file }
+	QMap<qint32, WaitForSendFile> m_waitForSendFiles; // randomFlag -> { file, priority }
+	QList<WaitForSendFileBundle> m_waitForSendFileBundles;
+	// Chunk deduplication
+	QMap<qint32, WaitForSendChunkedData> m_waitForSendChunkedDataPool; // randomFlag -> source and chunks
+	QMap<qint32, ReceivedChunkedData> m_receivedChunkedDataPool; // randomFlag -> manifest and progress
+	qint32 m_sendingFileBundleRandomFlag = 0; // the next bundle waits until this one has left the payload pool
+	QMap<qint32, ReceivedFile> m_receivedFilePackagePool; // randomFlag -> received file
+	static QMutex m_mutexForStripedReceivedFiles;
+	static QMap<QString, StripedReceivedFile> m_stripedReceivedFiles; // stripeId -> striped file
+	qint64 m_pendingFileWriteBytes = 0;
 	// Statistics
+	static std::atomic<quint64> m_nextConnectId;
+	const quint64 m_connectId;
 	qint64 m_connectCreateTime = 0;
 	qint64 m_connectSucceedTime = 0;
 	qint64 m_waitForSendBytes = 0;
 	qint64 m_alreadyWrittenBytes = 0;
+	std::atomic<qint64> m_sentPackageCount = { 0 }; // written on the connect thread, read from any thread
+	std::atomic<qint64> m_socketWriteCount = { 0 };
+	qint64 m_corruptedBytes = 0; // skipped while resynchronizing after corrupt framing
+	qint64 m_windowCorruptedBytes = 0; // skipped since m_corruptedWindowBegin, against maximumCorruptedBytes
+	qint64 m_corruptedWindowBegin = 0; // ms
+	bool m_peerSendsChecksum = false; // a checksummed package arrived, resynchronize only to checksummed heads
+	qint64 m_lastReceivedTime = 0; // heartbeat, ms
+	qint64 m_lastHeartbeatTime = 0;
+	bool m_idleReleaseScheduled = false;
+	bool m_activeSinceIdleCheck = false; // went idle again since the idle release check was scheduled
+	bool m_peerAnswersHeartbeat = false; // an older peer ignores pings, only a peer that answered can be timed out
+	std::array<std::atomic<qint64>, NetworkMetrics::CounterCount> m_metricCounters = {};
+	// Tracing, sampled messages between their first and last package
+	QSet<qint32> m_tracedSendingMessages;
+	QSet<qint32> m_tracedFinishedMessages; // last package still in the send scheduler
+	QSet<qint32> m_tracedReceivingMessages;
 };
 
 #endif // NETWORK_INCLUDE_NETWORK_CONNECT_H_
@@ -2,6 +2,9 @@
 #ifndef NETWORK_INCLUDE_NETWORK_CONNECTPOOL_H_
 #define NETWORK_INCLUDE_NETWORK_CONNECTPOOL_H_
 
+#include <QHash>
+#include <QSet>
+
 #include "foundation.h"
 
 struct ConnectPoolSettings {
@@ -28,10 +31,12 @@ public:
 	);
 	~ConnectPool() override;
 
+	// connectIndex > 0 opens an extra connect to the same host and port, used by striped file transfers
 	void createConnect(
 		std::function<void(std::function<void()>)> runOnConnectThreadCallback,
 		const QString& hostName,
-		const quint16& port
+		const quint16& port,
+		const int& connectIndex = 0
 	);
 
 	void createConnect(
@@ -39,9 +44,9 @@ public:
 		const qintptr& socketDescriptor
 	);
 
-	inline bool containsConnect(const QString& hostName, const quint16& port) {
+	inline bool containsConnect(const QString& hostName, const quint16& port, const int& connectIndex = 0) {
 		mutex_.lock();
-		auto contains = m_bimapForHostAndPort1.contains(QString("%1:%2").arg(hostName).arg(port));
+		auto contains = m_bimapForHostAndPort1.contains(connectKey(hostName, port, connectIndex));
 		mutex_.unlock();
 		return contains;
 	}
@@ -53,15 +58,51 @@ public:
 		return contains;
 	}
 
+	inline int connectCount() {
+		mutex_.lock();
+		const auto&& count = m_connectForConnecting.size() + m_connectForConnected.size();
+		mutex_.unlock();
+		return count;
+	}
+
+	inline QList<QPointer<Connect>> connectedConnects() {
+		QList<QPointer<Connect>> connects;
+		mutex_.lock();
+		connects.reserve(m_connectForConnected.size());
+		for (auto it = m_connectForConnected.begin(); it != m_connectForConnected.end(); ++it) {
+			connects.push_back(it.key());
+		}
+		mutex_.unlock();
+		return connects;
+	}
+
+	// Topic subscriptions of the connects of this pool, only touched on the thread of the pool, see Server::subscribe
+	void subscribe(const QPointer<Connect>& connect, const QString& topic);
+
+	void unsubscribe(const QPointer<Connect>& connect, const QString& topic);
+
+	// Implicitly shared, stays valid while connects closed by the caller unsubscribe
+	inline QSet<Connect*> topicSubscribers(const QString& topic) const {
+		return m_topicSubscribers.value(topic);
+	}
+
 	QPair<QString, quint16> getHostAndPortByConnect(const QPointer<Connect>& connect);
 
+	int getConnectIndexByConnect(const QPointer<Connect>& connect);
+
 	qintptr getSocketDescriptorByConnect(const QPointer<Connect>& connect);
 
-	QPointer<Connect> getConnectByHostAndPort(const QString& hostName, const quint16& port);
+	QPointer<Connect> getConnectByHostAndPort(const QString& hostName, const quint16& port, const int& connectIndex = 0);
 
 	QPointer<Connect> getConnectBySocketDescriptor(const qintptr& socketDescriptor);
 
 private:
+	static inline QString connectKey(const QString& hostName, const quint16& port, const int& connectIndex) {
+		return (connectIndex)
+			? (QString("%1:%2#%3").arg(hostName, QString::number(port), QString::number(connectIndex)))
+			: (QString("%1:%2").arg(hostName, QString::number(port)));
+	}
+
 	inline void onConnectToHostError(const QPointer<Connect>& connect) {
 		NETWORK_NULLPTR_CHECK(m_connectPoolSettings->connectToHostErrorCallback);
 		m_connectPoolSettings->connectToHostErrorCallback(connect, this);
@@ -129,13 +170,16 @@ private:
 	// Settings
 	QSharedPointer<ConnectPoolSettings> m_connectPoolSettings;
 	QSharedPointer<ConnectSettings> m_connectSettings;
-	// Connect
-	QMap<Connect*, QSharedPointer<Connect>> m_connectForConnecting;
-	QMap<Connect*, QSharedPointer<Connect>> m_connectForConnected;
-	QMap<QString, QPointer<Connect>> m_bimapForHostAndPort1; // "127.0.0.1:34543" -> Connect
-	QMap<Connect*, QString> m_bimapForHostAndPort2; // Connect -> "127.0.0.1:34543"
-	QMap<qintptr, QPointer<Connect>> m_bimapForSocketDescriptor1; // socketDescriptor -> Connect
-	QMap<Connect*, qintptr> m_bimapForSocketDescriptor2; // Connect -> socketDescriptor
+	// Connect, hashed: a node per entry of a QMap costs more than a slot in a QHash at tens of thousands of connects
+	QHash<Connect*, QSharedPointer<Connect>> m_connectForConnecting;
+	QHash<Connect*, QSharedPointer<Connect>> m_connectForConnected;
+	QHash<QString, QPointer<Connect>> m_bimapForHostAndPort1; // "127.0.0.1:34543" or "127.0.0.1:34543#1" -> Connect
+	QHash<Connect*, QString> m_bimapForHostAndPort2; // Connect -> "127.0.0.1:34543" or "127.0.0.1:34543#1"
+	QHash<qintptr, QPointer<Connect>> m_bimapForSocketDescriptor1; // socketDescriptor -> Connect
+	QHash<Connect*, qintptr> m_bimapForSocketDescriptor2; // Connect -> socketDescriptor
+	// Topic, thread of the pool only
+	QHash<QString, QSet<Connect*>> m_topicSubscribers; // topic -> Connects
+	QHash<Connect*, QSet<QString>> m_connectTopics; // Connect -> topics
 	// Other
 	QMutex mutex_;
 };
@@ -5,6 +5,7 @@
 #include <functional>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 #include <QObject>
 #include <QSharedPointer>
@@ -21,8 +22,28 @@
 #define NETWORKPACKAGE_PAYLOADDATAREQUESTPACKGEFLAG qint8( 0x2 )
 #define NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG qint8( 0x3 )
 #define NETWORKPACKAGE_FILEDATAREQUESTPACKGEFLAG qint8( 0x4 )
+#define NETWORKPACKAGE_HEARTBEATPACKGEFLAG qint8( 0x5 ) // head only, randomFlag NETWORKPACKAGE_HEARTBEATPING asks for one back
+#define NETWORKPACKAGE_HEARTBEATPING qint32( 1 )
+#define NETWORKPACKAGE_HEARTBEATPONG qint32( 2 )
 #define NETWORKPACKAGE_UNCOMPRESSEDFLAG qint8( 0x1 )
 #define NETWORKPACKAGE_COMPRESSEDFLAG qint8( 0x2 )
+#define NETWORKPACKAGE_CHECKSUMFLAG qint8( 0x10 ) // or'ed into payloadDataFlag on the wire, a CRC32C of the head and one of the package follow the head
+#define NETWORKPACKAGE_HEADCHECKSUMSIZE 4
+#define NETWORKPACKAGE_CHECKSUMSIZE 8 // head checksum and package checksum
+
+#define NETWORK_PRIORITYCOUNT 3
+
+#define NETWORKPACKAGE_FILERESUMECHECKSIZE qint64( 64 * 1024 )
+
+#define NETWORKPACKAGE_FILEDELTACOPYFLAG qint8( 0x1 )
+#define NETWORKPACKAGE_FILEDELTALITERALFLAG qint8( 0x2 )
+#define NETWORKPACKAGE_FILEDELTAMINIMUMBLOCKSIZE qint64( 2 * 1024 )
+#define NETWORKPACKAGE_FILEDELTAMAXIMUMBLOCKSIZE qint64( 128 * 1024 )
+
+#define NETWORKPACKAGE_CHUNKMINIMUMSIZE qint64( 16 * 1024 )
+#define NETWORKPACKAGE_CHUNKAVERAGESIZEBITS 16 // 64 KB
+#define NETWORKPACKAGE_CHUNKMAXIMUMSIZE qint64( 256 * 1024 )
+#define NETWORKPACKAGE_CHUNKHASHSIZE 32 // sha256
 
 #if ( defined Q_OS_IOS ) || ( defined Q_OS_ANDROID )
 #   define NETWORK_ADVISE_THREADCOUNT 1
@@ -55,10 +76,13 @@ class QJsonArray;
 class QJsonValue;
 class QJsonDocument;
 class QFile;
+class QCryptographicHash;
+class QIODevice;
 class QDir;
 class QFileInfo;
 class QTcpSocket;
 class QTcpServer;
+class QLocalServer;
 class QUdpSocket;
 
 class Package;
@@ -68,6 +92,7 @@ class Server;
 class Processor;
 class Client;
 class Lan;
+class NetworkMetrics;
 
 struct ConnectSettings;
 struct ConnectPoolSettings;
@@ -102,6 +127,30 @@ using LanSettingsSharedPointer = QSharedPointer<LanSettings>;
 
 using ConnectPointerFunction = std::function<void(const ConnectPointer& connect)>;
 using ConnectPointerAndPackageSharedPointerFunction = std::function<void(const ConnectPointer& connect, const PackageSharedPointer& package)>;
+using ConnectPointerAndPackageSharedPointerListFunction = std::function<void(const ConnectPointer& connect, const QList<PackageSharedPointer>& packages)>;
+
+// Local send priority, lower value is written to the socket first
+enum class NetworkPriority {
+	Control = 0,
+	Interactive = 1,
+	Bulk = 2
+};
+
+// What Server::broadcast does with a connect that already has too many bytes waiting for its socket
+enum class NetworkSlowConsumerPolicy {
+	Send = 0, // queue the frame anyway
+	Skip = 1, // leave the connect out of this broadcast
+	Disconnect = 2 // close the connect
+};
+
+// One message of a sendBatch or putBatch, putBatch ignores the callbacks
+struct NetworkBatchMessage {
+	QString targetActionFlag;
+	QByteArray payloadData;
+	QVariantMap appendData;
+	ConnectPointerAndPackageSharedPointerFunction succeedCallback = nullptr;
+	ConnectPointerFunction failCallback = nullptr;
+};
 
 struct NetworkOnReceivedCallbackPackage {
 	std::function<void(const ConnectPointer& connect, const PackageSharedPointer&)> succeedCallback = nullptr;
@@ -119,11 +168,17 @@ public:
 
 	void run(const std::function<void()>& callback);
 
+	// Callbacks waiting for this thread, read without the lock
+	inline int queuedCallbackCount() const {
+		return m_queuedCallbackCount.load(std::memory_order_relaxed);
+	}
+
 public Q_SLOTS:
 	void onRun();
 
 private:
 	QMutex m_mutex;
+	std::atomic<int> m_queuedCallbackCount = { 0 };
 	QSharedPointer<std::vector<std::function<void()>>> m_waitForRunCallbacks;
 	bool m_alreadyCall = false;
 	qint64 m_lastRunTime = 0;
@@ -146,6 +201,16 @@ public:
 
 	int run(const std::function<void()>& callback, const int& threadIndex = -1);
 
+	// threadIndex for run of one of the threads of this pool, -1 for any other thread
+	inline int threadIndex(const QThread* thread) const {
+		for (auto index = 0; index < m_helpers->size(); ++index) {
+			if ((*m_helpers)[index] && ((*m_helpers)[index]->thread() == thread)) {
+				return index;
+			}
+		}
+		return -1;
+	}
+
 	inline void runEach(const std::function<void()>& callback) {
 		for (auto index = 0; index < m_helpers->size(); ++index) {
 			(*m_helpers)[index]->run(callback);
@@ -154,6 +219,12 @@ public:
 
 	int waitRun(const std::function<void()>& callback, const int& threadIndex = -1);
 
+	inline int threadCount() const {
+		return m_helpers->size();
+	}
+
+	int queuedCallbackCount() const;
+
 	inline void waitRunEach(const std::function<void()>& callback) {
 		for (auto index = 0; index < m_helpers->size(); ++index) {
 			this->waitRun(callback, index);
@@ -0,0 +1,59 @@
+﻿#ifndef NETWORK_INCLUDE_NETWORK_FUTURE_H_
+#define NETWORK_INCLUDE_NETWORK_FUTURE_H_
+
+#include <QFuture>
+#include <QPromise>
+#include <QList>
+
+#include "foundation.h"
+
+// Outcome of one request, package is null when the send was refused or the connect was lost before the reply
+struct NetworkReply {
+	ConnectPointer connect;
+	PackageSharedPointer package;
+
+	inline bool succeed() const {
+		return !package.isNull();
+	}
+};
+
+using NetworkReplyFuture = QFuture<NetworkReply>;
+
+// Turns the succeedCallback / failCallback pair of a send into a QFuture, the first side to report settles it.
+// Continuations go through QFuture::then, pass a QObject or a QThreadPool there to pick where they run
+class NetworkReplyPromise {
+public:
+	NetworkReplyPromise();
+
+	NetworkReplyFuture future() const;
+
+	ConnectPointerAndPackageSharedPointerFunction succeedCallback() const;
+
+	ConnectPointerFunction failCallback() const;
+
+	// For a send that returned 0, some refusals never reach failCallback
+	void fail(const ConnectPointer& connect = nullptr);
+
+private:
+	struct State {
+		QMutex mutex;
+		QPromise<NetworkReply> promise;
+		bool finished = false;
+
+		void finish(const NetworkReply& reply);
+	};
+
+	QSharedPointer<State> m_state;
+};
+
+namespace NetworkFuture {
+
+// Settles once every future has, replies keep the order of futures and failed ones stay in place
+QFuture<QList<NetworkReply>> whenAll(const QList<NetworkReplyFuture>& futures);
+
+// Settled futures, for functions that refuse before anything is sent
+NetworkReplyFuture makeFailed(const ConnectPointer& connect = nullptr);
+
+}
+
+#endif//NETWORK_INCLUDE_NETWORK_FUTURE_H_
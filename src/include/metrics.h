@@ -0,0 +1,95 @@
+﻿#ifndef NETWORK_INCLUDE_NETWORK_METRICS_H_
+#define NETWORK_INCLUDE_NETWORK_METRICS_H_
+
+#include <array>
+#include <atomic>
+
+#include "foundation.h"
+
+// Process wide totals of every connect sharing one ConnectSettings, a Server always has one. Updates are a
+// single relaxed atomic add, reading is a snapshot that may be a moment behind on other threads
+class NetworkMetrics {
+	Q_DISABLE_COPY(NetworkMetrics)
+
+public:
+	enum Counter {
+		SentBytes = 0,
+		ReceivedBytes,
+		SentPackages,
+		ReceivedPackages,
+		SentFileChunks,
+		ReceivedFileChunks,
+		CompressedOriginalBytes, // payload size of compressed packages before compression
+		CompressedWireBytes, // and after
+		ChecksumErrors,
+		CorruptedBytes,
+		ReplyTimeouts,
+		SlowConsumerSkips, // broadcast frames a connect did not get, see NetworkSlowConsumerPolicy
+		CounterCount
+	};
+
+	enum Gauge {
+		Connections = 0,
+		SocketThreads,
+		CallbackThreads,
+		SocketThreadQueueDepth, // callbacks waiting in the NetworkThreadPoolHelper queues
+		CallbackThreadQueueDepth,
+		GaugeCount
+	};
+
+	enum Histogram {
+		ReplyLatency = 0, // package sent until its reply arrived
+		CallbackQueueLatency, // package received until its callback started on the callback pool
+		HistogramCount
+	};
+
+	// Bucket i counts observations up to 2^i microseconds, the last one everything above
+	static constexpr int HistogramBucketCount = 26;
+
+	NetworkMetrics() = default;
+
+	~NetworkMetrics() = default;
+
+	inline void add(const Counter& counter, const qint64& value = 1) {
+		m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	inline qint64 counter(const Counter& counter) const {
+		return m_counters[counter].load(std::memory_order_relaxed);
+	}
+
+	inline void setGauge(const Gauge& gauge, const qint64& value) {
+		m_gauges[gauge].store(value, std::memory_order_relaxed);
+	}
+
+	inline qint64 gauge(const Gauge& gauge) const {
+		return m_gauges[gauge].load(std::memory_order_relaxed);
+	}
+
+	void observe(const Histogram& histogram, const qint64& microseconds);
+
+	qint64 histogramCount(const Histogram& histogram) const;
+
+	// Prometheus text exposition format, version 0.0.4
+	QByteArray toPrometheusText(const QString& prefix = "network") const;
+
+	static qint64 nowMicroseconds();
+
+	static const char* counterName(const Counter& counter);
+
+	static const char* gaugeName(const Gauge& gauge);
+
+	static const char* histogramName(const Histogram& histogram);
+
+private:
+	struct HistogramData {
+		std::array<std::atomic<qint64>, HistogramBucketCount> buckets = {};
+		std::atomic<qint64> sum = { 0 }; // microseconds
+	};
+
+	std::array<std::atomic<qint64>, CounterCount> m_counters = {};
+	std::array<std::atomic<qint64>, GaugeCount> m_gauges = {};
+	std::array<HistogramData, HistogramCount> m_histograms;
+};
+
+#endif//NETWORK_INCLUDE_NETWORK_METRICS_H_
@@ -1,5 +1,9 @@
 ﻿
 #include "foundation.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "future.h"
+#include "awaitable.h"
 #include "package.h"
 #include "connect.h"
 #include "connectpool.h"
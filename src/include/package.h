@@ -23,7 +23,27 @@ public:
 		return sizeof(m_head);
 	}
 
-	static qint32 checkDataIsReadyReceive(const QByteArray& rawData);
+	// requireChecksum rejects a head without the checksum flag, for streams known to carry checksums
+	static qint32 checkDataIsReadyReceive(const QByteArray& rawData, const bool& requireChecksum = false);
+
+	// data holds at least checkedHeadSize(data) bytes. A head with the checksum flag is only valid when its
+	// own checksum matches, so the length fields of a stray boot flag are never trusted
+	static bool isValidHead(const char* data, const bool& requireChecksum = false);
+
+	// data holds at least headSize() bytes, the head and the head checksum when it has one
+	static int checkedHeadSize(const char* data);
+
+	// Index of the next boot flag at or after from that starts a valid head, or that is too close to the end
+	// to tell yet, rawData.size() when there is none
+	static int nextHeadIndex(const QByteArray& rawData, const int& from, const bool& requireChecksum = false);
+
+	// CRC32C (Castagnoli), SSE4.2 or ARMv8 CRC instructions when the CPU has them, a table otherwise.
+	// Pass the previous result as crc to continue a checksum over more data
+	static quint32 crc32c(const char* data, const qint64& size, const quint32& crc = 0);
+
+	static inline quint32 crc32c(const QByteArray& data, const quint32& crc = 0) {
+		return crc32c(data.constData(), data.size(), crc);
+	}
 
 	static QSharedPointer<Package> readPackage(QByteArray& rawData);
 
@@ -33,7 +53,8 @@ public:
 		const QVariantMap& appendData,
 		const qint32& randomFlag,
 		qint64 cutPackageSize = -1,
-		const bool& compressionData = false);
+		const bool& compressionData = false,
+		const QVariantMap& fileBundle = QVariantMap());
 
 	static QSharedPointer<Package> createFileTransportPackage(
 		const QString& targetActionFlag,
@@ -41,11 +62,58 @@ public:
 		const QByteArray& fileData,
 		const QVariantMap& appendData,
 		const qint32& randomFlag,
-		const bool& compressionData = false);
+		const bool& compressionData = false,
+		const qint64& fileOffset = -1,
+		const QVariantMap& fileStripe = QVariantMap(),
+		const bool& fileDelta = false);
+
+	// Payload stays in the file until the package is written, so it can go out with sendfile
+	static QSharedPointer<Package> createFileTransportPackage(
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData,
+		const qint32& randomFlag,
+		const QSharedPointer<QFile>& payloadFile,
+		const qint64& payloadFileOffset,
+		const qint32& payloadSize,
+		const qint64& fileOffset = -1,
+		const QVariantMap& fileStripe = QVariantMap());
 
 	static QSharedPointer<Package> createPayloadDataRequestPackage(const qint32& randomFlag);
 
-	static QSharedPointer<Package> createFileDataRequestPackage(const qint32& randomFlag);
+	// Only a head, 24 bytes on the wire
+	static QSharedPointer<Package> createHeartbeatPackage(const bool& replyWanted);
+
+	// First package of a deduplicated payload or file, the payload is the chunk manifest instead of the data
+	static QSharedPointer<Package> createChunkManifestPackage(
+		const qint8& packageFlag,
+		const QString& targetActionFlag,
+		const QFileInfo& fileInfo,
+		const QVariantMap& appendData,
+		const qint32& randomFlag,
+		const qint64& chunkedDataSize,
+		const QByteArray& chunkManifest);
+
+	// Answer to a chunk manifest, one bit per chunk the receiver does not have yet
+	static QSharedPointer<Package> createChunkWantsPackage(
+		const qint8& packageFlag,
+		const qint32& randomFlag,
+		const QByteArray& chunkWants);
+
+	static QSharedPointer<Package> createFileDataRequestPackage(
+		const qint32& randomFlag,
+		const qint64& fileResumeOffset = -1,
+		const QByteArray& fileResumeChecksum = QByteArray(),
+		const qint64& fileDeltaBlockSize = -1,
+		const QByteArray& fileDeltaSignatures = QByteArray());
+
+	// Receiver of a file delta, whether the rebuilt file matched the sender's hash. A mismatch asks the
+	// sender for the whole file instead
+	static QSharedPointer<Package> createFileDeltaResultPackage(const qint32& randomFlag, const bool& verified);
+
+	// Either side gives up the transfer of randomFlag, the sender fails its callbacks and the receiver drops
+	// what it has received
+	static QSharedPointer<Package> createTransferAbortPackage(const qint8& packageFlag, const qint32& randomFlag);
 
 	QDateTime fileCreatedTime() const;
 
@@ -159,6 +227,102 @@ public:
 			: (0);
 	}
 
+	inline QString fileTransferId() const {
+		return (m_metaDataInVariantMap.contains("fileTransferId"))
+			? (m_metaDataInVariantMap["fileTransferId"].toString())
+			: (QString());
+	}
+
+	inline qint64 fileOffset() const {
+		return (m_metaDataInVariantMap.contains("fileOffset")) ? (m_metaDataInVariantMap["fileOffset"].toLongLong()) : (-1);
+	}
+
+	// { id, index, count, offset, size } of one range of a striped file transfer
+	inline QVariantMap fileStripe() const {
+		return (m_metaDataInVariantMap.contains("fileStripe"))
+			? (m_metaDataInVariantMap["fileStripe"].toMap())
+			: (QVariantMap());
+	}
+
+	// { root, index, count, files: [ [ relativePath, size, permissions, lastModified ], ... ] }, the payload
+	// holds the contents of the files back to back in the same order. A file too big for a bundle is sent as
+	// a file transfer of its own with { root, index, count, path }
+	inline QVariantMap fileBundle() const {
+		return (m_metaDataInVariantMap.contains("fileBundle"))
+			? (m_metaDataInVariantMap["fileBundle"].toMap())
+			: (QVariantMap());
+	}
+
+	inline int fileBundleIndex() const {
+		return this->fileBundle().value("index", -1).toInt();
+	}
+
+	inline int fileBundleCount() const {
+		return this->fileBundle().value("count", 0).toInt();
+	}
+
+	// The sender asks for the receiver's block signatures and then sends the file as copy and literal instructions
+	inline bool isFileDelta() const {
+		return m_metaDataInVariantMap.value("fileDelta", false).toBool();
+	}
+
+	// Set on the data request carrying the block signatures, the payload holds the signatures
+	inline qint64 fileDeltaBlockSize() const {
+		return (m_metaDataInVariantMap.contains("fileDeltaBlockSize"))
+			? (m_metaDataInVariantMap["fileDeltaBlockSize"].toLongLong())
+			: (-1);
+	}
+
+	// Size of the data a chunk manifest describes, -1 when this is not a chunk manifest
+	inline qint64 chunkedDataSize() const {
+		return (m_metaDataInVariantMap.contains("chunkedDataSize"))
+			? (m_metaDataInVariantMap["chunkedDataSize"].toLongLong())
+			: (-1);
+	}
+
+	// CRC32C of the file data sent since the transfer started or last moved to fileOffset, set on the last
+	// data package of a file when package checksums are on
+	inline qint64 fileChecksum() const {
+		return (m_metaDataInVariantMap.contains("fileChecksum"))
+			? (m_metaDataInVariantMap["fileChecksum"].toLongLong())
+			: (-1);
+	}
+
+	void setFileChecksum(const quint32& fileChecksum);
+
+	void setFileBundle(const QVariantMap& fileBundle);
+
+	// Hex SHA-256 of the whole file, set on the last package of a file delta
+	inline QByteArray fileHash() const {
+		return m_metaDataInVariantMap.value("fileHash").toByteArray();
+	}
+
+	void setFileHash(const QByteArray& fileHash);
+
+	inline bool containsFileDeltaResult() const {
+		return m_metaDataInVariantMap.contains("fileDeltaVerified");
+	}
+
+	inline bool isFileDeltaVerified() const {
+		return m_metaDataInVariantMap.value("fileDeltaVerified", false).toBool();
+	}
+
+	inline bool isTransferAborted() const {
+		return m_metaDataInVariantMap.value("transferAborted", false).toBool();
+	}
+
+	inline qint64 fileResumeOffset() const {
+		return (m_metaDataInVariantMap.contains("fileResumeOffset"))
+			? (m_metaDataInVariantMap["fileResumeOffset"].toLongLong())
+			: (-1);
+	}
+
+	inline QByteArray fileResumeChecksum() const {
+		return (m_metaDataInVariantMap.contains("fileResumeChecksum"))
+			? (m_metaDataInVariantMap["fileResumeChecksum"].toByteArray())
+			: (QByteArray());
+	}
+
 	inline bool containsFile() const {
 		return !m_localFilePath.isEmpty();
 	}
@@ -171,6 +335,29 @@ public:
 		m_localFilePath = localFilePath;
 	}
 
+	inline NetworkPriority sendPriority() const {
+		return m_sendPriority;
+	}
+
+	inline void setSendPriority(const NetworkPriority& sendPriority) {
+		m_sendPriority = sendPriority;
+	}
+
+	inline bool hasPayloadFileRange() const {
+		return !m_payloadFile.isNull();
+	}
+
+	inline QSharedPointer<QFile> payloadFile() const {
+		return m_payloadFile;
+	}
+
+	inline qint64 payloadFileOffset() const {
+		return m_payloadFileOffset;
+	}
+
+	// Read the file range into payloadData, toByteArray only has the head and meta data before this
+	bool loadPayloadFileRange();
+
 	inline void clearMetaData() {
 		m_metaData.clear();
 	}
@@ -181,7 +368,46 @@ public:
 
 	inline QByteArray toByteArray() const {
 		QByteArray buffer;
-		buffer.append(reinterpret_cast<const char*>(&m_head), headSize());
+		buffer.reserve(this->byteArraySize());
+		this->appendToByteArray(buffer);
+		return buffer;
+	}
+
+	// Checksum of the head, and over the head, meta data and payload, as they go on the wire. A received
+	// package with a wrong checksum is marked as abandon package
+	void computeChecksum();
+
+	// Keep the bytes as they go on the wire, later writes append them as they are. The package does not
+	// change afterwards, so one encoded package can be queued on connects of different threads
+	void encodeFrame();
+
+	inline bool hasChecksum() const {
+		return m_hasChecksum;
+	}
+
+	inline int byteArraySize() const {
+		if (!m_encodedFrame.isEmpty()) {
+			return m_encodedFrame.size();
+		}
+		return headSize() + ((m_hasChecksum) ? (NETWORKPACKAGE_CHECKSUMSIZE) : (0)) +
+			((m_head.metaDataCurrentSize > 0) ? (m_metaData.size()) : (0)) +
+			((m_head.payloadDataCurrentSize > 0) ? (m_payloadData.size()) : (0));
+	}
+
+	inline void appendToByteArray(QByteArray& buffer) const {
+		if (!m_encodedFrame.isEmpty()) {
+			buffer.append(m_encodedFrame);
+			return;
+		}
+		if (m_hasChecksum) {
+			auto head = m_head;
+			head.payloadDataFlag |= NETWORKPACKAGE_CHECKSUMFLAG;
+			buffer.append(reinterpret_cast<const char*>(&head), headSize());
+			buffer.append(reinterpret_cast<const char*>(&m_headChecksum), NETWORKPACKAGE_HEADCHECKSUMSIZE);
+			buffer.append(reinterpret_cast<const char*>(&m_checksum), NETWORKPACKAGE_CHECKSUMSIZE - NETWORKPACKAGE_HEADCHECKSUMSIZE);
+		} else {
+			buffer.append(reinterpret_cast<const char*>(&m_head), headSize());
+		}
 
 		if (m_head.metaDataCurrentSize > 0) {
 			buffer.append(m_metaData);
@@ -190,8 +416,6 @@ public:
 		if (m_head.payloadDataCurrentSize > 0) {
 			buffer.append(m_payloadData);
 		}
-
-		return buffer;
 	}
 
 	bool mixPackage(const QSharedPointer<Package>& mixPackage);
@@ -201,6 +425,9 @@ public:
 private:
 	bool m_isCompletePackage = false;
 	bool m_isAbandonPackage = false;
+	bool m_hasChecksum = false;
+	quint32 m_headChecksum = 0;
+	quint32 m_checksum = 0; // continues from m_headChecksum
 
 #pragma pack(push)
 #pragma pack(1)
@@ -219,7 +446,11 @@ private:
 
 	QByteArray m_metaData;
 	QByteArray m_payloadData;
+	QByteArray m_encodedFrame;
 	QString m_localFilePath;
+	QSharedPointer<QFile> m_payloadFile;
+	qint64 m_payloadFileOffset = -1;
+	NetworkPriority m_sendPriority = NetworkPriority::Interactive;
 	qint32 m_metaDataOriginalIndex = -1;
 	qint32 m_metaDataOriginalCurrentSize = -1;
 	qint32 m_payloadDataOriginalIndex = -1;
@@ -128,7 +128,9 @@ public:
 	~Processor() override = default;
 	QSet<QString> availableSlots();
 	bool handlePackage(const QPointer<Connect>& connect, const QSharedPointer<Package>& package);
-	void setReceivedPossibleThreads(const QSet<QThread*>& threads);
+	// The handling thread no longer needs registering, kept so existing callers still build
+	[[deprecated("Processor works on any thread, the call can be removed")]]
+	inline void setReceivedPossibleThreads(const QSet<QThread*>&) { }
 	static bool checkMapContains(const QStringList& keys, const QVariantMap& received, QVariantMap& send);
 	static bool checkMapContainsAndNot0(const QStringList& keys, const QVariantMap& received, QVariantMap& send);
 	static bool checkMapContainsAndNotEmpty(const QStringList& keys, const QVariantMap& received, QVariantMap& send);
@@ -136,6 +138,40 @@ public:
 		const QVariantMap& received, QVariantMap& send);
 protected:
 	QPointer<Connect> currentThreadConnect();
+	QSharedPointer<Package> currentThreadPackage();
+	// Skip the automatic reply of the package being handled, the handler answers later through
+	// currentThreadConnect()->replyPayloadData with the randomFlag of currentThreadPackage(),
+	// e.g. from a NetworkTask that co_awaits downstream calls without holding the callback thread
+	void deferReply();
+private:
+	// Context of the package being handled on the current thread, kept in a thread-local
+	// stack so a processor can run on any thread without prior registration
+	struct HandleContext {
+		const Processor* processor;
+		QPointer<Connect> connect;
+		QSharedPointer<Package> package;
+		HandleContext* previous;
+		bool replyDeferred;
+	};
+	// Pushes a context for its lifetime, so a throwing slot still pops it
+	class HandleContextScope {
+	public:
+		explicit HandleContextScope(HandleContext& context) :
+			context_(context) {
+			auto& threadContext = threadHandleContext();
+			context_.previous = threadContext;
+			threadContext = &context_;
+		}
+		~HandleContextScope() {
+			threadHandleContext() = context_.previous;
+		}
+		HandleContextScope(const HandleContextScope&) = delete;
+		HandleContextScope& operator=(const HandleContextScope&) = delete;
+	private:
+		HandleContext& context_;
+	};
+	static HandleContext*& threadHandleContext();
+	const HandleContext* currentHandleContext() const;
 private:
     inline static void deleteByteArray(QByteArray *ptr)
     {
@@ -151,7 +187,6 @@ private:
 	static QSet<QString> exceptionSlots_;
 	bool invokeMethodByProcessorThread_;
 	QSet<QString> availableSlots_;
-	QMap<QThread*, QPointer<Connect>> connectMapByThread_;
 	QMap<QString, std::function<void(const QPointer<Connect>& connect,
 		const QSharedPointer<Package>& package)>> onpackageReceivedCallbacks_;
 };
@@ -7,6 +7,8 @@ struct ServerSettings {
 	QString dutyMark;
 	QHostAddress listenAddress = QHostAddress::Any;
 	quint16 listenPort = 0;
+	quint16 metricsPort = 0; // > 0: serve metricsText() over HTTP at http://listenAddress:metricsPort/metrics
+	bool localListenEnabled = false; // Linux, also accept same host connects on the Unix domain socket Connect::localServerName(listenPort)
 	std::function<void(const QPointer<Connect>&)> connectToHostErrorCallback = nullptr;
 	std::function<void(const QPointer<Connect>&)> connectToHostTimeoutCallback = nullptr;
 	std::function<void(const QPointer<Connect>&)> connectToHostSucceedCallback = nullptr;
@@ -15,6 +17,9 @@ struct ServerSettings {
 	std::function<void(const QPointer<Connect>&, const qint32&, const qint64&, const qint64&, const qint64&)> packageSendingCallback = nullptr;
 	std::function<void(const QPointer<Connect>&, const qint32&, const qint64&, const qint64&, const qint64&)> packageReceivingCallback = nullptr;
 	std::function<void(const QPointer<Connect>&, const QSharedPointer<Package>&)> packageReceivedCallback =	nullptr;
+	qint64 broadcastSlowConsumerBytes = 4 * 1024 * 1024; // unsent bytes that make a connect a slow consumer of broadcast, -1: never
+	NetworkSlowConsumerPolicy broadcastSlowConsumerPolicy = NetworkSlowConsumerPolicy::Skip;
+	NetworkPriority broadcastPriority = NetworkPriority::Interactive; // send scheduler queue of broadcast, multicast and publish frames
 	int globalServerThreadCount = 1;
 	int globalSocketThreadCount = NETWORK_ADVISE_THREADCOUNT;
 	int globalCallbackThreadCount = NETWORK_ADVISE_THREADCOUNT;
@@ -50,8 +55,42 @@ public:
 		return m_nodeMarkSummary;
 	}
 
+	inline QSharedPointer<NetworkMetrics> metrics() const {
+		return m_connectSettings->metrics;
+	}
+
+	// Counters and histograms of every connect of this server, gauges sampled now, Prometheus text format
+	QByteArray metricsText();
+
 	bool begin();
 
+	// Push one message that wants no reply to every connected connect. It is encoded and compressed once into
+	// a single package shared by all of them, every socket thread gets one task writing it to its own connects.
+	// Slow consumers are handled by broadcastSlowConsumerPolicy, returns false if the message could not be encoded
+	bool broadcast(
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData = QVariantMap());
+
+	// broadcast limited to connects of this server
+	bool multicast(
+		const QList<QPointer<Connect>>& connects,
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData = QVariantMap());
+
+	// Topic subscriptions live in the ConnectPool of the socket thread of the connect and are dropped when it closes.
+	// Both are queued on that thread behind earlier publish calls, a publish after subscribe returns reaches the connect
+	void subscribe(const QPointer<Connect>& connect, const QString& topic);
+
+	void unsubscribe(const QPointer<Connect>& connect, const QString& topic);
+
+	// broadcast to the subscribers of topic, the topic is the targetActionFlag of the message
+	bool publish(
+		const QString& topic,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData = QVariantMap());
+
 	void registerProcessor(const QPointer<Processor>& processor);
 
 	inline QSet<QString> availableProcessorMethodNames() const {
@@ -62,6 +101,13 @@ public:
 private:
 	void incomingConnection(const qintptr& socketDescriptor);
 
+	void onMetricsConnection();
+
+	QSharedPointer<Package> encodeSharedFrame(
+		const QString& targetActionFlag,
+		const QByteArray& payloadData,
+		const QVariantMap& appendData);
+
 	inline void onConnectToHostError(const QPointer<Connect>& connect,
 		const QPointer<ConnectPool>& connectPool) {
 		if (!m_serverSettings->connectToHostErrorCallback) {
@@ -182,6 +228,8 @@ private:
 	QSharedPointer<ConnectSettings> m_connectSettings;
 	// Server
 	QSharedPointer<QTcpServer> m_tcpServer;
+	QSharedPointer<QTcpServer> m_metricsTcpServer;
+	QSharedPointer<QLocalServer> m_localServer;
 	QMap<QThread*, QSharedPointer<ConnectPool>> m_connectPools;
 	// Processor
 	QSet<Processor*> m_processors;
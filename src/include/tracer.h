@@ -0,0 +1,82 @@
+﻿#ifndef NETWORK_INCLUDE_NETWORK_TRACER_H_
+#define NETWORK_INCLUDE_NETWORK_TRACER_H_
+
+#include <atomic>
+#include <memory>
+
+#include <QVector>
+
+#include "foundation.h"
+
+// Opt-in per message lifecycle tracing. Each stage a sampled message passes is one event in a fixed size ring,
+// recording never locks and never waits, the oldest events are overwritten once the ring is full
+class NetworkTracer {
+	Q_DISABLE_COPY(NetworkTracer)
+
+public:
+	enum Stage {
+		Enqueued = 0, // send or reply call accepted the message
+		FirstByteWritten, // first package of the message handed to the socket
+		LastChunkWritten, // last package of the message handed to the socket
+		FirstByteReceived, // first package of the message read from the socket
+		ReassemblyComplete, // every package received, the callback is about to be dispatched
+		CallbackDispatched, // callback queued on the callback thread pool
+		CallbackStarted,
+		CallbackFinished,
+		StageCount
+	};
+
+	struct Event {
+		qint64 time; // microseconds, NetworkMetrics::nowMicroseconds
+		quint64 threadId;
+		quint64 connectId; // Connect::connectId, a randomFlag is only unique per connect
+		qint32 randomFlag;
+		Stage stage;
+	};
+
+	// capacity is rounded up to a power of two. A message is traced when its randomFlag is a multiple of
+	// sampleInterval, so both ends of a connect and the reply of a request pick the same messages
+	explicit NetworkTracer(const int& capacity = 64 * 1024, const int& sampleInterval = 1);
+
+	~NetworkTracer() = default;
+
+	inline bool isSampled(const qint32& randomFlag) const {
+		return !(randomFlag % m_sampleInterval);
+	}
+
+	inline void trace(const Stage& stage, const qint32& randomFlag, const quint64& connectId) {
+		if (!this->isSampled(randomFlag)) {
+			return;
+		}
+		this->record(stage, randomFlag, connectId);
+	}
+
+	// Events still in the ring, oldest first. Slots being written at the same moment are skipped
+	QVector<Event> events() const;
+
+	// Chrome trace event format, loadable in chrome://tracing or Perfetto. One process per connect and one row
+	// per message of it, each stage is a slice lasting until the next stage of the same message on that connect
+	QByteArray toChromeTraceJson() const;
+
+	static const char* stageName(const Stage& stage);
+
+private:
+	void record(const Stage& stage, const qint32& randomFlag, const quint64& connectId);
+
+	// sequence is index + 1 of the event in the slot, 0 while a writer is filling it
+	struct Slot {
+		std::atomic<quint64> sequence = { 0 };
+		std::atomic<qint64> time = { 0 };
+		std::atomic<quint64> threadId = { 0 };
+		std::atomic<quint64> connectId = { 0 };
+		std::atomic<qint32> randomFlag = { 0 };
+		std::atomic<qint32> stage = { 0 };
+	};
+
+	std::unique_ptr<Slot[]> m_slots;
+	quint64 m_capacity;
+	int m_sampleInterval;
+	std::atomic<quint64> m_nextIndex = { 0 };
+};
+
+#endif//NETWORK_INCLUDE_NETWORK_TRACER_H_
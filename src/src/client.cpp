@@ -4,9 +4,12 @@
 #include <QDebug>
 #include <QThread>
 #include <QSemaphore>
+#include <QTimer>
+#include <QRandomGenerator>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QUuid>
 
 #include "connectpool.h"
 #include "connect.h"
@@ -30,6 +33,14 @@ Client::Client(
 }
 
 Client::~Client() {
+	m_mutexForReconnect.lock();
+	m_reconnectStopped = true;
+	const auto reconnectStates = m_reconnectStates;
+	m_reconnectStates.clear();
+	m_mutexForReconnect.unlock();
+	for (const auto& reconnectState : reconnectStates) {
+		this->failPendingSends(reconnectState.pendingSends);
+	}
 	if (!m_socketThreadPool) {
 		return;
 	}
@@ -68,15 +79,6 @@ bool Client::begin() {
 			new NetworkThreadPool(m_clientSettings->globalCallbackThreadCount));
 		m_globalCallbackThreadPool = m_callbackThreadPool.toWeakRef();
 	}
-	if (!m_processors.isEmpty()) {
-		QSet<QThread*> receivedPossibleThreads;
-		m_callbackThreadPool->waitRunEach([&receivedPossibleThreads]() {
-			receivedPossibleThreads.insert(QThread::currentThread());
-			});
-		for (const auto& processor : m_processors) {
-			processor->setReceivedPossibleThreads(receivedPossibleThreads);
-		}
-	}
 	m_socketThreadPool->waitRunEach(
 		[
 			this
@@ -148,7 +150,7 @@ void Client::registerProcessor(const QPointer<Processor>& processor) {
 	}
 }
 
-void Client::createConnect(const QString& hostName, const quint16& port) {
+void Client::createConnect(const QString& hostName, const quint16& port, const int& connectIndex) {
 	NETWORK_THISNULL_CHECK("Client::createConnect");
 	if (!m_socketThreadPool) {
 		qDebug() << "Client::createConnect: this client need to begin:" << this;
@@ -167,12 +169,14 @@ void Client::createConnect(const QString& hostName, const quint16& port) {
 					this,
 						runOnConnectThreadCallback,
 						hostName,
-						port
+						port,
+						connectIndex
 				]() {
 					this->m_connectPools[QThread::currentThread()]->createConnect(
 						runOnConnectThreadCallback,
 						hostName,
-						port
+						port,
+						connectIndex
 					);
 				},
 						rotaryIndex
@@ -182,21 +186,22 @@ void Client::createConnect(const QString& hostName, const quint16& port) {
 bool Client::waitForCreateConnect(
 	const QString& hostName,
 	const quint16& port,
-	const int& maximumConnectToHostWaitTime
+	const int& maximumConnectToHostWaitTime,
+	const int& connectIndex
 ) {
 	NETWORK_THISNULL_CHECK("Client::waitForCreateConnect", false);
 	if (!m_socketThreadPool) {
 		qDebug() << "Client::waitForCreateConnect: this client need to begin:" << this;
 		return false;
 	}
-	if (this->containsConnect(hostName, port)) {
+	if (this->containsConnect(hostName, port, connectIndex)) {
 		return true;
 	}
 	QSharedPointer<QSemaphore> semaphore(new QSemaphore);
-	const auto&& hostKey = QString("%1:%2").arg(hostName, QString::number(port));
+	const auto&& hostKey = QString("%1:%2#%3").arg(hostName, QString::number(port), QString::number(connectIndex));
 	m_mutex.lock();
 	m_waitConnectSucceedSemaphore[hostKey] = semaphore.toWeakRef();
-	this->createConnect(hostName, port);
+	this->createConnect(hostName, port, connectIndex);
 	m_mutex.unlock();
 	auto acquireSucceed = semaphore->tryAcquire(
 		1,
@@ -222,7 +227,8 @@ qint32 Client::sendPayloadData(
 	const QByteArray& payloadData,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Client::sendPayloadData", 0);
 	if (!m_socketThreadPool) {
@@ -232,6 +238,46 @@ qint32 Client::sendPayloadData(
 		}
 		return 0;
 	}
+	if (m_clientSettings->autoReconnect) {
+		// Hold the send while the host is down or its queue is still draining, so the order is kept
+		m_mutexForReconnect.lock();
+		auto& reconnectState = m_reconnectStates[reconnectKey(hostName, port)];
+		QPointer<Connect> connect;
+		for (const auto& connectPool : this->m_connectPools) {
+			connect = connectPool->getConnectByHostAndPort(hostName, port);
+			if (connect) {
+				break;
+			}
+		}
+		if (connect && reconnectState.connected && !reconnectState.flushing) {
+			m_mutexForReconnect.unlock();
+			return connect->sendPayloadData(
+				targetActionFlag,
+				payloadData,
+				appendData,
+				succeedCallback,
+				failCallback,
+				priority
+			);
+		}
+		if (reconnectState.pendingSends.size() >= m_clientSettings->reconnectQueueSize) {
+			m_mutexForReconnect.unlock();
+			qDebug() << "Client::sendPayloadData: reconnect queue is full:" << reconnectKey(hostName, port);
+			if (failCallback) {
+				failCallback(nullptr);
+			}
+			return 0;
+		}
+		const auto&& randomFlag = reserveRandomFlag(reconnectState);
+		reconnectState.pendingSends.push_back(
+			{ randomFlag, targetActionFlag, payloadData, appendData, succeedCallback, failCallback, priority });
+		const auto&& delay = (connect) ? (-1) : (this->reserveReconnectAttempt(reconnectState));
+		m_mutexForReconnect.unlock();
+		if (delay >= 0) {
+			this->scheduleReconnect(hostName, port, delay);
+		}
+		return randomFlag;
+	}
 	auto connect = this->getConnect(hostName, port);
 	if (!connect) {
 		if (failCallback) {
@@ -244,7 +290,8 @@ qint32 Client::sendPayloadData(
 		payloadData,
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority
 	);
 }
 
@@ -255,7 +302,8 @@ qint32 Client::sendVariantMapData(
 	const QVariantMap& variantMap,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Client::sendVariantMapData", 0);
 	if (!m_socketThreadPool) {
@@ -272,7 +320,8 @@ qint32 Client::sendVariantMapData(
 		QJsonDocument(QJsonObject::fromVariantMap(variantMap)).toJson(QJsonDocument::Compact),
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority
 	);
 }
 
@@ -283,7 +332,8 @@ qint32 Client::sendFileData(
 	const QFileInfo& fileInfo,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Client::sendFileData", 0);
 	if (!m_socketThreadPool) {
@@ -305,10 +355,265 @@ qint32 Client::sendFileData(
 		fileInfo,
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority
+	);
+}
+
+QList<qint32> Client::sendBatch(
+	const QString& hostName,
+	const quint16& port,
+	const QList<NetworkBatchMessage>& messages,
+	const ConnectPointerAndPackageSharedPointerListFunction& batchSucceedCallback,
+	const ConnectPointerFunction& batchFailCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendBatch", {});
+	if (!m_socketThreadPool) {
+		qDebug() << "Client::sendBatch: this client need to begin:" << this;
+		if (batchFailCallback) {
+			batchFailCallback(nullptr);
+		}
+		return {};
+	}
+	auto connect = this->getConnect(hostName, port);
+	if (!connect) {
+		if (batchFailCallback) {
+			batchFailCallback(nullptr);
+		}
+		return {};
+	}
+	return connect->sendBatch(messages, batchSucceedCallback, batchFailCallback, priority);
+}
+
+NetworkReplyFuture Client::sendPayloadDataAsync(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendPayloadDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendPayloadData(
+		hostName,
+		port,
+		targetActionFlag,
+		payloadData,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail();
+	}
+	return promise.future();
+}
+
+NetworkReplyFuture Client::sendVariantMapDataAsync(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QVariantMap& variantMap,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendVariantMapDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendVariantMapData(
+		hostName,
+		port,
+		targetActionFlag,
+		variantMap,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail();
+	}
+	return promise.future();
+}
+
+NetworkReplyFuture Client::sendFileDataAsync(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendFileDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendFileData(
+		hostName,
+		port,
+		targetActionFlag,
+		fileInfo,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail();
+	}
+	return promise.future();
+}
+
+qint32 Client::sendFileBundle(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QDir& baseDir,
+	const QList<QFileInfo>& fileInfos,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendFileBundle", 0);
+	if (!m_socketThreadPool) {
+		qDebug() << "Client::sendFileBundle: this client need to begin:" << this;
+		if (failCallback) {
+			failCallback(nullptr);
+		}
+		return 0;
+	}
+	auto connect = this->getConnect(hostName, port);
+	if (!connect) {
+		if (failCallback) {
+			failCallback(nullptr);
+		}
+		return 0;
+	}
+	return connect->sendFileBundle(
+		targetActionFlag,
+		baseDir,
+		fileInfos,
+		appendData,
+		succeedCallback,
+		failCallback,
+		priority
+	);
+}
+
+qint32 Client::sendDirectory(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QDir& dir,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendDirectory", 0);
+	if (!m_socketThreadPool) {
+		qDebug() << "Client::sendDirectory: this client need to begin:" << this;
+		if (failCallback) {
+			failCallback(nullptr);
+		}
+		return 0;
+	}
+	auto connect = this->getConnect(hostName, port);
+	if (!connect) {
+		if (failCallback) {
+			failCallback(nullptr);
+		}
+		return 0;
+	}
+	return connect->sendDirectory(
+		targetActionFlag,
+		dir,
+		appendData,
+		succeedCallback,
+		failCallback,
+		priority
 	);
 }
 
+qint32 Client::sendFileDataStriped(
+	const QString& hostName,
+	const quint16& port,
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const int& stripeCount,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Client::sendFileDataStriped", 0);
+	if (!m_socketThreadPool) {
+		qDebug() << "Client::sendFileDataStriped: this client need to begin:" << this;
+		if (failCallback) {
+			failCallback(nullptr);
+		}
+		return 0;
+	}
+	// Every stripe should be worth at least one package
+	const auto&& cutPackageSize = qMax(qint64(1), m_connectSettings->cutPackageSize);
+	const auto&& availableStripeCount = static_cast<int>(qBound(
+		qint64(1),
+		qint64(stripeCount),
+		(fileInfo.size() + cutPackageSize - 1) / cutPackageSize));
+	if (availableStripeCount == 1) {
+		return this->sendFileData(
+			hostName,
+			port,
+			targetActionFlag,
+			fileInfo,
+			appendData,
+			succeedCallback,
+			failCallback,
+			priority
+		);
+	}
+	QVector<QPointer<Connect>> connects;
+	for (auto stripeIndex = 0; stripeIndex < availableStripeCount; ++stripeIndex) {
+		auto connect = this->getConnect(hostName, port, stripeIndex);
+		if (!connect) {
+			qDebug() << "Client::sendFileDataStriped: connect error, stripeIndex:" << stripeIndex;
+			if (failCallback) {
+				failCallback(nullptr);
+			}
+			return 0;
+		}
+		connects.push_back(connect);
+	}
+	const auto&& stripeId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+	QVector<qint32> randomFlags;
+	for (auto stripeIndex = 0; stripeIndex < availableStripeCount; ++stripeIndex) {
+		const auto&& randomFlag = connects[stripeIndex]->sendFileDataStripe(
+			targetActionFlag,
+			fileInfo,
+			appendData,
+			stripeId,
+			stripeIndex,
+			availableStripeCount,
+			(stripeIndex) ? (nullptr) : (succeedCallback),
+			(stripeIndex) ? (nullptr) : (failCallback),
+			priority
+		);
+		if (!randomFlag) {
+			qDebug() << "Client::sendFileDataStriped: send error, stripeIndex:" << stripeIndex;
+			// The stripes already on their way can never make a whole file, cancelling stripe 0 fails the callbacks
+			for (auto startedIndex = 0; startedIndex < randomFlags.size(); ++startedIndex) {
+				if (connects[startedIndex]) {
+					connects[startedIndex]->cancelSend(randomFlags[startedIndex]);
+				}
+			}
+			return 0;
+		}
+		randomFlags.push_back(randomFlag);
+	}
+	return randomFlags.first();
+}
+
 qint32 Client::waitForSendPayloadData(
 	const QString& hostName,
 	const quint16& port,
@@ -428,29 +733,106 @@ qint32 Client::waitForSendFileData(
 	return (semaphore.tryAcquire(1)) ? (sendReply) : (0);
 }
 
-QPointer<Connect> Client::getConnect(const QString& hostName, const quint16& port) {
+QFuture<bool> Client::createConnectAsync(
+	const QString& hostName,
+	const quint16& port,
+	const int& maximumConnectToHostWaitTime,
+	const int& connectIndex
+) {
+	NETWORK_THISNULL_CHECK("Client::createConnectAsync", QFuture<bool>());
+	QSharedPointer<QPromise<bool>> promise(new QPromise<bool>);
+	promise->start();
+	auto future = promise->future();
+	const auto&& settle = [](const QSharedPointer<QPromise<bool>>& promise, const bool& succeed) {
+		promise->addResult(succeed);
+		promise->finish();
+	};
+	if (!m_socketThreadPool) {
+		qDebug() << "Client::createConnectAsync: this client need to begin:" << this;
+		settle(promise, false);
+		return future;
+	}
+	if (this->containsConnect(hostName, port, connectIndex)) {
+		settle(promise, true);
+		return future;
+	}
+	const auto&& hostKey = QString("%1:%2#%3").arg(hostName, QString::number(port), QString::number(connectIndex));
+	m_mutex.lock();
+	m_waitConnectSucceedPromises[hostKey].push_back(promise);
+	this->createConnect(hostName, port, connectIndex);
+	m_mutex.unlock();
+	const auto&& waitTime = (maximumConnectToHostWaitTime == -1)
+		? (m_connectSettings->maximumConnectToHostWaitTime)
+		: (maximumConnectToHostWaitTime);
+	m_socketThreadPool->run(
+		[
+			this,
+				hostKey,
+				waitTime,
+				promise = promise.toWeakRef(),
+				settle
+		]() {
+			QTimer::singleShot(
+				waitTime,
+				this->m_connectPools[QThread::currentThread()].data(),
+				[
+					this,
+						hostKey,
+						promise,
+						settle
+				]() {
+					const auto&& strongPromise = promise.toStrongRef();
+					if (!strongPromise) {
+						return;
+					}
+					this->m_mutex.lock();
+					const auto&& removed = this->m_waitConnectSucceedPromises[hostKey].removeOne(strongPromise);
+					if (this->m_waitConnectSucceedPromises[hostKey].isEmpty()) {
+						this->m_waitConnectSucceedPromises.remove(hostKey);
+					}
+					this->m_mutex.unlock();
+					if (removed) {
+						settle(strongPromise, false);
+					}
+				}
+			);
+		}
+			);
+	return future;
+}
+
+QPointer<Connect> Client::getConnect(const QString& hostName, const quint16& port, const int& connectIndex) {
 	NETWORK_THISNULL_CHECK("Client::getConnect", nullptr);
 	if (!m_socketThreadPool) {
 		qDebug() << "Client::getConnect: this client need to begin:" << this;
 		return {};
 	}
 	for (const auto& connectPool : this->m_connectPools) {
-		auto connect = connectPool->getConnectByHostAndPort(hostName, port);
+		auto connect = connectPool->getConnectByHostAndPort(hostName, port, connectIndex);
 		if (!connect) {
 			continue;
 		}
 		return connect;
 	}
+	if (m_clientSettings->autoReconnect && !connectIndex) {
+		m_mutexForReconnect.lock();
+		const auto&& delay = this->reserveReconnectAttempt(m_reconnectStates[reconnectKey(hostName, port)]);
+		m_mutexForReconnect.unlock();
+		if (delay >= 0) {
+			this->scheduleReconnect(hostName, port, delay);
+		}
+		return {};
+	}
 	if (!m_clientSettings->autoCreateConnect) {
 		return {};
 	}
 	const auto&& autoConnectSucceed = this->waitForCreateConnect(hostName, port,
-		m_clientSettings->maximumAutoConnectToHostWaitTime);
+		m_clientSettings->maximumAutoConnectToHostWaitTime, connectIndex);
 	if (!autoConnectSucceed) {
 		return {};
 	}
 	for (const auto& connectPool : this->m_connectPools) {
-		auto connect = connectPool->getConnectByHostAndPort(hostName, port);
+		auto connect = connectPool->getConnectByHostAndPort(hostName, port, connectIndex);
 		if (!connect) {
 			continue;
 		}
@@ -459,14 +841,23 @@ QPointer<Connect> Client::getConnect(const QString& hostName, const quint16& por
 	return {};
 }
 
-bool Client::containsConnect(const QString& hostName, const quint16& port) {
+int Client::pendingSendCount(const QString& hostName, const quint16& port) {
+	NETWORK_THISNULL_CHECK("Client::pendingSendCount", 0);
+	m_mutexForReconnect.lock();
+	const auto&& it = m_reconnectStates.constFind(reconnectKey(hostName, port));
+	const auto&& count = (it != m_reconnectStates.constEnd()) ? (it->pendingSends.size()) : (0);
+	m_mutexForReconnect.unlock();
+	return count;
+}
+
+bool Client::containsConnect(const QString& hostName, const quint16& port, const int& connectIndex) {
 	NETWORK_THISNULL_CHECK("Client::containsConnect", false);
 	if (!m_socketThreadPool) {
 		qDebug() << "Client::containsConnect: this client need to begin:" << this;
 		return {};
 	}
 	for (const auto& connectPool : this->m_connectPools) {
-		auto connect = connectPool->getConnectByHostAndPort(hostName, port);
+		auto connect = connectPool->getConnectByHostAndPort(hostName, port, connectIndex);
 		if (!connect) {
 			continue;
 		}
@@ -478,7 +869,8 @@ bool Client::containsConnect(const QString& hostName, const quint16& port) {
 void Client::onConnectToHostError(const QPointer<Connect>& connect,
 	const QPointer<ConnectPool>& connectPool) {
 	const auto&& reply = connectPool->getHostAndPortByConnect(connect);
-	this->releaseWaitConnectSucceedSemaphore(reply.first, reply.second, false);
+	this->releaseWaitConnectSucceedSemaphore(reply.first, reply.second,
+		connectPool->getConnectIndexByConnect(connect), false);
 	if (!m_clientSettings->connectToHostErrorCallback) {
 		return;
 	}
@@ -504,7 +896,8 @@ void Client::onConnectToHostError(const QPointer<Connect>& connect,
 void Client::onConnectToHostTimeout(const QPointer<Connect>& connect,
 	const QPointer<ConnectPool>& connectPool) {
 	const auto&& reply = connectPool->getHostAndPortByConnect(connect);
-	this->releaseWaitConnectSucceedSemaphore(reply.first, reply.second, false);
+	this->releaseWaitConnectSucceedSemaphore(reply.first, reply.second,
+		connectPool->getConnectIndexByConnect(connect), false);
 	if (!m_clientSettings->connectToHostTimeoutCallback) {
 		return;
 	}
@@ -534,14 +927,36 @@ void Client::onConnectToHostSucceed(const QPointer<Connect>& connect,
 		qDebug() << "Client::onConnectToHostSucceed: connect error";
 		return;
 	}
+	if (m_clientSettings->autoReconnect && !connectPool->getConnectIndexByConnect(connect)) {
+		m_mutexForReconnect.lock();
+		auto& reconnectState = m_reconnectStates[reconnectKey(reply.first, reply.second)];
+		reconnectState.failedAttemptCount = 0;
+		reconnectState.connected = true;
+		reconnectState.flushing = !reconnectState.pendingSends.isEmpty();
+		const auto&& flushWanted = reconnectState.flushing;
+		m_mutexForReconnect.unlock();
+		if (flushWanted) {
+			m_callbackThreadPool->run(
+				[
+					this,
+						connect,
+						hostName = reply.first,
+						port = reply.second
+				]() {
+					this->flushPendingSends(connect, hostName, port);
+				}
+					);
+		}
+	}
 	m_callbackThreadPool->run(
 		[
 			this,
 				connect,
 				hostName = reply.first,
-				port = reply.second
+				port = reply.second,
+				connectIndex = connectPool->getConnectIndexByConnect(connect)
 		]() {
-			this->releaseWaitConnectSucceedSemaphore(hostName, port, true);
+			this->releaseWaitConnectSucceedSemaphore(hostName, port, connectIndex, true);
 			if (!this->m_clientSettings->connectToHostSucceedCallback) {
 				return;
 			}
@@ -574,10 +989,44 @@ void Client::onRemoteHostClosed(const QPointer<Connect>& connect,
 
 void Client::onReadyToDelete(const QPointer<Connect>& connect,
 	const QPointer<ConnectPool>& connectPool) {
+	const auto&& reply = connectPool->getHostAndPortByConnect(connect);
+	if (m_clientSettings->autoReconnect && !reply.first.isEmpty() &&
+		!connectPool->getConnectIndexByConnect(connect)) {
+		auto delay = -1;
+		QList<PendingSend> failedSends;
+		m_mutexForReconnect.lock();
+		auto it = m_reconnectStates.find(reconnectKey(reply.first, reply.second));
+		if (!m_reconnectStopped && (it != m_reconnectStates.end())) {
+			it->connected = false;
+			++it->failedAttemptCount;
+			if ((m_clientSettings->reconnectMaximumAttemptCount >= 0) &&
+				(it->failedAttemptCount > m_clientSettings->reconnectMaximumAttemptCount)) {
+				failedSends = it->pendingSends;
+				m_reconnectStates.erase(it);
+			} else {
+				delay = this->reserveReconnectAttempt(*it);
+			}
+		}
+		m_mutexForReconnect.unlock();
+		if (delay >= 0) {
+			this->scheduleReconnect(reply.first, reply.second, delay);
+		}
+		if (!failedSends.isEmpty()) {
+			qDebug() << "Client::onReadyToDelete: reconnect attempts exhausted:" <<
+				reconnectKey(reply.first, reply.second);
+			m_callbackThreadPool->run(
+				[
+					this,
+						failedSends
+				]() {
+					this->failPendingSends(failedSends);
+				}
+					);
+		}
+	}
 	if (!m_clientSettings->readyToDeleteCallback) {
 		return;
 	}
-	const auto&& reply = connectPool->getHostAndPortByConnect(connect);
 	if (reply.first.isEmpty() || !reply.second) {
 		qDebug() << "Client::onReadyToDelete: error";
 		return;
@@ -688,15 +1137,26 @@ void Client::onPackageReceived(
 			qDebug() << "Client::onPackageReceived: error";
 			return;
 		}
+		if (m_connectSettings->tracer) {
+			m_connectSettings->tracer->trace(NetworkTracer::CallbackDispatched, package->randomFlag(), connect->connectId());
+		}
 		m_callbackThreadPool->run(
 			[
 				this,
 					connect,
 					hostName = reply.first,
 					port = reply.second,
-					package
+					package,
+					tracer = m_connectSettings->tracer,
+					connectId = connect->connectId()
 			]() {
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackStarted, package->randomFlag(), connectId);
+				}
 				this->m_clientSettings->packageReceivedCallback(connect, hostName, port, package);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackFinished, package->randomFlag(), connectId);
+				}
 			}
 				);
 	} else {
@@ -712,13 +1172,24 @@ void Client::onPackageReceived(
 				package->targetActionFlag();
 			return;
 		}
+		if (m_connectSettings->tracer) {
+			m_connectSettings->tracer->trace(NetworkTracer::CallbackDispatched, package->randomFlag(), connect->connectId());
+		}
 		m_callbackThreadPool->run(
 			[
 				connect,
 					package,
-					callback = *it
+					callback = *it,
+					tracer = m_connectSettings->tracer,
+					connectId = connect->connectId()
 			]() {
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackStarted, package->randomFlag(), connectId);
+				}
 				callback(connect, package);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackFinished, package->randomFlag(), connectId);
+				}
 			}
 				);
 	}
@@ -730,13 +1201,24 @@ void Client::onWaitReplySucceedPackage(
 	const QSharedPointer<Package>& package,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback
 ) {
+	if (m_connectSettings->tracer) {
+		m_connectSettings->tracer->trace(NetworkTracer::CallbackDispatched, package->randomFlag(), connect->connectId());
+	}
 	m_callbackThreadPool->run(
 		[
 			connect,
 				package,
-				succeedCallback
+				succeedCallback,
+				tracer = m_connectSettings->tracer,
+				connectId = connect->connectId()
 		]() {
+			if (tracer) {
+				tracer->trace(NetworkTracer::CallbackStarted, package->randomFlag(), connectId);
+			}
 			succeedCallback(connect, package);
+			if (tracer) {
+				tracer->trace(NetworkTracer::CallbackFinished, package->randomFlag(), connectId);
+			}
 		}
 			);
 }
@@ -757,9 +1239,9 @@ void Client::onWaitReplyPackageFail(
 }
 
 void Client::releaseWaitConnectSucceedSemaphore(const QString& hostName, const quint16& port,
-	const bool& succeed) {
+	const int& connectIndex, const bool& succeed) {
 	//    qDebug() << "releaseWaitConnectSucceedSemaphore: hostName:" << hostName << ", port:" << port;
-	const auto&& hostKey = QString("%1:%2").arg(hostName, QString::number(port));
+	const auto&& hostKey = QString("%1:%2#%3").arg(hostName, QString::number(port), QString::number(connectIndex));
 	this->m_mutex.lock();
 	{
 		auto it = this->m_waitConnectSucceedSemaphore.find(hostKey);
@@ -771,5 +1253,124 @@ void Client::releaseWaitConnectSucceedSemaphore(const QString& hostName, const q
 			}
 		}
 	}
+	const auto&& promises = this->m_waitConnectSucceedPromises.take(hostKey);
 	this->m_mutex.unlock();
+	for (const auto& promise : promises) {
+		promise->addResult(succeed);
+		promise->finish();
+	}
+}
+
+qint32 Client::reserveRandomFlag(ReconnectState& state) {
+	// Counted down from the top of the client range (see begin) while a connect counts up from the bottom,
+	// so a held send can not meet a flag the new connect has handed out in the meantime. Replies are only
+	// matched below randomFlagRangeEnd, so the range end itself is never reserved
+	if ((state.nextReservedRandomFlag < 500000000) || (state.nextReservedRandomFlag > 999999998)) {
+		state.nextReservedRandomFlag = 999999998;
+	}
+	return state.nextReservedRandomFlag--;
+}
+
+int Client::reserveReconnectAttempt(ReconnectState& state) {
+	if (m_reconnectStopped || state.reconnectScheduled) {
+		return -1;
+	}
+	state.reconnectScheduled = true;
+	if (!state.failedAttemptCount) {
+		return 0;
+	}
+	// Full jitter: a uniform pick below the capped backoff keeps clients that lost the same server
+	// from coming back to it in lockstep
+	const auto&& backoff = qMin(
+		qint64(m_clientSettings->reconnectMaximumBackoff),
+		qint64(m_clientSettings->reconnectInitialBackoff) << qMin(state.failedAttemptCount - 1, 20));
+	return QRandomGenerator::global()->bounded(static_cast<int>(qMax(qint64(0), backoff)) + 1);
+}
+
+void Client::scheduleReconnect(const QString& hostName, const quint16& port, const int& delay) {
+	m_socketThreadPool->run(
+		[
+			this,
+				hostName,
+				port,
+				delay
+		]() {
+			// The timer lives with the connect pool of this thread, so it is gone once the client is destroyed
+			QTimer::singleShot(
+				delay,
+				this->m_connectPools[QThread::currentThread()].data(),
+				[
+					this,
+						hostName,
+						port
+				]() {
+					this->m_mutexForReconnect.lock();
+					auto it = this->m_reconnectStates.find(reconnectKey(hostName, port));
+					const auto&& reconnectWanted = !this->m_reconnectStopped && (it != this->m_reconnectStates.end());
+					if (reconnectWanted) {
+						it->reconnectScheduled = false;
+					}
+					this->m_mutexForReconnect.unlock();
+					if (reconnectWanted) {
+						this->createConnect(hostName, port);
+					}
+				}
+			);
+		}
+			);
+}
+
+void Client::flushPendingSends(const QPointer<Connect>& connect, const QString& hostName, const quint16& port) {
+	const auto&& hostKey = reconnectKey(hostName, port);
+	forever {
+		m_mutexForReconnect.lock();
+		auto it = m_reconnectStates.find(hostKey);
+		if (it == m_reconnectStates.end()) {
+			m_mutexForReconnect.unlock();
+			return;
+		}
+		if (it->pendingSends.isEmpty() || !it->connected || !connect) {
+			it->flushing = false;
+			m_mutexForReconnect.unlock();
+			return;
+		}
+		auto pendingSends = it->pendingSends;
+		it->pendingSends.clear();
+		m_mutexForReconnect.unlock();
+		for (auto index = 0; index < pendingSends.size(); ++index) {
+			const auto& pendingSend = pendingSends[index];
+			const auto&& randomFlag = connect->sendPayloadDataWithRandomFlag(
+				pendingSend.randomFlag,
+				pendingSend.targetActionFlag,
+				pendingSend.payloadData,
+				pendingSend.appendData,
+				pendingSend.succeedCallback,
+				pendingSend.failCallback,
+				pendingSend.priority
+			);
+			if (randomFlag) {
+				continue;
+			}
+			// Dropped again while draining, the rest waits for the next connect in its original order
+			m_mutexForReconnect.lock();
+			it = m_reconnectStates.find(hostKey);
+			if (it != m_reconnectStates.end()) {
+				it->pendingSends = pendingSends.mid(index) + it->pendingSends;
+				it->flushing = false;
+				m_mutexForReconnect.unlock();
+			} else {
+				m_mutexForReconnect.unlock();
+				this->failPendingSends(pendingSends.mid(index));
+			}
+			return;
+		}
+	}
+}
+
+void Client::failPendingSends(const QList<PendingSend>& pendingSends) {
+	for (const auto& pendingSend : pendingSends) {
+		if (pendingSend.failCallback) {
+			pendingSend.failCallback(nullptr);
+		}
+	}
 }
@@ -4,6 +4,15 @@
 #if ( defined Q_OS_MAC ) || ( defined __MINGW32__ ) || ( defined Q_OS_LINUX )
 #   include <utime.h>
 #endif
+#ifdef Q_OS_LINUX
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/socket.h>
+#   include <sys/sendfile.h>
+#   include <sys/un.h>
+#   include <netinet/in.h>
+#   include <netinet/tcp.h>
+#endif
 
 #include <QDebug>
 #include <QTcpSocket>
@@ -14,12 +23,24 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QDirIterator>
+#include <QSet>
+#include <QBitArray>
+#include <QMultiHash>
+#include <QBuffer>
+#include <QSaveFile>
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QNetworkProxy>
+#include <QCryptographicHash>
+#include <QtConcurrent>
 
 #include "package.h"
 
+#include <array>
+#include <cmath>
+#include <cstring>
+
 // ConnectSettings
 void ConnectSettings::setFilePathProviderToDefaultDir() {
 	const auto&& defaultDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
@@ -35,9 +56,195 @@ void ConnectSettings::setFilePathProviderToDir(const QDir& dir) {
 }
 
 // Connect
+std::atomic<quint64> Connect::m_nextConnectId(0);
+QMutex Connect::m_mutexForGlobalFileWriteThreadPool;
+QWeakPointer<NetworkThreadPool> Connect::m_globalFileWriteThreadPool;
+QMutex Connect::m_mutexForStripedReceivedFiles;
+QMap<QString, Connect::StripedReceivedFile> Connect::m_stripedReceivedFiles;
+
+struct Connect::FileDeltaSignatures {
+	qint64 blockSize = 0;
+	QVector<quint64> strongChecksums; // first 8 bytes of the md5 of each block
+	QMultiHash<quint32, int> blockIndexes; // weak checksum -> block index
+	QBitArray weakChecksumFilter; // the rolling pass tests every byte, most of them never reach the hash
+};
+
+static inline void fileDeltaWeakSums(const uchar* data, const qint64& size, quint32& sumA, quint32& sumB) {
+	// Two independent sums without a carried dependency, the compiler turns this loop into SIMD code
+	quint32 a = 0;
+	quint32 b = 0;
+	for (qint64 index = 0; index < size; ++index) {
+		a += data[index];
+		b += static_cast<quint32>(size - index) * data[index];
+	}
+	sumA = a;
+	sumB = b;
+}
+
+static inline quint32 fileDeltaWeakChecksum(const quint32& sumA, const quint32& sumB) {
+	return (sumA & 0xffff) | (sumB << 16);
+}
+
+static inline int fileDeltaWeakChecksumFilterIndex(const quint32& weakChecksum) {
+	return static_cast<int>((weakChecksum ^ (weakChecksum >> 16)) & 0xffff);
+}
+
+static const std::array<quint64, 256>& chunkGearTable() {
+	static const auto gearTable = []() {
+		// Fixed seed, every sender has to cut the same data at the same places or nothing deduplicates
+		std::array<quint64, 256> table;
+		quint64 state = 0x2545f4914f6cdd1dULL;
+		for (auto& value : table) {
+			state += 0x9e3779b97f4a7c15ULL;
+			auto mixed = state;
+			mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+			value = mixed ^ (mixed >> 31);
+		}
+		return table;
+	}();
+	return gearTable;
+}
+
+static inline bool chunkIsWanted(const QByteArray& chunkWants, const int& chunkIndex) {
+	return ((chunkIndex >> 3) < chunkWants.size()) && ((chunkWants[chunkIndex >> 3] >> (chunkIndex & 7)) & 1);
+}
+
+// Hashed timer wheel, one per socket thread. Each tick only visits the connects due in its slot, and the
+// timer stops while no connect on the thread has a check due
+struct Connect::TimerWheel {
+	enum Check {
+		Heartbeat,
+		IdleRelease
+	};
+
+	struct Entry {
+		QPointer<Connect> connect;
+		Check check;
+		int rounds; // full turns of the wheel left before the entry is due
+	};
+
+	static constexpr int TickInterval = 100; // ms
+	static constexpr int SlotCount = 600; // one minute per turn
+
+	QTimer timer;
+	std::array<QVector<Entry>, SlotCount> buckets;
+	int currentSlot = 0;
+	int entryCount = 0;
+
+	TimerWheel() {
+		timer.setInterval(TickInterval);
+		QObject::connect(&timer, &QTimer::timeout, [this]() {
+			this->onTick();
+		});
+	}
+
+	void schedule(Connect* connect, const Check& check, const qint64& delay) {
+		const auto&& ticks = qMax(qint64(1), (delay + TickInterval - 1) / TickInterval);
+		buckets[(currentSlot + ticks) % SlotCount].push_back(
+			{ connect, check, static_cast<int>((ticks - 1) / SlotCount) });
+		if (!entryCount++) {
+			timer.start();
+		}
+	}
+
+	void onTick() {
+		currentSlot = (currentSlot + 1) % SlotCount;
+		QVector<Entry> entries;
+		entries.swap(buckets[currentSlot]);
+		const auto&& currentTime = QDateTime::currentMSecsSinceEpoch();
+		for (auto& entry : entries) {
+			if (entry.rounds) {
+				--entry.rounds;
+				buckets[currentSlot].push_back(entry);
+				continue;
+			}
+			--entryCount;
+			if (!entry.connect) {
+				continue;
+			}
+			const auto&& delay = (entry.check == Heartbeat)
+				? (entry.connect->onHeartbeatCheck(currentTime))
+				: (entry.connect->onIdleReleaseCheck());
+			if (delay > 0) {
+				this->schedule(entry.connect, entry.check, delay);
+			}
+		}
+		if (!entryCount) {
+			timer.stop();
+		}
+	}
+
+	static TimerWheel* currentThreadWheel() {
+		static thread_local std::unique_ptr<TimerWheel> wheel;
+		if (!wheel) {
+			wheel.reset(new TimerWheel);
+		}
+		return wheel.get();
+	}
+};
+
+// Qt containers keep their allocation once used, an idle connect should hold none
+template<typename Container>
+static inline void releaseIfEmpty(Container& container) {
+	if (container.isEmpty()) {
+		container = Container();
+	}
+}
+
+static inline quint64 fileDeltaStrongChecksum(const char* data, const qint64& size) {
+	const auto&& md5 = QCryptographicHash::hash(QByteArray::fromRawData(data, static_cast<int>(size)), QCryptographicHash::Md5);
+	quint64 strongChecksum = 0;
+	std::memcpy(&strongChecksum, md5.constData(), sizeof(strongChecksum));
+	return strongChecksum;
+}
+
+#ifdef Q_OS_LINUX
+// Peer of a Unix domain socket runs as the same user as this process
+static bool localPeerIsCurrentUser(const int& socketDescriptor) {
+	ucred peerCredentials = {};
+	socklen_t peerCredentialsSize = sizeof(peerCredentials);
+	if (::getsockopt(socketDescriptor, SOL_SOCKET, SO_PEERCRED, &peerCredentials, &peerCredentialsSize)) {
+		return false;
+	}
+	return peerCredentials.uid == ::getuid();
+}
+
+// Descriptor of a Unix domain socket connected to the local server of port, -1 if hostName is not loopback,
+// nothing listens there or the listener is another user. Non blocking, a full backlog falls back to TCP
+// instead of stalling the socket thread
+static int connectToLocalServer(const QString& hostName, const quint16& port) {
+	if (!QHostAddress(hostName).isLoopback() && (hostName.compare("localhost", Qt::CaseInsensitive) != 0)) {
+		return -1;
+	}
+	const auto&& path = QFile::encodeName(Connect::localServerName(port));
+	sockaddr_un socketAddress = {};
+	if (static_cast<size_t>(path.size()) >= sizeof(socketAddress.sun_path)) {
+		return -1;
+	}
+	socketAddress.sun_family = AF_UNIX;
+	std::memcpy(socketAddress.sun_path, path.constData(), static_cast<size_t>(path.size()));
+	const auto&& socketDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (socketDescriptor == -1) {
+		return -1;
+	}
+	if (::connect(socketDescriptor, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress))) {
+		::close(socketDescriptor);
+		return -1;
+	}
+	if (!localPeerIsCurrentUser(socketDescriptor)) {
+		qDebug() << "Connect::createConnect: local server of port" << port << "runs as another user, use TCP";
+		::close(socketDescriptor);
+		return -1;
+	}
+	return socketDescriptor;
+}
+#endif
+
 Connect::Connect(const QSharedPointer<ConnectSettings>& connectSettings) :
 	m_connectSettings(connectSettings),
 	m_tcpSocket(new QTcpSocket),
+	m_connectId(++m_nextConnectId),
 	m_connectCreateTime(QDateTime::currentMSecsSinceEpoch()) {
 	connect(m_tcpSocket.data(), &QAbstractSocket::stateChanged, this, &Connect::onTcpSocketStateChanged,
 		Qt::DirectConnection);
@@ -51,6 +258,16 @@ Connect::Connect(const QSharedPointer<ConnectSettings>& connectSettings) :
 			<< m_connectSettings->filePathProvider(QPointer<Connect>(nullptr),
 			QSharedPointer<Package>(nullptr), QString());
 	}
+	if (m_connectSettings->fileTransferEnabled && (m_connectSettings->fileWriteThreadCount > 0)) {
+		m_mutexForGlobalFileWriteThreadPool.lock();
+		m_fileWriteThreadPool = m_globalFileWriteThreadPool.toStrongRef();
+		if (!m_fileWriteThreadPool) {
+			m_fileWriteThreadPool = QSharedPointer<NetworkThreadPool>(
+				new NetworkThreadPool(m_connectSettings->fileWriteThreadCount));
+			m_globalFileWriteThreadPool = m_fileWriteThreadPool.toWeakRef();
+		}
+		m_mutexForGlobalFileWriteThreadPool.unlock();
+	}
 
 #ifdef Q_OS_IOS
 	static bool flag = true;
@@ -77,7 +294,25 @@ void Connect::createConnect(
 	NETWORK_NULLPTR_CHECK(onConnectCreatedCallback);
 	onConnectCreatedCallback(newConnect);
 	newConnect->startTimerForConnectToHostTimeOut();
+#ifdef Q_OS_LINUX
+	if (connectSettings->localTransportEnabled && connectSettings->localAddress.isNull()) {
+		const auto&& socketDescriptor = connectToLocalServer(hostName, port);
+		if (socketDescriptor != -1) {
+			newConnect->m_localTransport = true;
+			if (newConnect->m_tcpSocket->setSocketDescriptor(socketDescriptor)) {
+				return;
+			}
+			qDebug() << "Connect::createConnect: local transport error:" << newConnect->m_tcpSocket->errorString();
+			newConnect->m_localTransport = false;
+			::close(socketDescriptor);
+		}
+	}
+#endif
 	newConnect->m_tcpSocket->setProxy(QNetworkProxy::NoProxy);
+	if (!connectSettings->localAddress.isNull() && !newConnect->m_tcpSocket->bind(connectSettings->localAddress)) {
+		qDebug() << "Connect::createConnect: bind error:" << connectSettings->localAddress.toString()
+			<< newConnect->m_tcpSocket->errorString();
+	}
 	newConnect->m_tcpSocket->connectToHost(hostName, port);
 }
 
@@ -87,15 +322,35 @@ void Connect::createConnect(
 	const QSharedPointer<ConnectSettings>& connectSettings,
 	const qintptr& socketDescriptor
 ) {
+	auto localTransport = false;
+#ifdef Q_OS_LINUX
+	sockaddr_storage socketAddress = {};
+	socklen_t socketAddressSize = sizeof(socketAddress);
+	localTransport =
+		!::getsockname(static_cast<int>(socketDescriptor), reinterpret_cast<sockaddr*>(&socketAddress), &socketAddressSize) &&
+		(socketAddress.ss_family == AF_UNIX);
+	if (localTransport && !localPeerIsCurrentUser(static_cast<int>(socketDescriptor))) {
+		qDebug() << "Connect::createConnect: local peer runs as another user, refused";
+		::close(static_cast<int>(socketDescriptor));
+		return;
+	}
+#endif
 	QSharedPointer<Connect> newConnect(new Connect(connectSettings));
 	newConnect->m_runOnConnectThreadCallback = runOnConnectThreadCallback;
 	newConnect->m_sendRandomFlagRotaryIndex = connectSettings->randomFlagRangeStart - 1;
+	newConnect->m_localTransport = localTransport;
 	NETWORK_NULLPTR_CHECK(onConnectCreatedCallback);
 	onConnectCreatedCallback(newConnect);
 	newConnect->startTimerForConnectToHostTimeOut();
 	newConnect->m_tcpSocket->setSocketDescriptor(socketDescriptor);
 }
 
+QString Connect::localServerName(const quint16& port) {
+	// Per user and 0700, nobody else can plant or replace the socket like in a shared temp dir
+	return QDir(QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation)).filePath(
+		QString("network-%1.sock").arg(port));
+}
+
 void Connect::close() {
 	NETWORK_THISNULL_CHECK("Connect::close");
 	if (m_isAbandonTcpSocket) {
@@ -105,26 +360,87 @@ void Connect::close() {
 	this->onReadyToDelete();
 }
 
+void Connect::flush() {
+	NETWORK_THISNULL_CHECK("Connect::flush");
+	if (m_isAbandonTcpSocket) {
+		return;
+	}
+	if (this->thread() != QThread::currentThread()) {
+		NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback);
+		m_runOnConnectThreadCallback([this]() {
+			this->flush();
+			});
+		return;
+	}
+	NETWORK_NULLPTR_CHECK(m_tcpSocket);
+	this->flushWriteCoalescingBuffer();
+	m_tcpSocket->flush();
+}
+
 qint32 Connect::sendPayloadData(
 	const QString& targetActionFlag,
 	const QByteArray& payloadData,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::sendPayloadData", 0);
 	if (m_isAbandonTcpSocket) {
 		return 0;
 	}
+	return this->sendPayloadDataWithRandomFlag(
+		this->nextRandomFlag(),
+		targetActionFlag,
+		payloadData,
+		appendData,
+		succeedCallback,
+		failCallback,
+		priority
+	);
+}
+
+qint32 Connect::sendPayloadDataWithRandomFlag(
+	const qint32& currentRandomFlag,
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendPayloadDataWithRandomFlag", 0);
+	if (m_isAbandonTcpSocket) {
+		return 0;
+	}
 	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
-	const auto currentRandomFlag = this->nextRandomFlag();
+	this->traceMessage(NetworkTracer::Enqueued, currentRandomFlag);
+	if ((m_connectSettings->chunkDeduplicationMinimumBytes != -1) &&
+		(payloadData.size() >= qMax(qint64(1), m_connectSettings->chunkDeduplicationMinimumBytes))) {
+		QSharedPointer<QBuffer> source(new QBuffer);
+		source->setData(payloadData);
+		source->open(QIODevice::ReadOnly);
+		const auto&& readySendChunkedDataSucceed = this->readySendChunkedData(
+			currentRandomFlag,
+			NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG,
+			targetActionFlag,
+			QFileInfo(),
+			appendData,
+			source,
+			succeedCallback,
+			failCallback,
+			priority
+		);
+		return (readySendChunkedDataSucceed) ? (currentRandomFlag) : (0);
+	}
 	const auto&& readySendPayloadDataSucceed = this->readySendPayloadData(
 		currentRandomFlag,
 		targetActionFlag,
 		payloadData,
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority
 	);
 	if (!readySendPayloadDataSucceed) {
 		return 0;
@@ -137,7 +453,8 @@ qint32 Connect::sendVariantMapData(
 	const QVariantMap& variantMap,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::sendVariantMapData", 0);
 	return this->sendPayloadData(
@@ -145,7 +462,8 @@ qint32 Connect::sendVariantMapData(
 		QJsonDocument(QJsonObject::fromVariantMap(variantMap)).toJson(QJsonDocument::Compact),
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority
 	);
 }
 
@@ -154,7 +472,8 @@ qint32 Connect::sendFileData(
 	const QFileInfo& fileInfo,
 	const QVariantMap& appendData,
 	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::sendFileData", 0);
 	if (m_isAbandonTcpSocket) {
@@ -162,13 +481,265 @@ qint32 Connect::sendFileData(
 	}
 	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
 	const auto currentRandomFlag = this->nextRandomFlag();
+	this->traceMessage(NetworkTracer::Enqueued, currentRandomFlag);
+	const auto&& readySendFileDataSucceed = this->readySendFileData(
+		currentRandomFlag,
+		targetActionFlag,
+		fileInfo,
+		appendData,
+		succeedCallback,
+		failCallback,
+		priority
+	);
+	if (!readySendFileDataSucceed) {
+		return 0;
+	}
+	return currentRandomFlag;
+}
+
+QList<qint32> Connect::sendBatch(
+	const QList<NetworkBatchMessage>& messages,
+	const ConnectPointerAndPackageSharedPointerListFunction& batchSucceedCallback,
+	const ConnectPointerFunction& batchFailCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendBatch", {});
+	// Every early return fails the whole batch, the messages and the batch hear about it like after a send
+	const auto&& failBatch = [this, &messages, &batchFailCallback]() {
+		for (const auto& message : messages) {
+			if (message.failCallback) {
+				message.failCallback(this);
+			}
+		}
+		if (batchFailCallback) {
+			batchFailCallback(this);
+		}
+		return QList<qint32>();
+	};
+	if (m_isAbandonTcpSocket || messages.isEmpty() || !m_runOnConnectThreadCallback) {
+		return failBatch();
+	}
+	struct BatchState {
+		QMutex mutex;
+		QList<PackageSharedPointer> replies;
+		int remainingCount = 0;
+		bool finished = false;
+	};
+	QSharedPointer<BatchState> batchState;
+	if (batchSucceedCallback || batchFailCallback) {
+		batchState.reset(new BatchState);
+		batchState->replies.resize(messages.size());
+		batchState->remainingCount = messages.size();
+	}
+	QList<ReadySendPackages> batch;
+	batch.reserve(messages.size());
+	QList<qint32> randomFlags;
+	randomFlags.reserve(messages.size());
+	for (auto index = 0; index < messages.size(); ++index) {
+		const auto& message = messages[index];
+		const auto currentRandomFlag = this->nextRandomFlag();
+		auto succeedCallback = message.succeedCallback;
+		auto failCallback = message.failCallback;
+		if (batchState) {
+			succeedCallback = [
+				batchState,
+					index,
+					messageSucceedCallback = message.succeedCallback,
+					batchSucceedCallback
+			](const ConnectPointer& connect, const PackageSharedPointer& package) {
+				if (messageSucceedCallback) {
+					messageSucceedCallback(connect, package);
+				}
+				batchState->mutex.lock();
+				batchState->replies[index] = package;
+				const auto&& completed = !batchState->finished && !--batchState->remainingCount;
+				if (completed) {
+					batchState->finished = true;
+				}
+				batchState->mutex.unlock();
+				if (completed && batchSucceedCallback) {
+					batchSucceedCallback(connect, batchState->replies);
+				}
+			};
+			failCallback = [
+				batchState,
+					messageFailCallback = message.failCallback,
+					batchFailCallback
+			](const ConnectPointer& connect) {
+				if (messageFailCallback) {
+					messageFailCallback(connect);
+				}
+				batchState->mutex.lock();
+				const auto&& firstFailure = !batchState->finished;
+				batchState->finished = true;
+				batchState->mutex.unlock();
+				if (firstFailure && batchFailCallback) {
+					batchFailCallback(connect);
+				}
+			};
+		}
+		if (!this->appendReadySendPackages(batch, currentRandomFlag, message, succeedCallback, failCallback, priority)) {
+			return failBatch();
+		}
+		randomFlags.push_back(currentRandomFlag);
+	}
+	// Traced only once the whole batch is accepted, a batch failed above leaves no open message behind
+	for (const auto& randomFlag : randomFlags) {
+		this->traceMessage(NetworkTracer::Enqueued, randomFlag);
+	}
+	this->readySendPackageBatch(batch);
+	return randomFlags;
+}
+
+bool Connect::putBatch(
+	const QList<NetworkBatchMessage>& messages,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::putBatch", false);
+	if (m_isAbandonTcpSocket || messages.isEmpty()) {
+		return false;
+	}
+	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, false);
+	QList<ReadySendPackages> batch;
+	batch.reserve(messages.size());
+	for (const auto& message : messages) {
+		// Not the shared put flag, the rest chunks of every message are pooled and requested by their randomFlag
+		if (!this->appendReadySendPackages(batch, this->nextRandomFlag(), message, nullptr, nullptr, priority)) {
+			return false;
+		}
+	}
+	this->readySendPackageBatch(batch);
+	return true;
+}
+
+bool Connect::writeSharedFrame(
+	const QSharedPointer<Package>& frame,
+	const qint64& slowConsumerBytes,
+	const NetworkSlowConsumerPolicy& slowConsumerPolicy
+) {
+	if (m_isAbandonTcpSocket || !m_onceConnectSucceed) {
+		return false;
+	}
+	NETWORK_NULLPTR_CHECK(m_tcpSocket, false);
+	if ((slowConsumerBytes != -1) && (slowConsumerPolicy != NetworkSlowConsumerPolicy::Send) &&
+		((m_tcpSocket->bytesToWrite() + m_writeCoalescingBuffer.size()) >= slowConsumerBytes)) {
+		this->addMetric(NetworkMetrics::SlowConsumerSkips);
+		if (slowConsumerPolicy == NetworkSlowConsumerPolicy::Disconnect) {
+			qDebug() << "Connect::writeSharedFrame: slow consumer closed:" << this;
+			this->close();
+		}
+		return false;
+	}
+	// Queued like any other package, so it keeps its place behind what this connect already queued
+	this->sendPackageToRemote(frame);
+	return true;
+}
+
+NetworkReplyFuture Connect::sendPayloadDataAsync(
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendPayloadDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendPayloadData(
+		targetActionFlag,
+		payloadData,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail(this);
+	}
+	return promise.future();
+}
+
+NetworkReplyFuture Connect::sendVariantMapDataAsync(
+	const QString& targetActionFlag,
+	const QVariantMap& variantMap,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendVariantMapDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendVariantMapData(
+		targetActionFlag,
+		variantMap,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail(this);
+	}
+	return promise.future();
+}
+
+NetworkReplyFuture Connect::sendFileDataAsync(
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendFileDataAsync", NetworkFuture::makeFailed());
+	NetworkReplyPromise promise;
+	const auto&& randomFlag = this->sendFileData(
+		targetActionFlag,
+		fileInfo,
+		appendData,
+		promise.succeedCallback(),
+		promise.failCallback(),
+		priority
+	);
+	if (!randomFlag) {
+		promise.fail(this);
+	}
+	return promise.future();
+}
+
+qint32 Connect::sendFileDataStripe(
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const QString& stripeId,
+	const int& stripeIndex,
+	const int& stripeCount,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendFileDataStripe", 0);
+	if (m_isAbandonTcpSocket) {
+		return 0;
+	}
+	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
+	const auto&& stripeSize = (stripeCount > 0) ? ((fileInfo.size() + stripeCount - 1) / stripeCount) : (0);
+	const auto&& stripeOffset = stripeSize * stripeIndex;
+	if ((stripeIndex < 0) || (stripeIndex >= stripeCount) || (stripeOffset >= fileInfo.size())) {
+		qDebug() << "Connect::sendFileDataStripe: stripe out of range, index:" << stripeIndex << ", count:" << stripeCount;
+		return 0;
+	}
+	QVariantMap fileStripe;
+	fileStripe["id"] = stripeId;
+	fileStripe["index"] = stripeIndex;
+	fileStripe["count"] = stripeCount;
+	fileStripe["offset"] = stripeOffset;
+	fileStripe["size"] = qMin(stripeSize, fileInfo.size() - stripeOffset);
+	const auto currentRandomFlag = this->nextRandomFlag();
+	this->traceMessage(NetworkTracer::Enqueued, currentRandomFlag);
 	const auto&& readySendFileDataSucceed = this->readySendFileData(
 		currentRandomFlag,
 		targetActionFlag,
 		fileInfo,
 		appendData,
 		succeedCallback,
-		failCallback
+		failCallback,
+		priority,
+		fileStripe
 	);
 	if (!readySendFileDataSucceed) {
 		return 0;
@@ -176,23 +747,145 @@ qint32 Connect::sendFileData(
 	return currentRandomFlag;
 }
 
+void Connect::cancelSend(const qint32& randomFlag) {
+	NETWORK_THISNULL_CHECK("Connect::cancelSend");
+	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback);
+	if (this->thread() != QThread::currentThread()) {
+		m_runOnConnectThreadCallback([thisPointer = QPointer<Connect>(this), randomFlag]() {
+			if (!thisPointer) {
+				return;
+			}
+			thisPointer->cancelSend(randomFlag);
+			});
+		return;
+	}
+	this->sendTransferAbortToRemote(
+		(m_sendPayloadPackagePool.contains(randomFlag))
+			? (NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG)
+			: (NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG),
+		randomFlag
+	);
+	this->onTransferAborted(randomFlag);
+}
+
+qint32 Connect::sendFileBundle(
+	const QString& targetActionFlag,
+	const QDir& baseDir,
+	const QList<QFileInfo>& fileInfos,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendFileBundle", 0);
+	if (m_isAbandonTcpSocket) {
+		return 0;
+	}
+	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
+	WaitForSendFileBundle waitForSendFileBundle;
+	waitForSendFileBundle.targetActionFlag = targetActionFlag;
+	waitForSendFileBundle.appendData = appendData;
+	waitForSendFileBundle.baseDirPath = baseDir.absolutePath();
+	waitForSendFileBundle.succeedCallback = succeedCallback;
+	waitForSendFileBundle.failCallback = failCallback;
+	waitForSendFileBundle.priority = priority;
+	// Split by the sizes known now, so every bundle can tell the receiver how many bundles there are
+	QStringList currentBundle;
+	qint64 currentBundleBytes = 0;
+	for (const auto& fileInfo : fileInfos) {
+		if (!fileInfo.isFile()) {
+			qDebug() << "Connect::sendFileBundle: not a file, filePath:" << fileInfo.filePath();
+			return 0;
+		}
+		if (baseDir.relativeFilePath(fileInfo.absoluteFilePath()).startsWith("../")) {
+			qDebug() << "Connect::sendFileBundle: file not below baseDir, filePath:" << fileInfo.filePath();
+			return 0;
+		}
+		if (!currentBundle.isEmpty() &&
+			((currentBundle.size() >= m_connectSettings->fileBundleMaximumFileCount) ||
+				((currentBundleBytes + fileInfo.size()) > m_connectSettings->fileBundleMaximumBytes))) {
+			waitForSendFileBundle.bundles.push_back(currentBundle);
+			currentBundle.clear();
+			currentBundleBytes = 0;
+		}
+		currentBundle.push_back(fileInfo.absoluteFilePath());
+		currentBundleBytes += fileInfo.size();
+	}
+	if (currentBundle.isEmpty()) {
+		qDebug() << "Connect::sendFileBundle: no files, baseDir:" << baseDir.path();
+		return 0;
+	}
+	waitForSendFileBundle.bundles.push_back(currentBundle);
+	waitForSendFileBundle.bundleCount = waitForSendFileBundle.bundles.size();
+	waitForSendFileBundle.progress = QSharedPointer<FileBundleProgress>::create();
+	waitForSendFileBundle.progress->pendingBundleCount = waitForSendFileBundle.bundleCount;
+	waitForSendFileBundle.progress->failCallback = failCallback;
+	if (succeedCallback || failCallback) {
+		// Every bundle carries these, the user callbacks run once for the whole send
+		waitForSendFileBundle.succeedCallback = [progress = waitForSendFileBundle.progress, succeedCallback](
+			const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+				if ((--progress->pendingBundleCount == 0) && !progress->failed && succeedCallback) {
+					succeedCallback(connect, package);
+				}
+		};
+		waitForSendFileBundle.failCallback = [progress = waitForSendFileBundle.progress](const QPointer<Connect>& connect) {
+			if (!progress->failed.exchange(true) && progress->failCallback) {
+				progress->failCallback(connect);
+			}
+		};
+	}
+	waitForSendFileBundle.firstRandomFlag = this->nextRandomFlag();
+	this->readySendFileBundle(waitForSendFileBundle);
+	return waitForSendFileBundle.firstRandomFlag;
+}
+
+qint32 Connect::sendDirectory(
+	const QString& targetActionFlag,
+	const QDir& dir,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_THISNULL_CHECK("Connect::sendDirectory", 0);
+	QList<QFileInfo> fileInfos;
+	QDirIterator dirIterator(dir.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoSymLinks,
+		QDirIterator::Subdirectories);
+	while (dirIterator.hasNext()) {
+		dirIterator.next();
+		fileInfos.push_back(dirIterator.fileInfo());
+	}
+	return this->sendFileBundle(
+		targetActionFlag,
+		dir,
+		fileInfos,
+		appendData,
+		succeedCallback,
+		failCallback,
+		priority
+	);
+}
+
 qint32 Connect::replyPayloadData(
 	const qint32& receivedPackageRandomFlag,
 	const QByteArray& payloadData,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::replyPayloadData", 0);
 	if (m_isAbandonTcpSocket) {
 		return 0;
 	}
 	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
+	this->traceMessage(NetworkTracer::Enqueued, receivedPackageRandomFlag);
 	const auto&& readySendPayloadDataSucceed = this->readySendPayloadData(
 		receivedPackageRandomFlag,
 		{}, // empty targetActionFlag
 		payloadData,
 		appendData,
 		nullptr,
-		nullptr
+		nullptr,
+		priority
 	);
 	if (!readySendPayloadDataSucceed) {
 		return 0;
@@ -203,33 +896,38 @@ qint32 Connect::replyPayloadData(
 qint32 Connect::replyVariantMapData(
 	const qint32& receivedPackageRandomFlag,
 	const QVariantMap& variantMap,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::replyVariantMapData", 0);
 	return this->replyPayloadData(
 		receivedPackageRandomFlag,
 		QJsonDocument(QJsonObject::fromVariantMap(variantMap)).toJson(QJsonDocument::Compact),
-		appendData
+		appendData,
+		priority
 	);
 }
 
 qint32 Connect::replyFile(
 	const qint32& receivedPackageRandomFlag,
 	const QFileInfo& fileInfo,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::replyFile", 0);
 	if (m_isAbandonTcpSocket) {
 		return 0;
 	}
 	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, 0);
+	this->traceMessage(NetworkTracer::Enqueued, receivedPackageRandomFlag);
 	const auto&& readySendFileData = this->readySendFileData(
 		receivedPackageRandomFlag,
 		{}, // empty targetActionFlag
 		fileInfo,
 		appendData,
 		nullptr,
-		nullptr
+		nullptr,
+		priority
 	);
 	if (!readySendFileData) {
 		return 0;
@@ -240,7 +938,8 @@ qint32 Connect::replyFile(
 bool Connect::putPayloadData(
 	const QString& targetActionFlag,
 	const QByteArray& payloadData,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::putPayloadData", 0);
 	if (m_isAbandonTcpSocket) {
@@ -253,7 +952,8 @@ bool Connect::putPayloadData(
 		payloadData,
 		appendData,
 		nullptr,
-		nullptr
+		nullptr,
+		priority
 	);
 	if (!readySendPayloadDataSucceed) {
 		return false;
@@ -264,20 +964,23 @@ bool Connect::putPayloadData(
 bool Connect::putVariantMapData(
 	const QString& targetActionFlag,
 	const QVariantMap& variantMap,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::putVariantMapData", 0);
 	return this->putPayloadData(
 		targetActionFlag,
 		QJsonDocument(QJsonObject::fromVariantMap(variantMap)).toJson(QJsonDocument::Compact),
-		appendData
+		appendData,
+		priority
 	);
 }
 
 bool Connect::putFile(
 	const QString& targetActionFlag,
 	const QFileInfo& fileInfo,
-	const QVariantMap& appendData
+	const QVariantMap& appendData,
+	const NetworkPriority& priority
 ) {
 	NETWORK_THISNULL_CHECK("Connect::putFile", 0);
 	if (m_isAbandonTcpSocket) {
@@ -290,7 +993,8 @@ bool Connect::putFile(
 		fileInfo,
 		appendData,
 		nullptr,
-		nullptr
+		nullptr,
+		priority
 	);
 	if (!readySendFileData) {
 		return false;
@@ -315,6 +1019,11 @@ void Connect::onTcpSocketStateChanged() {
 			m_connectSettings->connectToHostSucceedCallback(this);
 			m_onceConnectSucceed = true;
 			m_connectSucceedTime = QDateTime::currentMSecsSinceEpoch();
+			this->applySocketOptions();
+			if (m_connectSettings->heartbeatInterval > 0) {
+				m_lastReceivedTime = m_connectSucceedTime;
+				TimerWheel::currentThreadWheel()->schedule(this, TimerWheel::Heartbeat, m_connectSettings->heartbeatInterval);
+			}
 			break;
 		}
 		case QAbstractSocket::UnconnectedState:
@@ -370,6 +1079,16 @@ void Connect::onTcpSocketBytesWritten(const qint64& bytes) {
 	NETWORK_NULLPTR_CHECK(m_tcpSocket);
 	m_waitForSendBytes -= bytes;
 	m_alreadyWrittenBytes += bytes;
+	this->addMetric(NetworkMetrics::SentBytes, bytes);
+	if (m_sendSchedulerQueuedCount) {
+		this->runSendScheduler();
+	}
+	if (!m_waitForSendFileBundles.isEmpty()) {
+		this->readySendNextFileBundle();
+	}
+	if ((m_waitForSendBytes <= 0) && m_tcpSocketBuffer.isEmpty()) {
+		this->scheduleIdleRelease();
+	}
 	//    qDebug() << "onTcpSocketBytesWritten:" << waitForSendBytes_ << alreadyWrittenBytes_ << QThread::currentThread();
 }
 
@@ -378,19 +1097,64 @@ void Connect::onTcpSocketReadyRead() {
 		return;
 	}
 	NETWORK_NULLPTR_CHECK(m_tcpSocket);
-	const auto&& data = m_tcpSocket->readAll();
-	m_tcpSocketBuffer.append(data);
+	auto data = m_tcpSocket->readAll();
+	this->addMetric(NetworkMetrics::ReceivedBytes, data.size());
+	if (m_connectSettings->heartbeatInterval > 0) {
+		m_lastReceivedTime = QDateTime::currentMSecsSinceEpoch();
+	}
+	if (m_tcpSocketBuffer.isEmpty()) {
+		// No copy, and the buffer keeps no capacity from an earlier burst
+		m_tcpSocketBuffer.swap(data);
+	} else {
+		m_tcpSocketBuffer.append(data);
+	}
 	//    qDebug() << tcpSocketBuffer_.size() << data.size();
 	forever
 	{
-		const auto && checkReply = Package::checkDataIsReadyReceive(m_tcpSocketBuffer);
+		const auto && checkReply = Package::checkDataIsReadyReceive(m_tcpSocketBuffer, m_peerSendsChecksum);
 		if (checkReply > 0) {
+			if (m_tcpSocketBuffer.isEmpty()) {
+				this->scheduleIdleRelease();
+			}
 			return;
 		}
 		if (checkReply < 0) {
-			m_tcpSocketBuffer.remove(0, checkReply * -1);
+			// Jump straight to the next plausible head instead of retrying one byte further each time
+			const auto&& skippedSize = Package::nextHeadIndex(m_tcpSocketBuffer, 1, m_peerSendsChecksum);
+			const auto&& currentTime = QDateTime::currentMSecsSinceEpoch();
+			if ((currentTime - m_corruptedWindowBegin) > m_connectSettings->corruptedBytesWindow) {
+				// Rare bursts of corruption over a long lived connect do not add up to a close
+				m_corruptedWindowBegin = currentTime;
+				m_windowCorruptedBytes = 0;
+			}
+			m_corruptedBytes += skippedSize;
+			m_windowCorruptedBytes += skippedSize;
+			this->addMetric(NetworkMetrics::CorruptedBytes, skippedSize);
+			if ((m_connectSettings->maximumCorruptedBytes != -1) &&
+				(m_windowCorruptedBytes > m_connectSettings->maximumCorruptedBytes)) {
+				qDebug() << "Connect::onTcpSocketReadyRead: too many corrupted bytes:" << m_windowCorruptedBytes;
+				this->onReadyToDelete();
+				return;
+			}
+			m_tcpSocketBuffer.remove(0, skippedSize);
 		} else {
 			auto package = Package::readPackage(m_tcpSocketBuffer);
+			this->addMetric(NetworkMetrics::ReceivedPackages);
+			if (m_connectSettings->tracer) {
+				this->traceReceivedPackage(package);
+			}
+			if (package->packageFlag() == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG) {
+				this->addMetric(NetworkMetrics::ReceivedFileChunks);
+			}
+			if (package->hasChecksum()) {
+				m_peerSendsChecksum = true;
+			}
+			if (package->isAbandonPackage()) {
+				this->addMetric(NetworkMetrics::ChecksumErrors);
+				// Transfers are pulled package by package and can not skip one, the senders see a closed connect
+				this->onReadyToDelete();
+				return;
+			}
 			if (package->isCompletePackage()) {
 				switch (package->packageFlag()) {
 				case NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG:
@@ -405,8 +1169,16 @@ void Connect::onTcpSocketReadyRead() {
 					}
 				case NETWORKPACKAGE_PAYLOADDATAREQUESTPACKGEFLAG:
 					{
-						if (!m_sendPayloadPackagePool.contains(package->randomFlag())) {
-							qDebug() << "Connect::onTcpSocketReadyRead: no contains randonFlag:" << package->
+						if (package->isTransferAborted()) {
+							this->onTransferAborted(package->randomFlag());
+							break;
+						}
+						if (m_waitForSendChunkedDataPool.contains(package->randomFlag())) {
+							this->sendNextChunkedData(package->randomFlag(), package);
+							break;
+						}
+						if (!m_sendPayloadPackagePool.contains(package->randomFlag())) {
+							qDebug() << "Connect::onTcpSocketReadyRead: no contains randonFlag:" << package->
 								randomFlag();
 							break;
 						}
@@ -434,6 +1206,14 @@ void Connect::onTcpSocketReadyRead() {
 					}
 				case NETWORKPACKAGE_FILEDATAREQUESTPACKGEFLAG:
 					{
+						if (package->isTransferAborted()) {
+							this->onTransferAborted(package->randomFlag());
+							break;
+						}
+						if (m_waitForSendChunkedDataPool.contains(package->randomFlag())) {
+							this->sendNextChunkedData(package->randomFlag(), package);
+							break;
+						}
 						const auto&& itForFile = m_waitForSendFiles.find(package->randomFlag());
 						const auto&& fileIsContains = itForFile != m_waitForSendFiles.end();
 						if (!fileIsContains) {
@@ -441,28 +1221,99 @@ void Connect::onTcpSocketReadyRead() {
 								package->randomFlag();
 							break;
 						}
-						const auto&& currentFileData = itForFile.value()->read(m_connectSettings->cutPackageSize);
-						this->sendPackageToRemote(
-							Package::createFileTransportPackage(
+						if (itForFile->fileDelta && package->containsFileDeltaResult()) {
+							if (package->isFileDeltaVerified()) {
+								m_waitForSendFiles.erase(itForFile);
+								this->traceSendFinished(package->randomFlag());
+								break;
+							}
+							// The receiver's rebuilt file did not match, it waits for the whole file now
+							qDebug() << "Connect::onTcpSocketReadyRead: file delta mismatch, sending the whole file, randomFlag:" <<
+								package->randomFlag();
+							itForFile->fileDelta = false;
+							itForFile->fileDeltaSignatures.clear();
+							itForFile->fileDeltaHash.clear();
+							itForFile->fileChecksum = 0;
+							itForFile->file->seek(0);
+						} else if (itForFile->fileDelta) {
+							if (!itForFile->fileDeltaSignatures) {
+								itForFile->fileDeltaSignatures = readFileDeltaSignatures(
+									package->fileDeltaBlockSize(),
+									package->payloadData()
+								);
+							}
+							// Kept after the last delta until the receiver has checked the rebuilt file
+							this->sendNextFileDelta(package->randomFlag(), *itForFile);
+							break;
+						}
+						const auto& file = itForFile->file;
+						qint64 fileOffset = -1;
+						const auto&& resumeOffset = package->fileResumeOffset();
+						if ((resumeOffset > file->pos()) && (resumeOffset < file->size())) {
+							if (fileResumeChecksum(file.data(), resumeOffset) == package->fileResumeChecksum()) {
+								file->seek(resumeOffset);
+								fileOffset = resumeOffset;
+								itForFile->fileChecksum = 0;
+							} else {
+								qDebug() << "Connect::onTcpSocketReadyRead: resume checksum mismatch, randomFlag:" <<
+									package->randomFlag();
+							}
+						}
+						const auto&& currentFileSize = static_cast<qint32>(
+							qMin(this->cutPackageSizeForPriority(itForFile->priority), itForFile->endOffset - file->pos()));
+						QSharedPointer<Package> filePackage;
+						if (this->useFileZeroCopy(currentFileSize)) {
+							filePackage = Package::createFileTransportPackage(
 								{}, // empty targetActionFlag,
 								{}, // empty fileInfo
-								currentFileData,
 								{}, // empty appendData
 								package->randomFlag(),
-								this->needCompressionPayloadData(currentFileData.size())
-							)
-						);
+								file,
+								file->pos(),
+								currentFileSize,
+								fileOffset
+							);
+							file->seek(file->pos() + currentFileSize);
+						} else {
+							const auto&& fileData = file->read(currentFileSize);
+							filePackage = Package::createFileTransportPackage(
+								{}, // empty targetActionFlag,
+								{}, // empty fileInfo
+								fileData,
+								{}, // empty appendData
+								package->randomFlag(),
+								this->needCompressionPayloadData(currentFileSize),
+								fileOffset
+							);
+							if (m_connectSettings->packageChecksumEnabled) {
+								itForFile->fileChecksum = Package::crc32c(fileData, itForFile->fileChecksum);
+								if (file->pos() >= itForFile->endOffset) {
+									filePackage->setFileChecksum(itForFile->fileChecksum);
+								}
+							}
+						}
+						filePackage->setSendPriority(itForFile->priority);
+						this->sendPackageToRemote(filePackage);
 						NETWORK_NULLPTR_CHECK(m_connectSettings->packageSendingCallback);
 						m_connectSettings->packageSendingCallback(
 							this,
 							package->randomFlag(),
-							itForFile.value()->pos() - currentFileData.size(),
-							currentFileData.size(),
-							itForFile.value()->size()
+							file->pos() - currentFileSize,
+							currentFileSize,
+							file->size()
 						);
-						if (itForFile.value()->atEnd()) {
-							itForFile.value()->close();
+						if (file->pos() >= itForFile->endOffset) {
+							// Closed with the last package, a file range package may still be queued
 							m_waitForSendFiles.erase(itForFile);
+							this->traceSendFinished(package->randomFlag());
+						}
+						break;
+					}
+				case NETWORKPACKAGE_HEARTBEATPACKGEFLAG:
+					{
+						m_peerAnswersHeartbeat = true;
+						if (package->randomFlag() == NETWORKPACKAGE_HEARTBEATPING) {
+							this->sendPackageToRemote(Package::createHeartbeatPackage(false));
 						}
 						break;
 					}
@@ -531,6 +1382,113 @@ void Connect::onTcpSocketConnectToHostTimeOut() {
 	this->onReadyToDelete();
 }
 
+void Connect::applySocketOptions() {
+	if (m_connectSettings->socketSendBufferSize > 0) {
+		m_tcpSocket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, m_connectSettings->socketSendBufferSize);
+	}
+	if (m_localTransport) {
+		return;
+	}
+	if (m_connectSettings->tcpKeepAliveIdle > 0) {
+		m_tcpSocket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+	}
+#ifdef Q_OS_LINUX
+	const auto&& socketDescriptor = static_cast<int>(m_tcpSocket->socketDescriptor());
+	if (socketDescriptor == -1) {
+		return;
+	}
+	const auto&& setOption = [socketDescriptor](const int& option, const int& value) {
+		if ((value > 0) && setsockopt(socketDescriptor, IPPROTO_TCP, option, &value, sizeof(value))) {
+			qDebug() << "Connect::applySocketOptions: setsockopt error, option:" << option << ", value:" << value;
+		}
+	};
+	if (m_connectSettings->tcpKeepAliveIdle > 0) {
+		setOption(TCP_KEEPIDLE, m_connectSettings->tcpKeepAliveIdle);
+		setOption(TCP_KEEPINTVL, m_connectSettings->tcpKeepAliveInterval);
+		setOption(TCP_KEEPCNT, m_connectSettings->tcpKeepAliveCount);
+	}
+	setOption(TCP_USER_TIMEOUT, m_connectSettings->tcpUserTimeout);
+#endif
+}
+
+qint64 Connect::onHeartbeatCheck(const qint64& currentTime) {
+	if (m_isAbandonTcpSocket) {
+		return -1;
+	}
+	const auto&& heartbeatInterval = static_cast<qint64>(m_connectSettings->heartbeatInterval);
+	const auto&& heartbeatTimeout = (m_connectSettings->heartbeatTimeout > 0)
+		? (static_cast<qint64>(m_connectSettings->heartbeatTimeout))
+		: (heartbeatInterval * 3);
+	const auto&& silence = currentTime - m_lastReceivedTime;
+	if (silence >= heartbeatTimeout) {
+		if (!m_peerAnswersHeartbeat) {
+			// An older peer drops the ping unanswered, its silence says nothing, leave it to TCP keepalive
+			qDebug() << "Connect::onHeartbeatCheck: the peer never answered a heartbeat, stop the heartbeat";
+			return -1;
+		}
+		qDebug() << "Connect::onHeartbeatCheck: no data received for" << silence << "ms, close the connect";
+		this->onReadyToDelete();
+		return -1;
+	}
+	if (silence < heartbeatInterval) {
+		// Traffic arrived in the meantime, nothing to send
+		return heartbeatInterval - silence;
+	}
+	if ((currentTime - m_lastHeartbeatTime) >= heartbeatInterval) {
+		m_lastHeartbeatTime = currentTime;
+		this->sendPackageToRemote(Package::createHeartbeatPackage(true));
+	}
+	return qMin(heartbeatInterval, heartbeatTimeout - silence);
+}
+
+void Connect::scheduleIdleRelease() {
+	// Runs after every round trip, so freeing here would only churn the allocator on a busy connect
+	m_activeSinceIdleCheck = true;
+	if (m_idleReleaseScheduled || (m_connectSettings->idleReleaseDelay < 0)) {
+		return;
+	}
+	m_idleReleaseScheduled = true;
+	m_activeSinceIdleCheck = false;
+	TimerWheel::currentThreadWheel()->schedule(this, TimerWheel::IdleRelease, m_connectSettings->idleReleaseDelay);
+}
+
+qint64 Connect::onIdleReleaseCheck() {
+	if (m_isAbandonTcpSocket) {
+		m_idleReleaseScheduled = false;
+		return -1;
+	}
+	if (m_activeSinceIdleCheck || (m_waitForSendBytes > 0) || !m_tcpSocketBuffer.isEmpty()) {
+		// Traffic in the meantime, look again one delay later
+		m_activeSinceIdleCheck = false;
+		return qMax(1, m_connectSettings->idleReleaseDelay);
+	}
+	m_idleReleaseScheduled = false;
+	this->releaseIdleState();
+	return -1;
+}
+
+void Connect::releaseIdleState() {
+	m_tcpSocketBuffer = QByteArray();
+	if (m_sendSchedulerQueuedCount || !m_onReceivedCallbacks.isEmpty() || !m_writeCoalescingBuffer.isEmpty()) {
+		return;
+	}
+	releaseIfEmpty(m_writeCoalescingBuffer);
+	releaseIfEmpty(m_onReceivedCallbacks);
+	for (auto& queue : m_sendSchedulerQueues) {
+		releaseIfEmpty(queue);
+	}
+	releaseIfEmpty(m_sendPayloadPackagePool);
+	releaseIfEmpty(m_receivePayloadPackagePool);
+	releaseIfEmpty(m_waitForSendFiles);
+	releaseIfEmpty(m_waitForSendFileBundles);
+	releaseIfEmpty(m_waitForSendChunkedDataPool);
+	releaseIfEmpty(m_receivedChunkedDataPool);
+	releaseIfEmpty(m_receivedFilePackagePool);
+	releaseIfEmpty(m_tracedSendingMessages);
+	releaseIfEmpty(m_tracedFinishedMessages);
+	releaseIfEmpty(m_tracedReceivingMessages);
+}
+
 void Connect::onSendPackageCheck() {
 	//    qDebug() << "onSendPackageCheck:" << QThread::currentThread() << this->thread();
 	if (m_onReceivedCallbacks.isEmpty()) {
@@ -540,6 +1498,7 @@ void Connect::onSendPackageCheck() {
 		auto it = m_onReceivedCallbacks.begin();
 		while ((it != m_onReceivedCallbacks.end()) &&
 			((currentTime - it->sendTime) > m_connectSettings->maximumReceivePackageWaitTime)) {
+			this->addMetric(NetworkMetrics::ReplyTimeouts);
 			if (it->failCallback) {
 				NETWORK_NULLPTR_CHECK(m_connectSettings->waitReplyPackageFailCallback);
 				m_connectSettings->waitReplyPackageFailCallback(this, it->failCallback);
@@ -553,6 +1512,13 @@ void Connect::onSendPackageCheck() {
 	}
 }
 
+void Connect::onWriteCoalescingTimeOut() {
+	if (m_isAbandonTcpSocket) {
+		return;
+	}
+	this->flushWriteCoalescingBuffer();
+}
+
 void Connect::startTimerForConnectToHostTimeOut() {
 	if (m_timerForConnectToHostTimeOut) {
 		qDebug() << "startTimerForConnectToHostTimeOut: error, timer already started";
@@ -585,6 +1551,22 @@ void Connect::startTimerForSendPackageCheck() {
 	m_timerForSendPackageCheck->start(1000);
 }
 
+void Connect::startTimerForWriteCoalescing() {
+	if (!m_timerForWriteCoalescing) {
+		m_timerForWriteCoalescing.reset(new QTimer);
+		connect(m_timerForWriteCoalescing.data(), &QTimer::timeout,
+			this, &Connect::onWriteCoalescingTimeOut,
+			Qt::DirectConnection);
+		m_timerForWriteCoalescing->setSingleShot(true);
+		m_timerForWriteCoalescing->setTimerType(Qt::PreciseTimer);
+	}
+	if (m_timerForWriteCoalescing->isActive()) {
+		return;
+	}
+	// QTimer works in milliseconds, a window below 1 ms becomes the next event loop iteration
+	m_timerForWriteCoalescing->start(qMax(0, m_connectSettings->writeCoalescingWindow) / 1000);
+}
+
 void Connect::onDataTransportPackageReceived(const QSharedPointer<Package>& package) {
 	if ((package->randomFlag() >= m_connectSettings->randomFlagRangeStart) &&
 		(package->randomFlag() < m_connectSettings->randomFlagRangeEnd)) {
@@ -595,6 +1577,13 @@ void Connect::onDataTransportPackageReceived(const QSharedPointer<Package>& pack
 		if (it == m_onReceivedCallbacks.end()) {
 			return;
 		}
+		if (m_connectSettings->metrics) {
+			m_connectSettings->metrics->observe(
+				NetworkMetrics::ReplyLatency,
+				NetworkMetrics::nowMicroseconds() - it->sendMicroseconds
+			);
+		}
+		this->traceReassemblyComplete(package->randomFlag());
 		if (it->succeedCallback) {
 			NETWORK_NULLPTR_CHECK(m_connectSettings->waitReplyPackageSucceedCallback);
 			m_connectSettings->waitReplyPackageSucceedCallback(this, package, it->succeedCallback);
@@ -604,6 +1593,15 @@ void Connect::onDataTransportPackageReceived(const QSharedPointer<Package>& pack
 		switch (package->packageFlag()) {
 			case NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG:
 			{
+				if (m_receivedChunkedDataPool.contains(package->randomFlag()) || (package->chunkedDataSize() != -1)) {
+					this->onChunkedDataReceived(package, true);
+					break;
+				}
+				if (!package->fileBundle().isEmpty()) {
+					this->onFileBundleReceived(package);
+					break;
+				}
+				this->traceReassemblyComplete(package->randomFlag());
 				NETWORK_NULLPTR_CHECK(m_connectSettings->packageReceivedCallback);
 				m_connectSettings->packageReceivedCallback(this, package);
 				break;
@@ -623,218 +1621,1880 @@ void Connect::onDataTransportPackageReceived(const QSharedPointer<Package>& pack
 	}
 }
 
-bool Connect::onFileDataTransportPackageReceived(
-	const QSharedPointer<Package>& package,
-	const bool& callbackOnFinish
-) {
-	const auto&& itForPackage = m_receivedFilePackagePool.find(package->randomFlag());
-	const auto&& packageIsCached = itForPackage != m_receivedFilePackagePool.end();
-	auto checkFinish = [this, packageIsCached, callbackOnFinish](const QSharedPointer<Package>& firstPackage,
-		QSharedPointer<QFile>& file)-> bool {
-			const auto&& fileSize = firstPackage->fileSize();
-			if (file->pos() != fileSize) {
-				if (!packageIsCached) {
-					this->m_receivedFilePackagePool[firstPackage->randomFlag()] = { firstPackage, file };
-				}
-				this->sendDataRequestToRemote(firstPackage);
-				return false;
-			}
-			const auto&& filePermissions = firstPackage->filePermissions();
-			file->setPermissions(QFile::Permissions(filePermissions));
-			file->close();
-			file.clear();
-#if ( defined Q_OS_MAC ) || ( defined __MINGW32__ ) || ( defined Q_OS_LINUX )
-			utimbuf timeBuf = { static_cast<time_t>(firstPackage->fileLastReadTime().toTime_t()), static_cast<time_t>(firstPackage->fileLastModifiedTime().toTime_t()) };
-			utime(firstPackage->localFilePath().toLatin1().data(), &timeBuf);
-#endif
-			if (callbackOnFinish) {
-				NETWORK_NULLPTR_CHECK(this->m_connectSettings->packageReceivedCallback, false);
-				this->m_connectSettings->packageReceivedCallback(this, firstPackage);
-			}
-			return true;
-		};
-	if (packageIsCached) {
-		itForPackage.value().second->write(package->payloadData());
-		itForPackage.value().second->waitForBytesWritten(m_connectSettings->maximumFileWriteWaitTime);
-		return checkFinish(itForPackage.value().first, itForPackage.value().second);
-	}
-	const auto&& fileName = package->fileName();
-	const auto&& fileSize = package->fileSize();
-	NETWORK_NULLPTR_CHECK(m_connectSettings->filePathProvider, false);
-	const auto&& localFilePath = m_connectSettings->filePathProvider(this, package, fileName);
-	if (localFilePath.isEmpty()) {
-		qDebug() << "Connect::onFileDataTransportPackageReceived: File path is empty, fileName:" << fileName;
-		return false;
-	}
-	const auto&& localFileInfo = QFileInfo(localFilePath);
-	if (!localFileInfo.dir().exists() && !localFileInfo.dir().mkpath(localFileInfo.dir().absolutePath())) {
-		qDebug() << "Connect::onFileDataTransportPackageReceived: mkpath error, filePath:" << localFilePath;
-		return false;
+void Connect::onFileBundleReceived(const QSharedPointer<Package>& package) {
+	if (!m_connectSettings->fileTransferEnabled) {
+		qDebug() << "Connect::onFileBundleReceived: fileTransfer is disabled, randomFlag:" << package->randomFlag();
+		return;
 	}
-	QSharedPointer<QFile> file(new QFile(localFilePath));
-	if (!file->open(QIODevice::WriteOnly)) {
-		qDebug() << "Connect::onFileDataTransportPackageReceived: Open file error, filePath:" << localFilePath;
-		return false;
+	NETWORK_NULLPTR_CHECK(m_connectSettings->filePathProvider);
+	// One provider call per bundle, the files keep their relative paths below the returned dir
+	const auto&& bundleRoot = package->fileBundle()["root"].toString();
+	const auto&& localBundleRootPath = m_connectSettings->filePathProvider(this, package, bundleRoot);
+	if (localBundleRootPath.isEmpty()) {
+		qDebug() << "Connect::onFileBundleReceived: Bundle path is empty, root:" << bundleRoot;
+		return;
 	}
-	if (!file->resize(fileSize)) {
-		qDebug() << "Connect::onFileDataTransportPackageReceived: File resize error, filePath:" <<
-			localFilePath;
-		return false;
+	package->setLocalFilePath(localBundleRootPath);
+	if (!m_fileWriteThreadPool) {
+		if (!writeFileBundle(package)) {
+			return;
+		}
+		package->clearPayloadData();
+		this->traceReassemblyComplete(package->randomFlag());
+		NETWORK_NULLPTR_CHECK(m_connectSettings->packageReceivedCallback);
+		m_connectSettings->packageReceivedCallback(this, package);
+		return;
 	}
-	package->setLocalFilePath(localFilePath);
-	file->write(package->payloadData());
-	file->waitForBytesWritten(m_connectSettings->maximumFileWriteWaitTime);
-	package->clearPayloadData();
-	return checkFinish(package, file);
+	m_fileWriteThreadPool->run(
+		[
+			thisPointer = QPointer<Connect>(this),
+			runOnConnectThreadCallback = m_runOnConnectThreadCallback,
+			package
+		]() {
+			const auto&& succeed = writeFileBundle(package);
+			package->clearPayloadData();
+			runOnConnectThreadCallback([thisPointer, package, succeed]() {
+				if (!thisPointer || !succeed) {
+					return;
+				}
+				thisPointer->traceReassemblyComplete(package->randomFlag());
+				NETWORK_NULLPTR_CHECK(thisPointer->m_connectSettings->packageReceivedCallback);
+				thisPointer->m_connectSettings->packageReceivedCallback(thisPointer, package);
+				});
+		}
+	);
 }
 
-void Connect::onReadyToDelete() {
-	if (m_isAbandonTcpSocket) {
-		return;
-	}
-	m_isAbandonTcpSocket = true;
-	if (!m_timerForConnectToHostTimeOut) {
-		m_timerForConnectToHostTimeOut.clear();
-	}
-	if (!m_onReceivedCallbacks.isEmpty()) {
-		for (const auto& callback : m_onReceivedCallbacks) {
-			if (!callback.failCallback) {
-				continue;
+bool Connect::writeFileBundle(const QSharedPointer<Package>& package) {
+	const QDir localBundleRootDir(package->localFilePath());
+	const auto&& payloadData = package->payloadData();
+	const auto&& files = package->fileBundle()["files"].toList();
+	QSet<QString> existingDirPaths; // one mkpath per directory instead of one per file
+	qint64 payloadOffset = 0;
+	for (const auto& file : files) {
+		const auto&& fileFields = file.toList();
+		if (fileFields.size() < 4) {
+			qDebug() << "Connect::writeFileBundle: Invalid manifest entry:" << file;
+			return false;
+		}
+		const auto&& relativePath = QDir::cleanPath(fileFields[0].toString());
+		const auto&& fileSize = fileFields[1].toLongLong();
+		if (relativePath.isEmpty() || QDir::isAbsolutePath(relativePath) || (relativePath == "..") ||
+			relativePath.startsWith("../") || (fileSize < 0) || ((payloadOffset + fileSize) > payloadData.size())) {
+			qDebug() << "Connect::writeFileBundle: Invalid manifest entry:" << file;
+			return false;
+		}
+		const auto&& localFilePath = localBundleRootDir.filePath(relativePath);
+		const auto&& localDirPath = QFileInfo(localFilePath).absolutePath();
+		if (!existingDirPaths.contains(localDirPath)) {
+			if (!QDir().mkpath(localDirPath)) {
+				qDebug() << "Connect::writeFileBundle: mkpath error, dirPath:" << localDirPath;
+				return false;
 			}
-			callback.failCallback(this);
+			existingDirPaths.insert(localDirPath);
+		}
+		QFile localFile(localFilePath);
+		if (!localFile.open(QIODevice::WriteOnly) ||
+			(localFile.write(payloadData.constData() + payloadOffset, fileSize) != fileSize) ||
+			!localFile.flush()) {
+			qDebug() << "Connect::writeFileBundle: File write error, filePath:" << localFilePath;
+			return false;
 		}
+		payloadOffset += fileSize;
+		// Still open, permissions and time go through the descriptor instead of another path lookup each
+		localFile.setPermissions(QFile::Permissions(fileFields[2].toInt()));
+		localFile.setFileTime(QDateTime::fromMSecsSinceEpoch(fileFields[3].toLongLong()),
+			QFileDevice::FileModificationTime);
 	}
-	NETWORK_NULLPTR_CHECK(m_tcpSocket);
-	m_tcpSocket->close();
-	NETWORK_NULLPTR_CHECK(m_connectSettings->readyToDeleteCallback);
-	m_connectSettings->readyToDeleteCallback(this);
+	return true;
 }
 
-qint32 Connect::nextRandomFlag() {
-	m_mutexForSend.lock();
-	if (m_sendRandomFlagRotaryIndex >= m_connectSettings->randomFlagRangeEnd) {
-		m_sendRandomFlagRotaryIndex = m_connectSettings->randomFlagRangeStart;
-	} else {
-		++m_sendRandomFlagRotaryIndex;
+bool Connect::onChunkedDataReceived(const QSharedPointer<Package>& package, const bool& callbackOnFinish) {
+	const auto&& randomFlag = package->randomFlag();
+	auto itForChunkedData = m_receivedChunkedDataPool.find(randomFlag);
+	if (itForChunkedData == m_receivedChunkedDataPool.end()) {
+		return this->openChunkedData(package, callbackOnFinish);
 	}
-	const auto currentRandomFlag = m_sendRandomFlagRotaryIndex;
-	m_mutexForSend.unlock();
-	return currentRandomFlag;
+	itForChunkedData->pendingChunkData.append(package->payloadData());
+	if (this->placeReceivedChunks(randomFlag, *itForChunkedData)) {
+		return true;
+	}
+	itForChunkedData = m_receivedChunkedDataPool.find(randomFlag);
+	if (itForChunkedData != m_receivedChunkedDataPool.end()) {
+		this->sendDataRequestToRemote(itForChunkedData->firstPackage);
+	}
+	return false;
 }
 
-bool Connect::readySendPayloadData(
-	const qint32& randomFlag,
-	const QString& targetActionFlag,
-	const QByteArray& payloadData,
-	const QVariantMap& appendData,
-	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
-) {
-	auto packages = Package::createPayloadTransportPackages(
-		targetActionFlag,
-		payloadData,
-		appendData,
-		randomFlag,
-		m_connectSettings->cutPackageSize,
-		this->needCompressionPayloadData(payloadData.size())
-	);
-	if (packages.isEmpty()) {
-		qDebug() << "Connect::readySendPayloadData: createPackagesFromPayloadData error";
+bool Connect::openChunkedData(const QSharedPointer<Package>& package, const bool& callbackOnFinish) {
+	const auto&& randomFlag = package->randomFlag();
+	const auto&& chunkManifest = package->payloadData();
+	const auto&& chunkEntrySize = NETWORKPACKAGE_CHUNKHASHSIZE + static_cast<int>(sizeof(qint32));
+	if (chunkManifest.isEmpty() || (chunkManifest.size() % chunkEntrySize)) {
+		qDebug() << "Connect::openChunkedData: Invalid chunk manifest, randomFlag:" << randomFlag;
 		return false;
 	}
-	this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
-	return true;
+	QSharedPointer<QFile> file;
+	if (package->packageFlag() == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG) {
+		file.reset(new QFile(package->localFilePath()));
+		if (!file->open(QIODevice::WriteOnly) || !preallocateFile(file.data(), package->chunkedDataSize())) {
+			qDebug() << "Connect::openChunkedData: Open file error, filePath:" << package->localFilePath();
+			return false;
+		}
+	}
+	// Chunks in the store, or wanted once already in this manifest, are taken from the store
+	const auto&& chunkCount = chunkManifest.size() / chunkEntrySize;
+	QByteArray chunkWants((chunkCount + 7) / 8, 0);
+	QSet<QByteArray> wantedChunkHashes;
+	for (auto index = 0; index < chunkCount; ++index) {
+		const auto&& chunkHash = chunkManifest.mid(index * chunkEntrySize, NETWORKPACKAGE_CHUNKHASHSIZE);
+		if (!m_connectSettings->chunkStoreDir.isEmpty() &&
+			(wantedChunkHashes.contains(chunkHash) || QFile::exists(this->chunkStorePath(chunkHash)))) {
+			continue;
+		}
+		wantedChunkHashes.insert(chunkHash);
+		chunkWants[index >> 3] = static_cast<char>(chunkWants[index >> 3] | (1 << (index & 7)));
+	}
+	package->clearPayloadData();
+	auto& receivedChunkedData = m_receivedChunkedDataPool[randomFlag];
+	receivedChunkedData.firstPackage = package;
+	receivedChunkedData.callbackOnFinish = callbackOnFinish;
+	receivedChunkedData.chunkManifest = chunkManifest;
+	receivedChunkedData.chunkWants = chunkWants;
+	receivedChunkedData.file = file;
+	// The wants double as the first data request
+	this->sendPackageToRemote(Package::createChunkWantsPackage(package->packageFlag(), randomFlag, chunkWants));
+	return this->placeReceivedChunks(randomFlag, receivedChunkedData);
 }
 
-bool Connect::readySendFileData(
-	const qint32& randomFlag,
-	const QString& targetActionFlag,
-	const QFileInfo& fileInfo,
-	const QVariantMap& appendData,
-	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
-) {
-	if (m_waitForSendFiles.contains(randomFlag)) {
-		qDebug() << "Connect::readySendFileData: file is sending, filePath:" << fileInfo.filePath();
-		return false;
+bool Connect::placeReceivedChunks(const qint32& randomFlag, ReceivedChunkedData& receivedChunkedData) {
+	const auto&& chunkEntrySize = NETWORKPACKAGE_CHUNKHASHSIZE + static_cast<int>(sizeof(qint32));
+	const auto&& chunkCount = receivedChunkedData.chunkManifest.size() / chunkEntrySize;
+	const auto&& packageFlag = receivedChunkedData.firstPackage->packageFlag();
+	while (receivedChunkedData.chunkIndex < chunkCount) {
+		const auto* chunkEntry = receivedChunkedData.chunkManifest.constData() +
+			(receivedChunkedData.chunkIndex * chunkEntrySize);
+		const QByteArray chunkHash(chunkEntry, NETWORKPACKAGE_CHUNKHASHSIZE);
+		qint32 chunkSize;
+		std::memcpy(&chunkSize, chunkEntry + NETWORKPACKAGE_CHUNKHASHSIZE, sizeof(chunkSize));
+		QByteArray chunkData;
+		if (chunkIsWanted(receivedChunkedData.chunkWants, receivedChunkedData.chunkIndex)) {
+			if (receivedChunkedData.pendingChunkData.size() < chunkSize) {
+				return false;
+			}
+			chunkData = receivedChunkedData.pendingChunkData.left(chunkSize);
+			receivedChunkedData.pendingChunkData.remove(0, chunkSize);
+			if (QCryptographicHash::hash(chunkData, QCryptographicHash::Sha256) != chunkHash) {
+				qDebug() << "Connect::placeReceivedChunks: Chunk hash mismatch, randomFlag:" << randomFlag;
+				this->abortReceivedChunkedData(randomFlag);
+				this->sendTransferAbortToRemote(packageFlag, randomFlag);
+				return false;
+			}
+			if (!m_connectSettings->chunkStoreDir.isEmpty()) {
+				const auto&& chunkFilePath = this->chunkStorePath(chunkHash);
+				QDir().mkpath(QFileInfo(chunkFilePath).absolutePath());
+				// Another connect may store the same chunk at the same time, QSaveFile only ever shows a whole one
+				QSaveFile chunkFile(chunkFilePath);
+				if (!chunkFile.open(QIODevice::WriteOnly) || (chunkFile.write(chunkData) != chunkData.size()) ||
+					!chunkFile.commit()) {
+					qDebug() << "Connect::placeReceivedChunks: Chunk store write error, filePath:" << chunkFilePath;
+				}
+			}
+		} else {
+			QFile chunkFile(this->chunkStorePath(chunkHash));
+			if (chunkFile.open(QIODevice::ReadOnly)) {
+				chunkData = chunkFile.readAll();
+				chunkFile.close();
+			}
+			// The store is only a cache on disk, a damaged chunk is dropped so the next transfer wants it again
+			if ((chunkData.size() != chunkSize) ||
+				(QCryptographicHash::hash(chunkData, QCryptographicHash::Sha256) != chunkHash)) {
+				qDebug() << "Connect::placeReceivedChunks: Chunk store read error, filePath:" << chunkFile.fileName();
+				chunkFile.remove();
+				this->abortReceivedChunkedData(randomFlag);
+				this->sendTransferAbortToRemote(packageFlag, randomFlag);
+				return false;
+			}
+		}
+		if (receivedChunkedData.file) {
+			if (!writeFileData(receivedChunkedData.file.data(), receivedChunkedData.receivedOffset, chunkData, false)) {
+				qDebug() << "Connect::placeReceivedChunks: File write error, filePath:" <<
+					receivedChunkedData.file->fileName();
+				this->abortReceivedChunkedData(randomFlag);
+				this->sendTransferAbortToRemote(packageFlag, randomFlag);
+				return false;
+			}
+		} else {
+			receivedChunkedData.payloadData.append(chunkData);
+		}
+		receivedChunkedData.fileChecksum = Package::crc32c(chunkData, receivedChunkedData.fileChecksum);
+		receivedChunkedData.receivedOffset += chunkSize;
+		++receivedChunkedData.chunkIndex;
 	}
-	if (!fileInfo.exists()) {
-		qDebug() << "Connect::readySendFileData: file not exists, filePath:" << fileInfo.filePath();
+	// Each chunk matched its hash, this covers the order they were put together in
+	const auto&& fileChecksum = receivedChunkedData.firstPackage->fileChecksum();
+	if ((fileChecksum != -1) && (fileChecksum != receivedChunkedData.fileChecksum)) {
+		qDebug() << "Connect::placeReceivedChunks: File checksum mismatch, randomFlag:" << randomFlag;
+		this->abortReceivedChunkedData(randomFlag);
+		this->sendTransferAbortToRemote(packageFlag, randomFlag);
 		return false;
 	}
-	QSharedPointer<QFile> file(new QFile(fileInfo.filePath()));
-	if (!file->open(QIODevice::ReadOnly)) {
-		qDebug() << "Connect::readySendFileData: file open error, filePath:" << fileInfo.filePath();
-		return false;
+	const auto&& finishedChunkedData = m_receivedChunkedDataPool.take(randomFlag);
+	const auto& firstPackage = finishedChunkedData.firstPackage;
+	if (finishedChunkedData.file) {
+		finishedChunkedData.file->close();
+		this->completeReceivedFile(firstPackage, finishedChunkedData.callbackOnFinish);
+		return true;
 	}
-	const auto&& fileData = file->read(m_connectSettings->cutPackageSize);
-	if (!file->atEnd()) {
-		m_waitForSendFiles[randomFlag] = file;
+	auto package = Package::createPayloadTransportPackages(
+		firstPackage->targetActionFlag(),
+		finishedChunkedData.payloadData,
+		firstPackage->appendData(),
+		randomFlag
+	).first();
+	package->refreshPackage();
+	if (finishedChunkedData.callbackOnFinish) {
+		this->traceReassemblyComplete(randomFlag);
+		NETWORK_NULLPTR_CHECK(m_connectSettings->packageReceivedCallback, true);
+		m_connectSettings->packageReceivedCallback(this, package);
 	}
-	auto packages = QList<QSharedPointer<Package>>(
-		{
-			Package::createFileTransportPackage(
-				targetActionFlag,
-				fileInfo,
-				fileData,
-				appendData,
-				randomFlag,
-				this->needCompressionPayloadData(fileData.size())
-			)
-		}
-	);
-	this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
 	return true;
 }
 
-void Connect::readySendPackages(
-	const qint32& randomFlag,
-	QList<QSharedPointer<Package>>& packages,
-	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
-	const ConnectPointerFunction& failCallback
-) {
-	if (this->thread() != QThread::currentThread()) {
-		m_runOnConnectThreadCallback(
-			[
-				this,
-					randomFlag,
-					packages,
-					succeedCallback,
-					failCallback
-			]() {
-				auto buf = packages;
-				this->readySendPackages(randomFlag, buf, succeedCallback, failCallback);
-			}
-				);
-		return;
+void Connect::sendNextChunkedData(const qint32& randomFlag, const QSharedPointer<Package>& requestPackage) {
+	auto itForChunkedData = m_waitForSendChunkedDataPool.find(randomFlag);
+	auto& waitForSendChunkedData = *itForChunkedData;
+	if (!waitForSendChunkedData.chunkWantsReceived) {
+		waitForSendChunkedData.chunkWants = requestPackage->payloadData();
+		waitForSendChunkedData.chunkWantsReceived = true;
 	}
-	auto firstPackage = packages.first();
-	this->sendPackageToRemote(firstPackage);
-	if (succeedCallback || failCallback) {
-		m_onReceivedCallbacks[randomFlag] =
-		{
-			QDateTime::currentMSecsSinceEpoch(),
-			succeedCallback,
-			failCallback
-		};
-		if (!m_timerForSendPackageCheck) {
-			this->startTimerForSendPackageCheck();
+	const auto& chunkOffsets = waitForSendChunkedData.chunkOffsets;
+	const auto&& chunkCount = chunkOffsets.size();
+	const auto&& sourceSize = waitForSendChunkedData.source->size();
+	const auto&& cutPackageSize = this->cutPackageSizeForPriority(waitForSendChunkedData.priority);
+	qint64 progressOffset = -1;
+	QByteArray chunkData;
+	// Only the wanted chunks travel, back to back, a chunk may continue in the next package
+	while ((waitForSendChunkedData.chunkIndex < chunkCount) && (chunkData.size() < cutPackageSize)) {
+		const auto&& chunkIndex = waitForSendChunkedData.chunkIndex;
+		if (!chunkIsWanted(waitForSendChunkedData.chunkWants, chunkIndex)) {
+			++waitForSendChunkedData.chunkIndex;
+			continue;
+		}
+		const auto&& chunkEnd = ((chunkIndex + 1) < chunkCount) ? (chunkOffsets[chunkIndex + 1]) : (sourceSize);
+		const auto&& readOffset = chunkOffsets[chunkIndex] + waitForSendChunkedData.chunkDataOffset;
+		const auto&& readSize = qMin(chunkEnd - readOffset, cutPackageSize - chunkData.size());
+		const auto&& data = (waitForSendChunkedData.source->seek(readOffset))
+			? (waitForSendChunkedData.source->read(readSize))
+			: (QByteArray());
+		if (data.size() != readSize) {
+			qDebug() << "Connect::sendNextChunkedData: read error, randomFlag:" << randomFlag;
+			m_waitForSendChunkedDataPool.erase(itForChunkedData);
+			return;
+		}
+		if (progressOffset == -1) {
+			progressOffset = readOffset;
+		}
+		chunkData.append(data);
+		waitForSendChunkedData.chunkDataOffset += readSize;
+		if ((readOffset + readSize) >= chunkEnd) {
+			++waitForSendChunkedData.chunkIndex;
+			waitForSendChunkedData.chunkDataOffset = 0;
 		}
 	}
-	if (packages.size() > 1) {
-		m_sendPayloadPackagePool[randomFlag].swap(packages);
-		m_sendPayloadPackagePool[randomFlag].pop_front();
+	while ((waitForSendChunkedData.chunkIndex < chunkCount) &&
+		!chunkIsWanted(waitForSendChunkedData.chunkWants, waitForSendChunkedData.chunkIndex)) {
+		++waitForSendChunkedData.chunkIndex;
+	}
+	const auto&& packageFlag = waitForSendChunkedData.packageFlag;
+	const auto&& priority = waitForSendChunkedData.priority;
+	if (waitForSendChunkedData.chunkIndex >= chunkCount) {
+		m_waitForSendChunkedDataPool.erase(itForChunkedData);
+	}
+	if (chunkData.isEmpty()) {
+		return;
+	}
+	auto chunkPackage = (packageFlag == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)
+		? (Package::createFileTransportPackage(
+			{}, // empty targetActionFlag,
+			{}, // empty fileInfo
+			chunkData,
+			{}, // empty appendData
+			randomFlag,
+			this->needCompressionPayloadData(chunkData.size())))
+		: (Package::createPayloadTransportPackages(
+			{}, // empty targetActionFlag,
+			chunkData,
+			{}, // empty appendData
+			randomFlag,
+			-1,
+			this->needCompressionPayloadData(chunkData.size())).first());
+	chunkPackage->setSendPriority(priority);
+	this->sendPackageToRemote(chunkPackage);
+	if (!m_waitForSendChunkedDataPool.contains(randomFlag)) {
+		this->traceSendFinished(randomFlag);
 	}
 	NETWORK_NULLPTR_CHECK(m_connectSettings->packageSendingCallback);
 	m_connectSettings->packageSendingCallback(
 		this,
 		randomFlag,
-		0,
-		firstPackage->payloadDataOriginalCurrentSize(),
-		firstPackage->payloadDataTotalSize()
+		progressOffset,
+		chunkData.size(),
+		sourceSize
 	);
 }
 
+QString Connect::chunkStorePath(const QByteArray& chunkHash) const {
+	const auto&& chunkName = QString::fromLatin1(chunkHash.toHex());
+	return QString("%1/%2/%3").arg(m_connectSettings->chunkStoreDir, chunkName.left(2), chunkName);
+}
+
+QByteArray Connect::computeChunkManifest(QIODevice* source, QVector<qint64>& chunkOffsets, quint32& sourceChecksum) {
+	QByteArray chunkManifest;
+	sourceChecksum = 0;
+	if (!source->seek(0)) {
+		return chunkManifest;
+	}
+	QByteArray buffer;
+	qint64 bufferPosition = 0;
+	qint64 sourceOffset = 0;
+	forever {
+		// Keep a maximum chunk ahead, so where a read ends never decides where a chunk ends
+		if (((buffer.size() - bufferPosition) < NETWORKPACKAGE_CHUNKMAXIMUMSIZE) && !source->atEnd()) {
+			const auto&& data = source->read(16 * NETWORKPACKAGE_CHUNKMAXIMUMSIZE);
+			if (data.isEmpty()) {
+				return QByteArray();
+			}
+			sourceChecksum = Package::crc32c(data, sourceChecksum);
+			buffer = buffer.mid(static_cast<int>(bufferPosition)) + data;
+			bufferPosition = 0;
+			continue;
+		}
+		const auto&& remainingSize = buffer.size() - bufferPosition;
+		if (remainingSize <= 0) {
+			break;
+		}
+		const auto&& chunkSize = nextChunkSize(
+			reinterpret_cast<const uchar*>(buffer.constData()) + bufferPosition,
+			remainingSize
+		);
+		chunkManifest.append(QCryptographicHash::hash(
+			QByteArray::fromRawData(buffer.constData() + bufferPosition, static_cast<int>(chunkSize)),
+			QCryptographicHash::Sha256
+		));
+		const auto&& chunkSizeInManifest = static_cast<qint32>(chunkSize);
+		chunkManifest.append(reinterpret_cast<const char*>(&chunkSizeInManifest), sizeof(chunkSizeInManifest));
+		chunkOffsets.push_back(sourceOffset);
+		sourceOffset += chunkSize;
+		bufferPosition += chunkSize;
+	}
+	return chunkManifest;
+}
+
+qint64 Connect::nextChunkSize(const uchar* data, const qint64& size) {
+	if (size <= NETWORKPACKAGE_CHUNKMINIMUMSIZE) {
+		return size;
+	}
+	// FastCDC normalized chunking, a stricter mask before the average size and a looser one after it keeps
+	// the sizes close to the average. The gear hash shifts left, so its high bits cover the last 64 bytes
+	const auto strictMask = ~quint64(0) << (64 - (NETWORKPACKAGE_CHUNKAVERAGESIZEBITS + 2));
+	const auto looseMask = ~quint64(0) << (64 - (NETWORKPACKAGE_CHUNKAVERAGESIZEBITS - 2));
+	const auto& gearTable = chunkGearTable();
+	const auto&& averageSize = qMin(size, qint64(1) << NETWORKPACKAGE_CHUNKAVERAGESIZEBITS);
+	const auto&& maximumSize = qMin(size, NETWORKPACKAGE_CHUNKMAXIMUMSIZE);
+	quint64 hash = 0;
+	auto index = NETWORKPACKAGE_CHUNKMINIMUMSIZE;
+	for (; index < averageSize; ++index) {
+		hash = (hash << 1) + gearTable[data[index]];
+		if (!(hash & strictMask)) {
+			return index + 1;
+		}
+	}
+	for (; index < maximumSize; ++index) {
+		hash = (hash << 1) + gearTable[data[index]];
+		if (!(hash & looseMask)) {
+			return index + 1;
+		}
+	}
+	return maximumSize;
+}
+
+bool Connect::onFileDataTransportPackageReceived(
+	const QSharedPointer<Package>& package,
+	const bool& callbackOnFinish
+) {
+	if (m_receivedChunkedDataPool.contains(package->randomFlag())) {
+		return this->onChunkedDataReceived(package, callbackOnFinish);
+	}
+	const auto&& itForFile = m_receivedFilePackagePool.find(package->randomFlag());
+	if (itForFile != m_receivedFilePackagePool.end()) {
+		auto& receivedFile = itForFile.value();
+		if (receivedFile.fileDeltaBlockSize > 0) {
+			if (!package->fileHash().isEmpty()) {
+				receivedFile.fileHash = package->fileHash();
+			}
+			return this->writeReceivedFileDelta(package->randomFlag(), receivedFile, package->payloadData());
+		}
+		if (package->fileOffset() != -1) {
+			receivedFile.receivedOffset = package->fileOffset();
+		}
+		if (!this->checkReceivedFileChecksum(package->randomFlag(), receivedFile, package, package->payloadData())) {
+			return false;
+		}
+		return this->writeReceivedFileData(package->randomFlag(), receivedFile, package->payloadData());
+	}
+	const auto&& fileName = package->fileName();
+	const auto&& fileSize = package->fileSize();
+	const auto&& fileBundle = package->fileBundle();
+	NETWORK_NULLPTR_CHECK(m_connectSettings->filePathProvider, false);
+	// A file too big for a bundle lands below the bundle root, next to the files of the other bundles
+	auto localFilePath = m_connectSettings->filePathProvider(
+		this,
+		package,
+		(fileBundle.isEmpty()) ? (fileName) : (fileBundle["root"].toString())
+	);
+	if (localFilePath.isEmpty()) {
+		qDebug() << "Connect::onFileDataTransportPackageReceived: File path is empty, fileName:" << fileName;
+		return false;
+	}
+	if (!fileBundle.isEmpty()) {
+		const auto&& relativePath = QDir::cleanPath(fileBundle["path"].toString());
+		if (relativePath.isEmpty() || QDir::isAbsolutePath(relativePath) || (relativePath == "..") ||
+			relativePath.startsWith("../")) {
+			qDebug() << "Connect::onFileDataTransportPackageReceived: Invalid bundle path:" << relativePath;
+			return false;
+		}
+		localFilePath = QDir(localFilePath).filePath(relativePath);
+	}
+	const auto&& localFileInfo = QFileInfo(localFilePath);
+	if (!localFileInfo.dir().exists() && !localFileInfo.dir().mkpath(localFileInfo.dir().absolutePath())) {
+		qDebug() << "Connect::onFileDataTransportPackageReceived: mkpath error, filePath:" << localFilePath;
+		return false;
+	}
+	package->setLocalFilePath(localFilePath);
+	if (package->isFileDelta()) {
+		return this->openFileDelta(package, callbackOnFinish);
+	}
+	if (package->chunkedDataSize() != -1) {
+		return this->openChunkedData(package, callbackOnFinish);
+	}
+	const auto&& fileStripe = package->fileStripe();
+	// Resume is per file, a striped transfer is simply sent again
+	const auto&& resumeOffset = (fileStripe.isEmpty()) ? (this->fileResumeOffset(package, localFilePath)) : (-1);
+	QSharedPointer<QFile> file(new QFile(localFilePath));
+	if (!fileStripe.isEmpty()) {
+		if (!this->openFileStripe(package, callbackOnFinish, file.data())) {
+			qDebug() << "Connect::onFileDataTransportPackageReceived: Open file stripe error, filePath:" <<
+				localFilePath;
+			return false;
+		}
+	} else {
+		if (!file->open((resumeOffset > 0) ? (QIODevice::ReadWrite) : (QIODevice::WriteOnly))) {
+			qDebug() << "Connect::onFileDataTransportPackageReceived: Open file error, filePath:" << localFilePath;
+			return false;
+		}
+		if (!preallocateFile(file.data(), fileSize)) {
+			qDebug() << "Connect::onFileDataTransportPackageReceived: File resize error, filePath:" <<
+				localFilePath;
+			return false;
+		}
+	}
+	const auto&& firstFileData = package->payloadData();
+	package->clearPayloadData();
+	auto& receivedFile = m_receivedFilePackagePool[package->randomFlag()];
+	receivedFile.firstPackage = package;
+	receivedFile.file = file;
+	receivedFile.callbackOnFinish = callbackOnFinish;
+	receivedFile.receivedOffset = (fileStripe.isEmpty()) ? (qint64(0)) : (fileStripe["offset"].toLongLong());
+	receivedFile.endOffset = (fileStripe.isEmpty())
+		? (fileSize)
+		: (qMin(fileSize, receivedFile.receivedOffset + fileStripe["size"].toLongLong()));
+	receivedFile.stripeId = fileStripe["id"].toString();
+	if (resumeOffset > 0) {
+		// Checksum before the first chunk is queued, the writer pool must be the only user of the file afterwards
+		receivedFile.resumeOffset = resumeOffset;
+		receivedFile.resumeChecksum = fileResumeChecksum(file.data(), resumeOffset);
+	}
+	if (!this->checkReceivedFileChecksum(package->randomFlag(), receivedFile, package, firstFileData)) {
+		return false;
+	}
+	return this->writeReceivedFileData(package->randomFlag(), receivedFile, firstFileData);
+}
+
+bool Connect::checkReceivedFileChecksum(
+	const qint32& randomFlag,
+	ReceivedFile& receivedFile,
+	const QSharedPointer<Package>& package,
+	const QByteArray& fileData
+) {
+	if (!package->hasChecksum()) {
+		return true;
+	}
+	if (package->fileOffset() != -1) {
+		// The sender moved to a resume offset and started its checksum again there
+		receivedFile.fileChecksum = 0;
+	}
+	// Summed up as the data arrives, so the whole file is verified without reading it back
+	receivedFile.fileChecksum = Package::crc32c(fileData, receivedFile.fileChecksum);
+	const auto&& fileChecksum = package->fileChecksum();
+	if ((fileChecksum == -1) || (fileChecksum == receivedFile.fileChecksum)) {
+		return true;
+	}
+	qDebug() << "Connect::checkReceivedFileChecksum: File checksum mismatch, filePath:" <<
+		receivedFile.firstPackage->localFilePath();
+	// Some of the data on disk is wrong and nothing tells which, resuming from it would keep the damage
+	this->abortReceivedFile(randomFlag, true);
+	this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+	return false;
+}
+
+bool Connect::writeReceivedFileData(const qint32& randomFlag, ReceivedFile& receivedFile, const QByteArray& fileData) {
+	const auto offset = receivedFile.receivedOffset;
+	receivedFile.receivedOffset += fileData.size();
+	const auto&& isLastData = receivedFile.receivedOffset >= receivedFile.endOffset;
+	const auto&& syncRange = (m_connectSettings->fileWriteSyncRangeMinimumBytes != -1) &&
+		(receivedFile.firstPackage->fileSize() >= m_connectSettings->fileWriteSyncRangeMinimumBytes);
+	// Keep the old sidecar until the remote has answered the resume request
+	const auto&& saveSidecar = m_connectSettings->fileTransferResumeEnabled && (receivedFile.resumeOffset <= 0);
+	if (!m_fileWriteThreadPool) {
+		if (!writeFileData(receivedFile.file.data(), offset, fileData, syncRange)) {
+			qDebug() << "Connect::writeReceivedFileData: File write error, filePath:" <<
+				receivedFile.firstPackage->localFilePath();
+			this->abortReceivedFile(randomFlag, !m_connectSettings->fileTransferResumeEnabled);
+			this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+			return false;
+		}
+		if (isLastData) {
+			return this->finishReceivedFile(randomFlag);
+		}
+		if (saveSidecar) {
+			saveFileResumeSidecar(receivedFile.firstPackage, receivedFile.file.data());
+		}
+		this->requestNextFileData(randomFlag, receivedFile);
+		return false;
+	}
+	receivedFile.pendingWriteBytes += fileData.size();
+	m_pendingFileWriteBytes += fileData.size();
+	receivedFile.writeThreadIndex = m_fileWriteThreadPool->run(
+		[
+			thisPointer = QPointer<Connect>(this),
+			runOnConnectThreadCallback = m_runOnConnectThreadCallback,
+			saveSidecar,
+			firstPackage = receivedFile.firstPackage,
+			file = receivedFile.file,
+			writeAborted = receivedFile.writeAborted,
+			randomFlag,
+			offset,
+			fileData,
+			isLastData,
+			syncRange
+		]() {
+			const auto&& succeed = !*writeAborted && writeFileData(file.data(), offset, fileData, syncRange);
+			if (succeed && isLastData) {
+				file->close();
+			} else if (succeed && saveSidecar) {
+				saveFileResumeSidecar(firstPackage, file.data());
+			}
+			const auto&& dataSize = static_cast<qint64>(fileData.size());
+			runOnConnectThreadCallback([thisPointer, randomFlag, dataSize, succeed]() {
+				if (!thisPointer) {
+					return;
+				}
+				thisPointer->onReceivedFileDataWritten(randomFlag, dataSize, succeed);
+				});
+		},
+		receivedFile.writeThreadIndex // one thread per file keeps its chunks in order
+			);
+	if (isLastData) {
+		// Finished from onReceivedFileDataWritten once everything is on disk
+		return false;
+	}
+	if (m_pendingFileWriteBytes > m_connectSettings->maximumPendingFileWriteBytes) {
+		// The sender only sends the next chunk when asked, holding the request back is the backpressure
+		receivedFile.dataRequestDeferred = true;
+		return false;
+	}
+	this->requestNextFileData(randomFlag, receivedFile);
+	return false;
+}
+
+void Connect::onReceivedFileDataWritten(const qint32& randomFlag, const qint64& dataSize, const bool& succeed) {
+	m_pendingFileWriteBytes -= dataSize;
+	const auto&& itForFile = m_receivedFilePackagePool.find(randomFlag);
+	if (itForFile != m_receivedFilePackagePool.end()) {
+		itForFile->pendingWriteBytes -= dataSize;
+		if (!succeed) {
+			qDebug() << "Connect::onReceivedFileDataWritten: File write error, filePath:" <<
+				itForFile->firstPackage->localFilePath();
+			this->abortReceivedFile(randomFlag, !m_connectSettings->fileTransferResumeEnabled);
+			this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+		} else if (!itForFile->pendingWriteBytes && (itForFile->receivedOffset >= itForFile->endOffset)) {
+			this->finishReceivedFile(randomFlag);
+		}
+	}
+	if (m_isAbandonTcpSocket || (m_pendingFileWriteBytes > m_connectSettings->maximumPendingFileWriteBytes)) {
+		return;
+	}
+	for (auto it = m_receivedFilePackagePool.begin(); it != m_receivedFilePackagePool.end(); ++it) {
+		if (!it->dataRequestDeferred) {
+			continue;
+		}
+		it->dataRequestDeferred = false;
+		this->requestNextFileData(it.key(), *it);
+	}
+}
+
+void Connect::requestNextFileData(const qint32& randomFlag, ReceivedFile& receivedFile) {
+	if (receivedFile.resumeOffset > 0) {
+		this->sendPackageToRemote(Package::createFileDataRequestPackage(
+			randomFlag,
+			receivedFile.resumeOffset,
+			receivedFile.resumeChecksum
+		));
+		receivedFile.resumeOffset = -1;
+		receivedFile.resumeChecksum.clear();
+		return;
+	}
+	this->sendDataRequestToRemote(receivedFile.firstPackage);
+}
+
+bool Connect::finishReceivedFile(const qint32& randomFlag) {
+	const auto&& receivedFile = m_receivedFilePackagePool.take(randomFlag);
+	receivedFile.file->close();
+	if (receivedFile.fileDeltaBlockSize > 0) {
+		// The old copy was read until the last instruction, only now the rebuilt file can take its place
+		const auto&& localFilePath = receivedFile.firstPackage->localFilePath();
+		if (receivedFile.fileDeltaBaseFile) {
+			receivedFile.fileDeltaBaseFile->close();
+		}
+		// Checked before the old copy is replaced, a mismatch still has the whole file to fall back on
+		if (!receivedFile.fileDeltaHash || (receivedFile.fileDeltaHash->result().toHex() != receivedFile.fileHash)) {
+			qDebug() << "Connect::finishReceivedFile: File delta hash mismatch, filePath:" << localFilePath;
+			this->restartFileDelta(randomFlag, receivedFile);
+			return false;
+		}
+		if ((QFile::exists(localFilePath) && !QFile::remove(localFilePath)) ||
+			!receivedFile.file->rename(localFilePath)) {
+			qDebug() << "Connect::finishReceivedFile: Replace file error, filePath:" << localFilePath;
+			QFile::remove(receivedFile.file->fileName());
+			this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+			return false;
+		}
+		this->sendPackageToRemote(Package::createFileDeltaResultPackage(randomFlag, true));
+	}
+	if (receivedFile.stripeId.isEmpty()) {
+		this->completeReceivedFile(receivedFile.firstPackage, receivedFile.callbackOnFinish);
+		return true;
+	}
+	m_mutexForStripedReceivedFiles.lock();
+	const auto&& itForStripedFile = m_stripedReceivedFiles.find(receivedFile.stripeId);
+	if (itForStripedFile == m_stripedReceivedFiles.end()) {
+		m_mutexForStripedReceivedFiles.unlock();
+		qDebug() << "Connect::finishReceivedFile: no contains stripeId:" << receivedFile.stripeId;
+		return false;
+	}
+	if (++itForStripedFile->finishedStripeCount < itForStripedFile->stripeCount) {
+		m_mutexForStripedReceivedFiles.unlock();
+		return false;
+	}
+	const auto&& stripedFile = m_stripedReceivedFiles.take(receivedFile.stripeId);
+	m_mutexForStripedReceivedFiles.unlock();
+	// The sender waits for a reply on the connect of stripe 0, so the whole file is reported there
+	NETWORK_NULLPTR_CHECK(stripedFile.runOnFirstStripeConnectThreadCallback, false);
+	stripedFile.runOnFirstStripeConnectThreadCallback(
+		[
+			firstStripeConnect = stripedFile.firstStripeConnect,
+			firstStripePackage = stripedFile.firstStripePackage,
+			callbackOnFinish = stripedFile.callbackOnFinish
+		]() {
+			if (!firstStripeConnect) {
+				return;
+			}
+			firstStripeConnect->completeReceivedFile(firstStripePackage, callbackOnFinish);
+		}
+	);
+	return true;
+}
+
+void Connect::restartFileDelta(const qint32& randomFlag, const ReceivedFile& deltaFile) {
+	QFile::remove(deltaFile.file->fileName());
+	const auto&& localFilePath = deltaFile.firstPackage->localFilePath();
+	QSharedPointer<QFile> file(new QFile(localFilePath));
+	if (!file->open(QIODevice::WriteOnly) || !preallocateFile(file.data(), deltaFile.firstPackage->fileSize())) {
+		qDebug() << "Connect::restartFileDelta: Open file error, filePath:" << localFilePath;
+		this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+		return;
+	}
+	// A plain received file from here on, the sender starts again at offset 0
+	auto& receivedFile = m_receivedFilePackagePool[randomFlag];
+	receivedFile.firstPackage = deltaFile.firstPackage;
+	receivedFile.file = file;
+	receivedFile.callbackOnFinish = deltaFile.callbackOnFinish;
+	receivedFile.endOffset = deltaFile.endOffset;
+	receivedFile.writeThreadIndex = deltaFile.writeThreadIndex;
+	this->sendPackageToRemote(Package::createFileDeltaResultPackage(randomFlag, false));
+}
+
+void Connect::abortReceivedFile(const qint32& randomFlag, const bool& removeFile) {
+	const auto&& itForFile = m_receivedFilePackagePool.find(randomFlag);
+	if (itForFile == m_receivedFilePackagePool.end()) {
+		return;
+	}
+	const auto receivedFile = *itForFile;
+	m_receivedFilePackagePool.erase(itForFile);
+	*receivedFile.writeAborted = true;
+	StripedReceivedFile stripedFile;
+	if (!receivedFile.stripeId.isEmpty()) {
+		m_mutexForStripedReceivedFiles.lock();
+		stripedFile = m_stripedReceivedFiles.take(receivedFile.stripeId);
+		m_mutexForStripedReceivedFiles.unlock();
+	}
+	// A rebuilt delta or a stripe is of no use on its own, a plain file may be kept for resume
+	const auto&& filePath = receivedFile.file->fileName();
+	const auto&& removeReceivedFile = removeFile || (receivedFile.fileDeltaBlockSize > 0) || !receivedFile.stripeId.isEmpty();
+	const auto&& closeFile = [file = receivedFile.file, baseFile = receivedFile.fileDeltaBaseFile, filePath, removeReceivedFile]() {
+		file->close();
+		if (baseFile) {
+			baseFile->close();
+		}
+		if (removeReceivedFile) {
+			QFile::remove(filePath);
+			QFile::remove(filePath + ".resume");
+		}
+	};
+	if (m_fileWriteThreadPool && (receivedFile.writeThreadIndex != -1)) {
+		// Behind the writes already queued for the file, they see writeAborted and skip
+		m_fileWriteThreadPool->run(closeFile, receivedFile.writeThreadIndex);
+	} else {
+		closeFile();
+	}
+	if (!stripedFile.firstStripePackage || (stripedFile.firstStripeConnect == this)) {
+		return;
+	}
+	// The other stripes finish into a file no one reports, only the sender of stripe 0 waits for a reply
+	NETWORK_NULLPTR_CHECK(stripedFile.runOnFirstStripeConnectThreadCallback);
+	stripedFile.runOnFirstStripeConnectThreadCallback(
+		[
+			firstStripeConnect = stripedFile.firstStripeConnect,
+			firstRandomFlag = stripedFile.firstStripePackage->randomFlag()
+		]() {
+			if (!firstStripeConnect) {
+				return;
+			}
+			firstStripeConnect->abortReceivedFile(firstRandomFlag, true);
+			firstStripeConnect->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, firstRandomFlag);
+		}
+	);
+}
+
+void Connect::abortReceivedChunkedData(const qint32& randomFlag) {
+	const auto&& receivedChunkedData = m_receivedChunkedDataPool.take(randomFlag);
+	if (!receivedChunkedData.file) {
+		return;
+	}
+	receivedChunkedData.file->close();
+	receivedChunkedData.file->remove();
+}
+
+void Connect::sendTransferAbortToRemote(const qint8& packageFlag, const qint32& randomFlag) {
+	if (m_isAbandonTcpSocket) {
+		return;
+	}
+	this->sendPackageToRemote(Package::createTransferAbortPackage(packageFlag, randomFlag));
+}
+
+void Connect::onTransferAborted(const qint32& randomFlag) {
+	if ((randomFlag < m_connectSettings->randomFlagRangeStart) || (randomFlag >= m_connectSettings->randomFlagRangeEnd)) {
+		// A transfer this side receives
+		this->abortReceivedFile(randomFlag, !m_connectSettings->fileTransferResumeEnabled);
+		m_receivePayloadPackagePool.remove(randomFlag);
+		this->abortReceivedChunkedData(randomFlag);
+		return;
+	}
+	m_waitForSendFiles.remove(randomFlag);
+	m_sendPayloadPackagePool.remove(randomFlag);
+	m_waitForSendChunkedDataPool.remove(randomFlag);
+	const auto&& itForCallback = m_onReceivedCallbacks.find(randomFlag);
+	if (itForCallback == m_onReceivedCallbacks.end()) {
+		return;
+	}
+	const auto failCallback = itForCallback->failCallback;
+	m_onReceivedCallbacks.erase(itForCallback);
+	if (failCallback) {
+		NETWORK_NULLPTR_CHECK(m_connectSettings->waitReplyPackageFailCallback);
+		m_connectSettings->waitReplyPackageFailCallback(this, failCallback);
+	}
+}
+
+void Connect::completeReceivedFile(const QSharedPointer<Package>& firstPackage, const bool& callbackOnFinish) {
+	const auto&& filePermissions = firstPackage->filePermissions();
+	QFile::setPermissions(firstPackage->localFilePath(), QFile::Permissions(filePermissions));
+	if (m_connectSettings->fileTransferResumeEnabled) {
+		QFile::remove(firstPackage->localFilePath() + ".resume");
+	}
+#if ( defined Q_OS_MAC ) || ( defined __MINGW32__ ) || ( defined Q_OS_LINUX )
+	utimbuf timeBuf = { static_cast<time_t>(firstPackage->fileLastReadTime().toTime_t()), static_cast<time_t>(firstPackage->fileLastModifiedTime().toTime_t()) };
+	utime(firstPackage->localFilePath().toLatin1().data(), &timeBuf);
+#endif
+	if (callbackOnFinish) {
+		this->traceReassemblyComplete(firstPackage->randomFlag());
+		NETWORK_NULLPTR_CHECK(m_connectSettings->packageReceivedCallback);
+		m_connectSettings->packageReceivedCallback(this, firstPackage);
+	}
+}
+
+bool Connect::openFileDelta(const QSharedPointer<Package>& package, const bool& callbackOnFinish) {
+	const auto&& localFilePath = package->localFilePath();
+	QSharedPointer<QFile> baseFile(new QFile(localFilePath));
+	if (!baseFile->open(QIODevice::ReadOnly)) {
+		// Nothing to compare against, the signatures stay empty and the sender sends every byte as literal
+		baseFile.clear();
+	}
+	// Around sqrt(size) like rsync, big files get fewer signatures while a small edit still costs little
+	const auto&& baseFileSize = (baseFile) ? (baseFile->size()) : (qint64(0));
+	const auto&& blockSize = qBound(
+		NETWORKPACKAGE_FILEDELTAMINIMUMBLOCKSIZE,
+		static_cast<qint64>(std::sqrt(static_cast<double>(baseFileSize))) & ~qint64(1023),
+		NETWORKPACKAGE_FILEDELTAMAXIMUMBLOCKSIZE
+	);
+	QSharedPointer<QFile> file(new QFile(localFilePath + ".delta"));
+	if (!file->open(QIODevice::WriteOnly) || !preallocateFile(file.data(), package->fileSize())) {
+		qDebug() << "Connect::openFileDelta: Open file error, filePath:" << file->fileName();
+		return false;
+	}
+	const auto&& randomFlag = package->randomFlag();
+	auto& receivedFile = m_receivedFilePackagePool[randomFlag];
+	receivedFile.firstPackage = package;
+	receivedFile.file = file;
+	receivedFile.callbackOnFinish = callbackOnFinish;
+	receivedFile.endOffset = package->fileSize();
+	receivedFile.fileDeltaBaseFile = baseFile;
+	receivedFile.fileDeltaBlockSize = blockSize;
+	receivedFile.fileDeltaHash = QSharedPointer<QCryptographicHash>::create(QCryptographicHash::Sha256);
+	if (!m_fileWriteThreadPool) {
+		this->sendPackageToRemote(Package::createFileDataRequestPackage(
+			randomFlag,
+			-1,
+			QByteArray(),
+			blockSize,
+			computeFileDeltaSignatures(baseFile.data(), blockSize)
+		));
+		return false;
+	}
+	// Reading the whole old copy takes a while, keep it off the socket thread
+	receivedFile.writeThreadIndex = m_fileWriteThreadPool->run(
+		[
+			thisPointer = QPointer<Connect>(this),
+			runOnConnectThreadCallback = m_runOnConnectThreadCallback,
+			baseFile,
+			blockSize,
+			randomFlag
+		]() {
+			const auto&& signatures = computeFileDeltaSignatures(baseFile.data(), blockSize);
+			runOnConnectThreadCallback([thisPointer, randomFlag, blockSize, signatures]() {
+				if (!thisPointer) {
+					return;
+				}
+				thisPointer->sendPackageToRemote(Package::createFileDataRequestPackage(
+					randomFlag,
+					-1,
+					QByteArray(),
+					blockSize,
+					signatures
+				));
+				});
+		},
+		receivedFile.writeThreadIndex
+			);
+	return false;
+}
+
+bool Connect::writeReceivedFileDelta(const qint32& randomFlag, ReceivedFile& receivedFile, const QByteArray& deltaData) {
+	if (!m_fileWriteThreadPool) {
+		if (!applyFileDelta(receivedFile, deltaData)) {
+			qDebug() << "Connect::writeReceivedFileDelta: Apply delta error, filePath:" <<
+				receivedFile.firstPackage->localFilePath();
+			this->abortReceivedFile(randomFlag, true);
+			this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+			return false;
+		}
+		if (receivedFile.receivedOffset >= receivedFile.endOffset) {
+			return this->finishReceivedFile(randomFlag);
+		}
+		this->requestNextFileData(randomFlag, receivedFile);
+		return false;
+	}
+	// The writer applies the instructions later, the offset has to move on now for the last-chunk check
+	const auto&& outputSize = fileDeltaOutputSize(deltaData, receivedFile.fileDeltaBlockSize);
+	if ((outputSize < 0) || ((receivedFile.receivedOffset + outputSize) > receivedFile.endOffset)) {
+		qDebug() << "Connect::writeReceivedFileDelta: Apply delta error, filePath:" <<
+			receivedFile.firstPackage->localFilePath();
+		this->abortReceivedFile(randomFlag, true);
+		this->sendTransferAbortToRemote(NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG, randomFlag);
+		return false;
+	}
+	auto writerFile = receivedFile; // the writer only touches the shared files and its own offset
+	receivedFile.receivedOffset += outputSize;
+	const auto&& isLastData = receivedFile.receivedOffset >= receivedFile.endOffset;
+	// Counted by the delta size, that is what sits in memory until the writer gets to it
+	receivedFile.pendingWriteBytes += deltaData.size();
+	m_pendingFileWriteBytes += deltaData.size();
+	receivedFile.writeThreadIndex = m_fileWriteThreadPool->run(
+		[
+			thisPointer = QPointer<Connect>(this),
+			runOnConnectThreadCallback = m_runOnConnectThreadCallback,
+			writerFile,
+			randomFlag,
+			deltaData,
+			outputSize
+		]() mutable {
+			const auto&& startOffset = writerFile.receivedOffset;
+			const auto&& succeed = !*writerFile.writeAborted && applyFileDelta(writerFile, deltaData) &&
+				((writerFile.receivedOffset - startOffset) == outputSize);
+			const auto&& dataSize = static_cast<qint64>(deltaData.size());
+			runOnConnectThreadCallback([thisPointer, randomFlag, dataSize, succeed]() {
+				if (!thisPointer) {
+					return;
+				}
+				thisPointer->onReceivedFileDataWritten(randomFlag, dataSize, succeed);
+				});
+		},
+		receivedFile.writeThreadIndex // same thread as the signatures, it reads the old copy too
+			);
+	if (isLastData) {
+		// Finished from onReceivedFileDataWritten once everything is on disk
+		return false;
+	}
+	if (m_pendingFileWriteBytes > m_connectSettings->maximumPendingFileWriteBytes) {
+		receivedFile.dataRequestDeferred = true;
+		return false;
+	}
+	this->requestNextFileData(randomFlag, receivedFile);
+	return false;
+}
+
+void Connect::sendNextFileDelta(const qint32& randomFlag, WaitForSendFile& waitForSendFile) {
+	const auto& file = waitForSendFile.file;
+	const auto&& startOffset = file->pos();
+	const auto&& deltaData = generateFileDelta(
+		file.data(),
+		waitForSendFile.endOffset,
+		*waitForSendFile.fileDeltaSignatures,
+		this->cutPackageSizeForPriority(waitForSendFile.priority)
+	);
+	auto deltaPackage = Package::createFileTransportPackage(
+		{}, // empty targetActionFlag,
+		{}, // empty fileInfo
+		deltaData,
+		{}, // empty appendData
+		randomFlag,
+		this->needCompressionPayloadData(deltaData.size())
+	);
+	// The covered range is read again for the hash, the delta itself only holds what the receiver lacks
+	if (!waitForSendFile.fileDeltaHash) {
+		waitForSendFile.fileDeltaHash = QSharedPointer<QCryptographicHash>::create(QCryptographicHash::Sha256);
+	}
+	const auto endOffset = file->pos();
+	file->seek(startOffset);
+	while (file->pos() < endOffset) {
+		const auto&& fileData = file->read(qMin(endOffset - file->pos(), NETWORKPACKAGE_FILEDELTAMAXIMUMBLOCKSIZE * 8));
+		if (fileData.isEmpty()) {
+			break;
+		}
+		waitForSendFile.fileDeltaHash->addData(fileData);
+	}
+	file->seek(endOffset);
+	if (endOffset >= waitForSendFile.endOffset) {
+		deltaPackage->setFileHash(waitForSendFile.fileDeltaHash->result().toHex());
+	}
+	deltaPackage->setSendPriority(waitForSendFile.priority);
+	this->sendPackageToRemote(deltaPackage);
+	NETWORK_NULLPTR_CHECK(m_connectSettings->packageSendingCallback);
+	m_connectSettings->packageSendingCallback(
+		this,
+		randomFlag,
+		startOffset,
+		file->pos() - startOffset,
+		file->size()
+	);
+}
+
+QByteArray Connect::computeFileDeltaSignatures(QFile* file, const qint64& blockSize) {
+	QByteArray signatures;
+	if (!file || !file->seek(0)) {
+		return signatures;
+	}
+	// Only whole blocks are signed, the tail of the old copy is never reused
+	const auto&& blockCount = file->size() / blockSize;
+	signatures.reserve(static_cast<int>(blockCount * (sizeof(quint32) + sizeof(quint64))));
+	for (qint64 index = 0; index < blockCount; ++index) {
+		const auto&& blockData = file->read(blockSize);
+		if (blockData.size() != blockSize) {
+			break;
+		}
+		quint32 sumA;
+		quint32 sumB;
+		fileDeltaWeakSums(reinterpret_cast<const uchar*>(blockData.constData()), blockSize, sumA, sumB);
+		const auto&& weakChecksum = fileDeltaWeakChecksum(sumA, sumB);
+		const auto&& strongChecksum = fileDeltaStrongChecksum(blockData.constData(), blockSize);
+		signatures.append(reinterpret_cast<const char*>(&weakChecksum), sizeof(weakChecksum));
+		signatures.append(reinterpret_cast<const char*>(&strongChecksum), sizeof(strongChecksum));
+	}
+	return signatures;
+}
+
+QSharedPointer<Connect::FileDeltaSignatures> Connect::readFileDeltaSignatures(
+	const qint64& blockSize,
+	const QByteArray& signatures
+) {
+	QSharedPointer<FileDeltaSignatures> fileDeltaSignatures(new FileDeltaSignatures);
+	fileDeltaSignatures->blockSize = blockSize;
+	fileDeltaSignatures->weakChecksumFilter.resize(0x10000);
+	if (blockSize <= 0) {
+		return fileDeltaSignatures;
+	}
+	const auto&& signatureSize = static_cast<int>(sizeof(quint32) + sizeof(quint64));
+	const auto&& blockCount = signatures.size() / signatureSize;
+	fileDeltaSignatures->strongChecksums.resize(blockCount);
+	fileDeltaSignatures->blockIndexes.reserve(blockCount);
+	const auto* data = signatures.constData();
+	for (auto index = 0; index < blockCount; ++index) {
+		quint32 weakChecksum;
+		quint64 strongChecksum;
+		std::memcpy(&weakChecksum, data, sizeof(weakChecksum));
+		std::memcpy(&strongChecksum, data + sizeof(weakChecksum), sizeof(strongChecksum));
+		data += signatureSize;
+		fileDeltaSignatures->strongChecksums[index] = strongChecksum;
+		fileDeltaSignatures->blockIndexes.insert(weakChecksum, index);
+		fileDeltaSignatures->weakChecksumFilter.setBit(fileDeltaWeakChecksumFilterIndex(weakChecksum));
+	}
+	return fileDeltaSignatures;
+}
+
+QByteArray Connect::generateFileDelta(
+	QFile* file,
+	const qint64& endOffset,
+	const FileDeltaSignatures& fileDeltaSignatures,
+	const qint64& maximumSize
+) {
+	/*
+	 * Instructions, native byte order like Package::Head:
+	 * NETWORKPACKAGE_FILEDELTACOPYFLAG, qint32 blockIndex, qint32 blockCount
+	 * NETWORKPACKAGE_FILEDELTALITERALFLAG, qint32 size, data
+	 */
+	QByteArray deltaData;
+	auto lastCopyPosition = -1; // a copy right after another one only grows its blockCount
+	qint32 lastCopyEndBlockIndex = -1;
+	const auto appendLiteral = [&deltaData, &lastCopyPosition](const char* data, const qint32& size) {
+		if (size <= 0) {
+			return;
+		}
+		deltaData.append(static_cast<char>(NETWORKPACKAGE_FILEDELTALITERALFLAG));
+		deltaData.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		deltaData.append(data, size);
+		lastCopyPosition = -1;
+	};
+	const auto appendCopy = [&deltaData, &lastCopyPosition, &lastCopyEndBlockIndex](const qint32& blockIndex) {
+		if ((lastCopyPosition != -1) && (blockIndex == lastCopyEndBlockIndex)) {
+			qint32 blockCount;
+			std::memcpy(&blockCount, deltaData.constData() + lastCopyPosition + 1 + sizeof(qint32), sizeof(blockCount));
+			++blockCount;
+			std::memcpy(deltaData.data() + lastCopyPosition + 1 + sizeof(qint32), &blockCount, sizeof(blockCount));
+		} else {
+			const qint32 blockCount = 1;
+			lastCopyPosition = deltaData.size();
+			deltaData.append(static_cast<char>(NETWORKPACKAGE_FILEDELTACOPYFLAG));
+			deltaData.append(reinterpret_cast<const char*>(&blockIndex), sizeof(blockIndex));
+			deltaData.append(reinterpret_cast<const char*>(&blockCount), sizeof(blockCount));
+		}
+		lastCopyEndBlockIndex = blockIndex + 1;
+	};
+	const auto&& startOffset = file->pos();
+	const auto&& blockSize = fileDeltaSignatures.blockSize;
+	if ((blockSize <= 0) || fileDeltaSignatures.strongChecksums.isEmpty()) {
+		const auto&& data = file->read(qMin(maximumSize, endOffset - startOffset));
+		appendLiteral(data.constData(), static_cast<qint32>(data.size()));
+		return deltaData;
+	}
+	// One block more than a package, so a block starting near the end of the package can still match
+	const auto&& data = file->read(qMin(maximumSize + blockSize, endOffset - startOffset));
+	const auto&& reachedEnd = (startOffset + data.size()) >= endOffset;
+	const auto* bytes = reinterpret_cast<const uchar*>(data.constData());
+	const auto&& dataSize = static_cast<qint64>(data.size());
+	qint64 literalStart = 0;
+	qint64 index = 0;
+	quint32 sumA = 0;
+	quint32 sumB = 0;
+	auto rolling = false;
+	while ((index < dataSize) && ((deltaData.size() + (index - literalStart)) < maximumSize)) {
+		if ((dataSize - index) < blockSize) {
+			if (!reachedEnd) {
+				// Continue with the next package, which reads this tail again together with what follows
+				break;
+			}
+			index = dataSize;
+			break;
+		}
+		if (!rolling) {
+			fileDeltaWeakSums(bytes + index, blockSize, sumA, sumB);
+			rolling = true;
+		}
+		const auto&& weakChecksum = fileDeltaWeakChecksum(sumA, sumB);
+		auto matchedBlockIndex = -1;
+		if (fileDeltaSignatures.weakChecksumFilter.testBit(fileDeltaWeakChecksumFilterIndex(weakChecksum))) {
+			const auto&& strongChecksum = fileDeltaStrongChecksum(data.constData() + index, blockSize);
+			for (auto it = fileDeltaSignatures.blockIndexes.constFind(weakChecksum);
+				(it != fileDeltaSignatures.blockIndexes.constEnd()) && (it.key() == weakChecksum); ++it) {
+				if (fileDeltaSignatures.strongChecksums[it.value()] == strongChecksum) {
+					matchedBlockIndex = it.value();
+					break;
+				}
+			}
+		}
+		if (matchedBlockIndex != -1) {
+			appendLiteral(data.constData() + literalStart, static_cast<qint32>(index - literalStart));
+			appendCopy(matchedBlockIndex);
+			index += blockSize;
+			literalStart = index;
+			rolling = false;
+			continue;
+		}
+		if ((index + blockSize) < dataSize) {
+			const quint32 outByte = bytes[index];
+			const quint32 inByte = bytes[index + blockSize];
+			sumA += inByte - outByte;
+			sumB += sumA - static_cast<quint32>(blockSize) * outByte;
+		} else {
+			rolling = false;
+		}
+		++index;
+	}
+	appendLiteral(data.constData() + literalStart, static_cast<qint32>(index - literalStart));
+	file->seek(startOffset + index);
+	return deltaData;
+}
+
+qint64 Connect::fileDeltaOutputSize(const QByteArray& deltaData, const qint64& blockSize) {
+	// Copy instructions only ever name whole blocks, so the size follows from the instructions alone
+	const auto* data = deltaData.constData();
+	const auto* dataEnd = data + deltaData.size();
+	qint64 outputSize = 0;
+	while (data < dataEnd) {
+		const auto operationFlag = *data;
+		++data;
+		qint32 value;
+		if ((dataEnd - data) < static_cast<qint64>(sizeof(value))) {
+			return -1;
+		}
+		std::memcpy(&value, data, sizeof(value));
+		data += sizeof(value);
+		if (value < 0) {
+			return -1;
+		}
+		if (operationFlag == NETWORKPACKAGE_FILEDELTACOPYFLAG) {
+			qint32 blockCount;
+			if ((dataEnd - data) < static_cast<qint64>(sizeof(blockCount))) {
+				return -1;
+			}
+			std::memcpy(&blockCount, data, sizeof(blockCount));
+			data += sizeof(blockCount);
+			if (blockCount <= 0) {
+				return -1;
+			}
+			outputSize += blockCount * blockSize;
+		} else if (operationFlag == NETWORKPACKAGE_FILEDELTALITERALFLAG) {
+			if ((dataEnd - data) < value) {
+				return -1;
+			}
+			data += value;
+			outputSize += value;
+		} else {
+			return -1;
+		}
+	}
+	return outputSize;
+}
+
+bool Connect::applyFileDelta(ReceivedFile& receivedFile, const QByteArray& deltaData) {
+	const auto* data = deltaData.constData();
+	const auto* dataEnd = data + deltaData.size();
+	const auto& baseFile = receivedFile.fileDeltaBaseFile;
+	const auto&& blockSize = receivedFile.fileDeltaBlockSize;
+	while (data < dataEnd) {
+		const auto operationFlag = *data;
+		++data;
+		qint32 value;
+		if ((dataEnd - data) < static_cast<qint64>(sizeof(value))) {
+			return false;
+		}
+		std::memcpy(&value, data, sizeof(value));
+		data += sizeof(value);
+		switch (operationFlag) {
+			case NETWORKPACKAGE_FILEDELTACOPYFLAG:
+			{
+				qint32 blockCount;
+				if (!baseFile || ((dataEnd - data) < static_cast<qint64>(sizeof(blockCount)))) {
+					return false;
+				}
+				std::memcpy(&blockCount, data, sizeof(blockCount));
+				data += sizeof(blockCount);
+				if ((value < 0) || (blockCount <= 0) || !baseFile->seek(value * blockSize)) {
+					return false;
+				}
+				// Read the run in pieces, a long run of unchanged blocks must not land in memory at once
+				auto copySize = blockCount * blockSize;
+				while (copySize > 0) {
+					const auto&& copyData = baseFile->read(qMin(copySize, NETWORKPACKAGE_FILEDELTAMAXIMUMBLOCKSIZE * 8));
+					if (copyData.isEmpty() ||
+						((receivedFile.receivedOffset + copyData.size()) > receivedFile.endOffset) ||
+						!writeFileData(receivedFile.file.data(), receivedFile.receivedOffset, copyData, false)) {
+						return false;
+					}
+					if (receivedFile.fileDeltaHash) {
+						receivedFile.fileDeltaHash->addData(copyData);
+					}
+					receivedFile.receivedOffset += copyData.size();
+					copySize -= copyData.size();
+				}
+				break;
+			}
+			case NETWORKPACKAGE_FILEDELTALITERALFLAG:
+			{
+				if ((value < 0) || ((dataEnd - data) < value) ||
+					((receivedFile.receivedOffset + value) > receivedFile.endOffset) ||
+					!writeFileData(receivedFile.file.data(), receivedFile.receivedOffset,
+						QByteArray::fromRawData(data, value), false)) {
+					return false;
+				}
+				if (receivedFile.fileDeltaHash) {
+					receivedFile.fileDeltaHash->addData(data, value);
+				}
+				data += value;
+				receivedFile.receivedOffset += value;
+				break;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Connect::openFileStripe(const QSharedPointer<Package>& package, const bool& callbackOnFinish, QFile* file) {
+	const auto&& fileStripe = package->fileStripe();
+	const auto&& stripeId = fileStripe["id"].toString();
+	if (stripeId.isEmpty() || (fileStripe["count"].toInt() < 1)) {
+		return false;
+	}
+	m_mutexForStripedReceivedFiles.lock();
+	auto itForStripedFile = m_stripedReceivedFiles.find(stripeId);
+	if (itForStripedFile == m_stripedReceivedFiles.end()) {
+		// First stripe to arrive creates the file, the others open it without truncating
+		if (!file->open(QIODevice::WriteOnly) || !preallocateFile(file, package->fileSize())) {
+			m_mutexForStripedReceivedFiles.unlock();
+			return false;
+		}
+		itForStripedFile = m_stripedReceivedFiles.insert(stripeId, StripedReceivedFile());
+		itForStripedFile->stripeCount = fileStripe["count"].toInt();
+	} else if (!file->open(QIODevice::ReadWrite)) {
+		m_mutexForStripedReceivedFiles.unlock();
+		return false;
+	}
+	if (!fileStripe["index"].toInt()) {
+		itForStripedFile->firstStripeConnect = this;
+		itForStripedFile->runOnFirstStripeConnectThreadCallback = m_runOnConnectThreadCallback;
+		itForStripedFile->firstStripePackage = package;
+		itForStripedFile->callbackOnFinish = callbackOnFinish;
+	}
+	m_mutexForStripedReceivedFiles.unlock();
+	return true;
+}
+
+qint64 Connect::fileResumeOffset(const QSharedPointer<Package>& package, const QString& localFilePath) {
+	if (!m_connectSettings->fileTransferResumeEnabled || package->fileTransferId().isEmpty()) {
+		return -1;
+	}
+	QFile sidecar(localFilePath + ".resume");
+	if (!sidecar.open(QIODevice::ReadOnly)) {
+		return -1;
+	}
+	const auto&& resumeData = QJsonDocument::fromJson(sidecar.readAll()).object().toVariantMap();
+	if ((resumeData["fileTransferId"].toString() != package->fileTransferId()) ||
+		(resumeData["fileSize"].toLongLong() != package->fileSize()) ||
+		(QFileInfo(localFilePath).size() != package->fileSize())) {
+		return -1;
+	}
+	const auto&& receivedOffset = resumeData["receivedOffset"].toLongLong();
+	// Only worth a resume when it skips more than the first chunk, which is always sent
+	if ((receivedOffset <= package->payloadData().size()) || (receivedOffset >= package->fileSize())) {
+		return -1;
+	}
+	return receivedOffset;
+}
+
+void Connect::saveFileResumeSidecar(const QSharedPointer<Package>& firstPackage, QFile* file) {
+	if (firstPackage->fileTransferId().isEmpty()) {
+		return;
+	}
+	// The sidecar must never claim bytes that are not on disk yet
+	file->flush();
+	QVariantMap resumeData;
+	resumeData["fileTransferId"] = firstPackage->fileTransferId();
+	resumeData["fileSize"] = firstPackage->fileSize();
+	resumeData["receivedOffset"] = file->pos();
+	QFile sidecar(firstPackage->localFilePath() + ".resume");
+	if (!sidecar.open(QIODevice::WriteOnly)) {
+		qDebug() << "Connect::saveFileResumeSidecar: open error, filePath:" << sidecar.fileName();
+		return;
+	}
+	sidecar.write(QJsonDocument(QJsonObject::fromVariantMap(resumeData)).toJson(QJsonDocument::Compact));
+}
+
+QByteArray Connect::fileResumeChecksum(QFile* file, const qint64& offset) {
+	const auto&& originalPos = file->pos();
+	const auto&& checkSize = qMin(offset, NETWORKPACKAGE_FILERESUMECHECKSIZE);
+	file->seek(offset - checkSize);
+	const auto&& checksum = QCryptographicHash::hash(file->read(checkSize), QCryptographicHash::Md5).toHex();
+	file->seek(originalPos);
+	return checksum;
+}
+
+bool Connect::preallocateFile(QFile* file, const qint64& fileSize) {
+#ifdef Q_OS_LINUX
+	// Reserve the blocks up front, keeps the file contiguous and a full disk fails here instead of mid transfer
+	if ((fileSize > 0) && (file->size() < fileSize) && !::fallocate(file->handle(), 0, 0, fileSize)) {
+		return true;
+	}
+#endif
+	return file->resize(fileSize);
+}
+
+bool Connect::writeFileData(QFile* file, const qint64& offset, const QByteArray& fileData, const bool& syncRange) {
+	if ((file->pos() != offset) && !file->seek(offset)) {
+		return false;
+	}
+	if (file->write(fileData) != fileData.size()) {
+		return false;
+	}
+#ifdef Q_OS_LINUX
+	if (syncRange && file->flush()) {
+		// Only starts the writeback, keeps dirty pages of a large receive from piling up
+		::sync_file_range(file->handle(), offset, fileData.size(), SYNC_FILE_RANGE_WRITE);
+	}
+#else
+	Q_UNUSED(syncRange);
+#endif
+	return true;
+}
+
+void Connect::onReadyToDelete() {
+	if (m_isAbandonTcpSocket) {
+		return;
+	}
+	m_isAbandonTcpSocket = true;
+	if (!m_timerForConnectToHostTimeOut) {
+		m_timerForConnectToHostTimeOut.clear();
+	}
+	if (m_timerForWriteCoalescing) {
+		m_timerForWriteCoalescing.clear();
+	}
+	for (auto& queue : m_sendSchedulerQueues) {
+		queue.clear();
+	}
+	m_sendSchedulerQueuedCount = 0;
+	if (!m_onReceivedCallbacks.isEmpty()) {
+		for (const auto& callback : m_onReceivedCallbacks) {
+			if (!callback.failCallback) {
+				continue;
+			}
+			callback.failCallback(this);
+		}
+	}
+	for (const auto& waitForSendFileBundle : m_waitForSendFileBundles) {
+		if (waitForSendFileBundle.failCallback) {
+			waitForSendFileBundle.failCallback(this);
+		}
+	}
+	m_waitForSendFileBundles.clear();
+	// A striped file also loses its shared entry, so it is not left waiting for a stripe that never comes
+	for (const auto& randomFlag : m_receivedFilePackagePool.keys()) {
+		this->abortReceivedFile(randomFlag, !m_connectSettings->fileTransferResumeEnabled);
+	}
+	NETWORK_NULLPTR_CHECK(m_tcpSocket);
+	this->flushWriteCoalescingBuffer();
+	m_tcpSocket->close();
+	NETWORK_NULLPTR_CHECK(m_connectSettings->readyToDeleteCallback);
+	m_connectSettings->readyToDeleteCallback(this);
+}
+
+qint32 Connect::nextRandomFlag() {
+	m_mutexForSend.lock();
+	if (m_sendRandomFlagRotaryIndex >= m_connectSettings->randomFlagRangeEnd) {
+		m_sendRandomFlagRotaryIndex = m_connectSettings->randomFlagRangeStart;
+	} else {
+		++m_sendRandomFlagRotaryIndex;
+	}
+	const auto currentRandomFlag = m_sendRandomFlagRotaryIndex;
+	m_mutexForSend.unlock();
+	return currentRandomFlag;
+}
+
+bool Connect::readySendPayloadData(
+	const qint32& randomFlag,
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	auto packages = Package::createPayloadTransportPackages(
+		targetActionFlag,
+		payloadData,
+		appendData,
+		randomFlag,
+		this->cutPackageSizeForPriority(priority),
+		this->needCompressionPayloadData(payloadData.size())
+	);
+	if (packages.isEmpty()) {
+		qDebug() << "Connect::readySendPayloadData: createPackagesFromPayloadData error";
+		return false;
+	}
+	for (const auto& package : packages) {
+		package->setSendPriority(priority);
+	}
+	this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
+	return true;
+}
+
+bool Connect::readySendFileData(
+	const qint32& randomFlag,
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority,
+	const QVariantMap& fileStripe,
+	const QVariantMap& fileBundle
+) {
+	if (m_waitForSendFiles.contains(randomFlag)) {
+		qDebug() << "Connect::readySendFileData: file is sending, filePath:" << fileInfo.filePath();
+		return false;
+	}
+	if (!fileInfo.exists()) {
+		qDebug() << "Connect::readySendFileData: file not exists, filePath:" << fileInfo.filePath();
+		return false;
+	}
+	QSharedPointer<QFile> file(new QFile(fileInfo.filePath()));
+	if (!file->open(QIODevice::ReadOnly)) {
+		qDebug() << "Connect::readySendFileData: file open error, filePath:" << fileInfo.filePath();
+		return false;
+	}
+	const auto&& startOffset = (fileStripe.isEmpty()) ? (qint64(0)) : (fileStripe["offset"].toLongLong());
+	const auto&& endOffset = (fileStripe.isEmpty())
+		? (file->size())
+		: (qMin(file->size(), startOffset + fileStripe["size"].toLongLong()));
+	if (startOffset && !file->seek(startOffset)) {
+		qDebug() << "Connect::readySendFileData: file seek error, filePath:" << fileInfo.filePath();
+		return false;
+	}
+	QList<QSharedPointer<Package>> packages;
+	if (fileStripe.isEmpty() && fileBundle.isEmpty() && (m_connectSettings->fileDeltaMinimumBytes != -1) &&
+		(file->size() >= qMax(qint64(1), m_connectSettings->fileDeltaMinimumBytes))) {
+		// No data yet, the receiver answers with the signatures of its copy and the data requests follow as usual
+		packages.push_back(Package::createFileTransportPackage(
+			targetActionFlag,
+			fileInfo,
+			QByteArray(),
+			appendData,
+			randomFlag,
+			false,
+			-1,
+			{}, // empty fileStripe
+			true
+		));
+		m_waitForSendFiles[randomFlag] = { file, priority, endOffset, true };
+		packages.first()->setSendPriority(priority);
+		this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
+		return true;
+	}
+	if (fileStripe.isEmpty() && fileBundle.isEmpty() && (m_connectSettings->chunkDeduplicationMinimumBytes != -1) &&
+		(file->size() >= qMax(qint64(1), m_connectSettings->chunkDeduplicationMinimumBytes))) {
+		return this->readySendChunkedData(
+			randomFlag,
+			NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG,
+			targetActionFlag,
+			fileInfo,
+			appendData,
+			file,
+			succeedCallback,
+			failCallback,
+			priority
+		);
+	}
+	const auto&& firstFileSize = static_cast<qint32>(qMin(this->cutPackageSizeForPriority(priority), endOffset - startOffset));
+	quint32 fileChecksum = 0;
+	if (this->useFileZeroCopy(firstFileSize)) {
+		packages.push_back(Package::createFileTransportPackage(
+			targetActionFlag,
+			fileInfo,
+			appendData,
+			randomFlag,
+			file,
+			startOffset,
+			firstFileSize,
+			-1,
+			fileStripe
+		));
+		file->seek(startOffset + firstFileSize);
+	} else {
+		const auto&& firstFileData = file->read(firstFileSize);
+		packages.push_back(Package::createFileTransportPackage(
+			targetActionFlag,
+			fileInfo,
+			firstFileData,
+			appendData,
+			randomFlag,
+			this->needCompressionPayloadData(firstFileSize),
+			-1,
+			fileStripe
+		));
+		if (m_connectSettings->packageChecksumEnabled) {
+			fileChecksum = Package::crc32c(firstFileData);
+			if (file->pos() >= endOffset) {
+				packages.first()->setFileChecksum(fileChecksum);
+			}
+		}
+	}
+	if (file->pos() < endOffset) {
+		auto& waitForSendFile = m_waitForSendFiles[randomFlag];
+		waitForSendFile = { file, priority, endOffset };
+		waitForSendFile.fileChecksum = fileChecksum;
+	}
+	if (!fileBundle.isEmpty()) {
+		packages.first()->setFileBundle(fileBundle);
+	}
+	packages.first()->setSendPriority(priority);
+	this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
+	return true;
+}
+
+bool Connect::readySendChunkedData(
+	const qint32& randomFlag,
+	const qint8& packageFlag,
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const QSharedPointer<QIODevice>& source,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	NETWORK_NULLPTR_CHECK(m_runOnConnectThreadCallback, false);
+	// Every byte of the source is read and hashed for the manifest, that is done on a worker instead of
+	// the caller's or the socket's thread, the result is handed to the connect thread
+	QtConcurrent::run(
+		[
+			thisPointer = QPointer<Connect>(this),
+			runOnConnectThreadCallback = m_runOnConnectThreadCallback,
+			packageChecksumEnabled = m_connectSettings->packageChecksumEnabled,
+			randomFlag,
+			packageFlag,
+			targetActionFlag,
+			fileInfo,
+			appendData,
+			source,
+			succeedCallback,
+			failCallback,
+			priority
+		]() {
+			WaitForSendChunkedData waitForSendChunkedData;
+			waitForSendChunkedData.source = source;
+			waitForSendChunkedData.packageFlag = packageFlag;
+			waitForSendChunkedData.priority = priority;
+			quint32 sourceChecksum = 0;
+			const auto&& chunkManifest = computeChunkManifest(source.data(), waitForSendChunkedData.chunkOffsets, sourceChecksum);
+			QSharedPointer<Package> manifestPackage;
+			if (!chunkManifest.isEmpty()) {
+				manifestPackage = Package::createChunkManifestPackage(
+					packageFlag,
+					targetActionFlag,
+					fileInfo,
+					appendData,
+					randomFlag,
+					source->size(),
+					chunkManifest
+				);
+				if (packageChecksumEnabled) {
+					manifestPackage->setFileChecksum(sourceChecksum);
+				}
+				manifestPackage->setSendPriority(priority);
+			}
+			runOnConnectThreadCallback(
+				[thisPointer, randomFlag, waitForSendChunkedData, manifestPackage, succeedCallback, failCallback]() {
+					if (!thisPointer) {
+						return;
+					}
+					thisPointer->startSendChunkedData(
+						randomFlag,
+						waitForSendChunkedData,
+						manifestPackage,
+						succeedCallback,
+						failCallback
+					);
+				});
+		}
+	);
+	return true;
+}
+
+void Connect::startSendChunkedData(
+	const qint32& randomFlag,
+	const WaitForSendChunkedData& waitForSendChunkedData,
+	const QSharedPointer<Package>& manifestPackage,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback
+) {
+	if (!manifestPackage || m_isAbandonTcpSocket || m_waitForSendChunkedDataPool.contains(randomFlag)) {
+		qDebug() << "Connect::startSendChunkedData: read error or randomFlag is sending, randomFlag:" << randomFlag;
+		if (failCallback) {
+			NETWORK_NULLPTR_CHECK(m_connectSettings->waitReplyPackageFailCallback);
+			m_connectSettings->waitReplyPackageFailCallback(this, failCallback);
+		}
+		return;
+	}
+	m_waitForSendChunkedDataPool[randomFlag] = waitForSendChunkedData;
+	QList<QSharedPointer<Package>> packages = { manifestPackage };
+	this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
+}
+
+void Connect::readySendFileBundle(const WaitForSendFileBundle& waitForSendFileBundle) {
+	if (this->thread() != QThread::currentThread()) {
+		m_runOnConnectThreadCallback([this, waitForSendFileBundle]() {
+			this->readySendFileBundle(waitForSendFileBundle);
+			});
+		return;
+	}
+	if (m_isAbandonTcpSocket) {
+		if (waitForSendFileBundle.failCallback) {
+			waitForSendFileBundle.failCallback(this);
+		}
+		return;
+	}
+	m_waitForSendFileBundles.push_back(waitForSendFileBundle);
+	this->readySendNextFileBundle();
+}
+
+void Connect::readySendNextFileBundle() {
+	while (!m_waitForSendFileBundles.isEmpty()) {
+		// Only one bundle is held in memory, the next is read once the last one has been handed to the socket
+		if (m_sendingFileBundleRandomFlag &&
+			(m_sendPayloadPackagePool.contains(m_sendingFileBundleRandomFlag) ||
+				m_waitForSendFiles.contains(m_sendingFileBundleRandomFlag) || m_sendSchedulerQueuedCount ||
+				!this->sendSchedulerHasRoom())) {
+			return;
+		}
+		m_sendingFileBundleRandomFlag = 0;
+		auto& waitForSendFileBundle = m_waitForSendFileBundles.first();
+		if (waitForSendFileBundle.progress->failed) {
+			// An earlier bundle failed, the send is over and the rest is not read
+			m_waitForSendFileBundles.pop_front();
+			continue;
+		}
+		const auto&& bundleIndex = waitForSendFileBundle.bundleCount - waitForSendFileBundle.bundles.size();
+		const auto&& filePaths = waitForSendFileBundle.bundles.takeFirst();
+		const QDir baseDir(waitForSendFileBundle.baseDirPath);
+		const auto succeedCallback = waitForSendFileBundle.succeedCallback;
+		const auto failCallback = waitForSendFileBundle.failCallback;
+		const auto progress = waitForSendFileBundle.progress;
+		const auto priority = waitForSendFileBundle.priority;
+		// Marked failed right away, so the loop drops the rest without waiting for the callback thread
+		const auto&& failFileBundle = [this, &progress]() {
+			if (!progress->failed.exchange(true) && progress->failCallback) {
+				NETWORK_NULLPTR_CHECK(m_connectSettings->waitReplyPackageFailCallback);
+				m_connectSettings->waitReplyPackageFailCallback(this, progress->failCallback);
+			}
+		};
+		const auto randomFlag = (bundleIndex) ? (this->nextRandomFlag()) : (waitForSendFileBundle.firstRandomFlag);
+		this->traceMessage(NetworkTracer::Enqueued, randomFlag);
+		QVariantMap fileBundle;
+		fileBundle["root"] = baseDir.dirName();
+		fileBundle["index"] = bundleIndex;
+		fileBundle["count"] = waitForSendFileBundle.bundleCount;
+		const auto targetActionFlag = waitForSendFileBundle.targetActionFlag;
+		const auto appendData = waitForSendFileBundle.appendData;
+		if (waitForSendFileBundle.bundles.isEmpty()) {
+			m_waitForSendFileBundles.pop_front();
+		}
+		const QFileInfo firstFileInfo(filePaths.first());
+		if ((filePaths.size() == 1) && (firstFileInfo.size() > m_connectSettings->fileBundleMaximumBytes)) {
+			// Too big to hold in memory, streamed from the file like any other file transfer
+			fileBundle["path"] = baseDir.relativeFilePath(firstFileInfo.absoluteFilePath());
+			if (!this->readySendFileData(
+				randomFlag,
+				targetActionFlag,
+				firstFileInfo,
+				appendData,
+				succeedCallback,
+				failCallback,
+				priority,
+				{}, // empty fileStripe
+				fileBundle
+			)) {
+				failFileBundle();
+				continue;
+			}
+			m_sendingFileBundleRandomFlag = randomFlag;
+			continue;
+		}
+		QVariantList files;
+		QByteArray payloadData;
+		auto readSucceed = true;
+		for (const auto& filePath : filePaths) {
+			QFile file(filePath);
+			if (!file.open(QIODevice::ReadOnly)) {
+				qDebug() << "Connect::readySendNextFileBundle: file open error, filePath:" << filePath;
+				readSucceed = false;
+				break;
+			}
+			const auto&& fileData = file.readAll();
+			const QFileInfo fileInfo(file);
+			// A positional list per file keeps the manifest small, the file data is not repeated in it
+			files.push_back(QVariantList({
+				baseDir.relativeFilePath(filePath),
+				fileData.size(),
+				static_cast<qint32>(fileInfo.permissions()),
+				fileInfo.lastModified().toMSecsSinceEpoch()
+			}));
+			payloadData.append(fileData);
+		}
+		if (!readSucceed) {
+			failFileBundle();
+			continue;
+		}
+		fileBundle["files"] = files;
+		auto packages = Package::createPayloadTransportPackages(
+			targetActionFlag,
+			payloadData,
+			appendData,
+			randomFlag,
+			this->cutPackageSizeForPriority(priority),
+			this->needCompressionPayloadData(payloadData.size()),
+			fileBundle
+		);
+		for (const auto& package : packages) {
+			package->setSendPriority(priority);
+		}
+		m_sendingFileBundleRandomFlag = randomFlag;
+		this->readySendPackages(randomFlag, packages, succeedCallback, failCallback);
+	}
+}
+
+void Connect::readySendPackages(
+	const qint32& randomFlag,
+	QList<QSharedPointer<Package>>& packages,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback
+) {
+	if (this->thread() != QThread::currentThread()) {
+		m_runOnConnectThreadCallback(
+			[
+				this,
+					randomFlag,
+					packages,
+					succeedCallback,
+					failCallback
+			]() {
+				auto buf = packages;
+				this->readySendPackages(randomFlag, buf, succeedCallback, failCallback);
+			}
+				);
+		return;
+	}
+	auto firstPackage = packages.first();
+	this->sendPackageToRemote(firstPackage);
+	if (succeedCallback || failCallback) {
+		m_onReceivedCallbacks[randomFlag] =
+		{
+			QDateTime::currentMSecsSinceEpoch(),
+			NetworkMetrics::nowMicroseconds(),
+			succeedCallback,
+			failCallback
+		};
+		if (!m_timerForSendPackageCheck) {
+			this->startTimerForSendPackageCheck();
+		}
+	}
+	if (packages.size() > 1) {
+		m_sendPayloadPackagePool[randomFlag].swap(packages);
+		m_sendPayloadPackagePool[randomFlag].pop_front();
+	}
+	NETWORK_NULLPTR_CHECK(m_connectSettings->packageSendingCallback);
+	m_connectSettings->packageSendingCallback(
+		this,
+		randomFlag,
+		0,
+		firstPackage->payloadDataOriginalCurrentSize(),
+		firstPackage->payloadDataTotalSize()
+	);
+}
+
+bool Connect::appendReadySendPackages(
+	QList<ReadySendPackages>& batch,
+	const qint32& randomFlag,
+	const NetworkBatchMessage& message,
+	const ConnectPointerAndPackageSharedPointerFunction& succeedCallback,
+	const ConnectPointerFunction& failCallback,
+	const NetworkPriority& priority
+) {
+	auto packages = Package::createPayloadTransportPackages(
+		message.targetActionFlag,
+		message.payloadData,
+		message.appendData,
+		randomFlag,
+		this->cutPackageSizeForPriority(priority),
+		this->needCompressionPayloadData(message.payloadData.size())
+	);
+	if (packages.isEmpty()) {
+		qDebug() << "Connect::appendReadySendPackages: createPackagesFromPayloadData error";
+		return false;
+	}
+	for (const auto& package : packages) {
+		package->setSendPriority(priority);
+	}
+	batch.push_back({ randomFlag, packages, succeedCallback, failCallback });
+	return true;
+}
+
+void Connect::readySendPackageBatch(QList<ReadySendPackages>& batch) {
+	if (this->thread() != QThread::currentThread()) {
+		m_runOnConnectThreadCallback(
+			[
+				this,
+					batch
+			]() {
+				auto buf = batch;
+				this->readySendPackageBatch(buf);
+			}
+				);
+		return;
+	}
+	m_batchWriting = true;
+	for (auto& readySendPackages : batch) {
+		this->readySendPackages(
+			readySendPackages.randomFlag,
+			readySendPackages.packages,
+			readySendPackages.succeedCallback,
+			readySendPackages.failCallback
+		);
+	}
+	m_batchWriting = false;
+	this->flushWriteCoalescingBuffer();
+}
+
 void Connect::sendDataRequestToRemote(const QSharedPointer<Package>& package) {
 	if (m_isAbandonTcpSocket) {
 		return;
@@ -860,7 +3520,214 @@ void Connect::sendDataRequestToRemote(const QSharedPointer<Package>& package) {
 }
 
 void Connect::sendPackageToRemote(const QSharedPointer<Package>& package) {
-	const auto&& buffer = package->toByteArray();
-	m_waitForSendBytes += buffer.size();
+	// Control packages are tiny and always go straight out, everything else waits while the
+	// socket already holds enough bytes, so a later control or interactive package can overtake it
+	if ((package->sendPriority() == NetworkPriority::Control) ||
+		(!m_sendSchedulerQueuedCount && this->sendSchedulerHasRoom())) {
+		this->writePackageToRemote(package);
+		return;
+	}
+	m_sendSchedulerQueues[static_cast<int>(package->sendPriority())].push_back(package);
+	++m_sendSchedulerQueuedCount;
+}
+
+bool Connect::sendSchedulerHasRoom() const {
+	if (m_connectSettings->sendSchedulerWatermark == -1) {
+		return true;
+	}
+	return (m_tcpSocket->bytesToWrite() + m_writeCoalescingBuffer.size()) < m_connectSettings->sendSchedulerWatermark;
+}
+
+void Connect::runSendScheduler() {
+	for (auto& queue : m_sendSchedulerQueues) {
+		while (!queue.isEmpty()) {
+			if (!this->sendSchedulerHasRoom()) {
+				return;
+			}
+			this->writePackageToRemote(queue.takeFirst());
+			--m_sendSchedulerQueuedCount;
+		}
+	}
+}
+
+void Connect::writePackageToRemote(const QSharedPointer<Package>& package) {
+	m_sentPackageCount.fetch_add(1, std::memory_order_relaxed);
+	if (m_connectSettings->tracer) {
+		this->traceWrittenPackage(package);
+	}
+	this->addMetric(NetworkMetrics::SentPackages);
+	if (package->packageFlag() == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG) {
+		this->addMetric(NetworkMetrics::SentFileChunks);
+	}
+	if (package->payloadDataFlag() == NETWORKPACKAGE_COMPRESSEDFLAG) {
+		this->addMetric(NetworkMetrics::CompressedOriginalBytes, package->payloadDataOriginalCurrentSize());
+		this->addMetric(NetworkMetrics::CompressedWireBytes, package->payloadDataCurrentSize());
+	}
+	if (package->hasPayloadFileRange()) {
+		// The checksum needs the payload in memory
+		if (!m_connectSettings->packageChecksumEnabled && this->writeFileRangeToRemote(package)) {
+			return;
+		}
+		if (!package->loadPayloadFileRange()) {
+			qDebug() << "Connect::writePackageToRemote: read file range error, randomFlag:" << package->randomFlag();
+			this->onReadyToDelete();
+			return;
+		}
+	}
+	if (m_connectSettings->packageChecksumEnabled) {
+		package->computeChecksum();
+	}
+	if (!m_connectSettings->writeCoalescingEnabled && !m_batchWriting) {
+		const auto&& buffer = package->toByteArray();
+		m_waitForSendBytes += buffer.size();
+		this->writeToTcpSocket(buffer);
+		return;
+	}
+	const auto&& packageSize = package->byteArraySize();
+	m_waitForSendBytes += packageSize;
+	if (m_writeCoalescingBuffer.isEmpty()) {
+		m_writeCoalescingBuffer.reserve(static_cast<int>(qMax(m_connectSettings->writeCoalescingMaximumBytes, qint64(packageSize))));
+	}
+	package->appendToByteArray(m_writeCoalescingBuffer);
+	if ((m_connectSettings->writeCoalescingMaximumBytes != -1) &&
+		(m_writeCoalescingBuffer.size() >= m_connectSettings->writeCoalescingMaximumBytes)) {
+		this->flushWriteCoalescingBuffer();
+		return;
+	}
+	if (m_batchWriting) {
+		return;
+	}
+	this->startTimerForWriteCoalescing();
+}
+
+void Connect::traceWrittenPackage(const QSharedPointer<Package>& package) {
+	const auto&& randomFlag = package->randomFlag();
+	const auto& tracer = m_connectSettings->tracer;
+	if (((package->packageFlag() != NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG) &&
+		(package->packageFlag() != NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)) || !tracer->isSampled(randomFlag)) {
+		return;
+	}
+	if (!m_tracedSendingMessages.contains(randomFlag)) {
+		m_tracedSendingMessages.insert(randomFlag);
+		tracer->trace(NetworkTracer::FirstByteWritten, randomFlag, m_connectId);
+	}
+	const auto&& finished = m_tracedFinishedMessages.remove(randomFlag);
+	const auto&& lastPayloadPackage = (package->packageFlag() == NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG) &&
+		!m_waitForSendChunkedDataPool.contains(randomFlag) &&
+		((package->payloadDataOriginalIndex() + package->payloadDataOriginalCurrentSize()) >= package->payloadDataTotalSize());
+	if (!finished && !lastPayloadPackage) {
+		return;
+	}
+	m_tracedSendingMessages.remove(randomFlag);
+	tracer->trace(NetworkTracer::LastChunkWritten, randomFlag, m_connectId);
+}
+
+void Connect::traceSendFinished(const qint32& randomFlag) {
+	if (!m_connectSettings->tracer || !m_connectSettings->tracer->isSampled(randomFlag)) {
+		return;
+	}
+	// Transfers are pulled, at most the last package of the message can still wait in the send scheduler
+	for (const auto& queue : m_sendSchedulerQueues) {
+		for (const auto& queuedPackage : queue) {
+			if (queuedPackage->randomFlag() == randomFlag) {
+				m_tracedFinishedMessages.insert(randomFlag);
+				return;
+			}
+		}
+	}
+	if (m_tracedSendingMessages.remove(randomFlag)) {
+		m_connectSettings->tracer->trace(NetworkTracer::LastChunkWritten, randomFlag, m_connectId);
+	}
+}
+
+void Connect::traceReceivedPackage(const QSharedPointer<Package>& package) {
+	const auto&& randomFlag = package->randomFlag();
+	if (((package->packageFlag() != NETWORKPACKAGE_PAYLOADDATATRANSPORTPACKGEFLAG) &&
+		(package->packageFlag() != NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)) ||
+		!m_connectSettings->tracer->isSampled(randomFlag) || m_tracedReceivingMessages.contains(randomFlag)) {
+		return;
+	}
+	m_tracedReceivingMessages.insert(randomFlag);
+	m_connectSettings->tracer->trace(NetworkTracer::FirstByteReceived, randomFlag, m_connectId);
+}
+
+bool Connect::writeFileRangeToRemote(const QSharedPointer<Package>& package) {
+#ifdef Q_OS_LINUX
+	if (!m_writeCoalescingBuffer.isEmpty()) {
+		this->flushWriteCoalescingBuffer();
+		m_tcpSocket->flush();
+	}
+	// Writing around QTcpSocket is only in order while its own buffer is empty
+	if (m_tcpSocket->bytesToWrite() > 0) {
+		return false;
+	}
+	const auto&& socketDescriptor = static_cast<int>(m_tcpSocket->socketDescriptor());
+	const auto&& fileDescriptor = package->payloadFile()->handle();
+	if ((socketDescriptor == -1) || (fileDescriptor == -1)) {
+		return false;
+	}
+	const auto&& head = package->toByteArray(); // head and meta data only, the payload is still in the file
+	const auto&& payloadSize = static_cast<qint64>(package->payloadDataCurrentSize());
+	m_socketWriteCount.fetch_add(1, std::memory_order_relaxed);
+	const auto&& headWritten = qMax(ssize_t(0),
+		::send(socketDescriptor, head.constData(), static_cast<size_t>(head.size()), MSG_NOSIGNAL | MSG_MORE));
+	if (headWritten < head.size()) {
+		// Socket send buffer is full, the rest goes through QTcpSocket like any other package
+		if (!package->loadPayloadFileRange()) {
+			qDebug() << "Connect::writeFileRangeToRemote: read file range error, randomFlag:" << package->randomFlag();
+			this->onReadyToDelete();
+			return true;
+		}
+		const auto&& rest = package->toByteArray().mid(static_cast<int>(headWritten));
+		m_alreadyWrittenBytes += headWritten;
+		this->addMetric(NetworkMetrics::SentBytes, headWritten);
+		m_waitForSendBytes += rest.size();
+		this->writeToTcpSocket(rest);
+		return true;
+	}
+	off_t fileOffset = package->payloadFileOffset();
+	auto remainingSize = payloadSize;
+	while (remainingSize > 0) {
+		const auto&& sentSize = ::sendfile(socketDescriptor, fileDescriptor, &fileOffset, static_cast<size_t>(remainingSize));
+		if (sentSize <= 0) {
+			break;
+		}
+		remainingSize -= sentSize;
+	}
+	m_alreadyWrittenBytes += head.size() + payloadSize - remainingSize;
+	this->addMetric(NetworkMetrics::SentBytes, head.size() + payloadSize - remainingSize);
+	if (!remainingSize) {
+		return true;
+	}
+	QByteArray rest(static_cast<int>(remainingSize), Qt::Uninitialized);
+	if (::pread(fileDescriptor, rest.data(), static_cast<size_t>(remainingSize), fileOffset) != remainingSize) {
+		// Half a package is already on the wire, the stream can not be recovered
+		qDebug() << "Connect::writeFileRangeToRemote: read file range error, randomFlag:" << package->randomFlag();
+		this->onReadyToDelete();
+		return true;
+	}
+	m_waitForSendBytes += rest.size();
+	this->writeToTcpSocket(rest);
+	return true;
+#else
+	Q_UNUSED(package);
+	return false;
+#endif
+}
+
+void Connect::flushWriteCoalescingBuffer() {
+	if (m_timerForWriteCoalescing) {
+		m_timerForWriteCoalescing->stop();
+	}
+	if (m_writeCoalescingBuffer.isEmpty()) {
+		return;
+	}
+	QByteArray buffer;
+	buffer.swap(m_writeCoalescingBuffer);
+	this->writeToTcpSocket(buffer);
+}
+
+void Connect::writeToTcpSocket(const QByteArray& buffer) {
+	m_socketWriteCount.fetch_add(1, std::memory_order_relaxed);
 	m_tcpSocket->write(buffer);
 }
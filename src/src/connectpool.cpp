@@ -43,9 +43,10 @@ ConnectPool::~ConnectPool() {
 void ConnectPool::createConnect(
 	const std::function<void(std::function<void()>)> runOnConnectThreadCallback,
 	const QString& hostName,
-	const quint16& port
+	const quint16& port,
+	const int& connectIndex
 ) {
-	auto connectKey = QString("%1:%2").arg(hostName).arg(port);
+	auto connectKey = ConnectPool::connectKey(hostName, port, connectIndex);
 	mutex_.lock();
 	if (m_bimapForHostAndPort1.contains(connectKey)) {
 		mutex_.unlock();
@@ -98,16 +99,43 @@ void ConnectPool::createConnect(
 				);
 }
 
+void ConnectPool::subscribe(const QPointer<Connect>& connect, const QString& topic) {
+	if (!connect || connect->isAbandonTcpSocket()) {
+		return;
+	}
+	m_topicSubscribers[topic].insert(connect.data());
+	m_connectTopics[connect.data()].insert(topic);
+}
+
+void ConnectPool::unsubscribe(const QPointer<Connect>& connect, const QString& topic) {
+	auto itForTopics = m_connectTopics.find(connect.data());
+	if ((itForTopics == m_connectTopics.end()) || !itForTopics->remove(topic)) {
+		return;
+	}
+	if (itForTopics->isEmpty()) {
+		m_connectTopics.erase(itForTopics);
+	}
+	auto itForSubscribers = m_topicSubscribers.find(topic);
+	if (itForSubscribers == m_topicSubscribers.end()) {
+		return;
+	}
+	itForSubscribers->remove(connect.data());
+	if (itForSubscribers->isEmpty()) {
+		m_topicSubscribers.erase(itForSubscribers);
+	}
+}
+
 QPair<QString, quint16> ConnectPool::getHostAndPortByConnect(const QPointer<Connect>& connect) {
 	QPair<QString, quint16> reply;
 	mutex_.lock();
 	{
 		auto it = m_bimapForHostAndPort2.find(connect.data());
 		if (it != m_bimapForHostAndPort2.end()) {
-			auto index = it.value().lastIndexOf(":");
-			if ((index > 0) && ((index + 1) < it.value().size())) {
-				reply.first = it.value().mid(0, index);
-				reply.second = it.value().mid(index + 1).toUShort();
+			const auto&& hostAndPort = it.value().section("#", 0, 0);
+			auto index = hostAndPort.lastIndexOf(":");
+			if ((index > 0) && ((index + 1) < hostAndPort.size())) {
+				reply.first = hostAndPort.mid(0, index);
+				reply.second = hostAndPort.mid(index + 1).toUShort();
 			}
 		}
 	}
@@ -115,6 +143,19 @@ QPair<QString, quint16> ConnectPool::getHostAndPortByConnect(const QPointer<Conn
 	return reply;
 }
 
+int ConnectPool::getConnectIndexByConnect(const QPointer<Connect>& connect) {
+	int reply = 0;
+	mutex_.lock();
+	{
+		auto it = m_bimapForHostAndPort2.find(connect.data());
+		if (it != m_bimapForHostAndPort2.end()) {
+			reply = it.value().section("#", 1, 1).toInt();
+		}
+	}
+	mutex_.unlock();
+	return reply;
+}
+
 qintptr ConnectPool::getSocketDescriptorByConnect(const QPointer<Connect>& connect) {
 	qintptr reply = {};
 	mutex_.lock();
@@ -128,11 +169,15 @@ qintptr ConnectPool::getSocketDescriptorByConnect(const QPointer<Connect>& conne
 	return reply;
 }
 
-QPointer<Connect> ConnectPool::getConnectByHostAndPort(const QString& hostName, const quint16& port) {
+QPointer<Connect> ConnectPool::getConnectByHostAndPort(
+	const QString& hostName,
+	const quint16& port,
+	const int& connectIndex
+) {
 	QPointer<Connect> reply;
 	mutex_.lock();
 	{
-		auto it = m_bimapForHostAndPort1.find(QString("%1:%2").arg(hostName, QString::number(port)));
+		auto it = m_bimapForHostAndPort1.find(connectKey(hostName, port, connectIndex));
 		if (it != m_bimapForHostAndPort1.end()) {
 			reply = it.value();
 		}
@@ -174,6 +219,17 @@ void ConnectPool::onReadyToDelete(const QPointer<Connect>& connect) {
 	//    qDebug() << "ConnectPool::onReadyToDelete:" << connect.data();
 	NETWORK_NULLPTR_CHECK(m_connectPoolSettings->readyToDeleteCallback);
 	m_connectPoolSettings->readyToDeleteCallback(connect, this);
+	const auto&& topics = m_connectTopics.take(connect.data());
+	for (const auto& topic : topics) {
+		auto it = m_topicSubscribers.find(topic);
+		if (it == m_topicSubscribers.end()) {
+			continue;
+		}
+		it->remove(connect.data());
+		if (it->isEmpty()) {
+			m_topicSubscribers.erase(it);
+		}
+	}
 	mutex_.lock();
 	auto containsInConnecting = m_connectForConnecting.contains(connect.data());
 	auto containsInConnected = m_connectForConnected.contains(connect.data());
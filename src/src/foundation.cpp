@@ -19,6 +19,7 @@ NetworkThreadPoolHelper::NetworkThreadPoolHelper() :
 void NetworkThreadPoolHelper::run(const std::function<void()>& callback) {
 	m_mutex.lock();
 	m_waitForRunCallbacks->push_back(callback);
+	m_queuedCallbackCount.fetch_add(1, std::memory_order_relaxed);
 	if (!m_alreadyCall) {
 		m_alreadyCall = true;
 		QMetaObject::invokeMethod(
@@ -39,6 +40,7 @@ void NetworkThreadPoolHelper::onRun() {
 	m_mutex.lock();
 	callbacks = *m_waitForRunCallbacks;
 	m_waitForRunCallbacks->clear();
+	m_queuedCallbackCount.store(0, std::memory_order_relaxed);
 	m_alreadyCall = false;
 	m_lastRunTime = currentTime;
 	m_lastRunCallbackCount = static_cast<int>(callbacks.size());
@@ -88,6 +90,16 @@ int NetworkThreadPool::run(const std::function<void()>& callback, const int& thr
 	return index;
 }
 
+int NetworkThreadPool::queuedCallbackCount() const {
+	auto count = 0;
+	for (const auto& helper : *m_helpers) {
+		if (helper) {
+			count += helper->queuedCallbackCount();
+		}
+	}
+	return count;
+}
+
 int NetworkThreadPool::waitRun(const std::function<void()>& callback, const int& threadIndex) {
 	QSemaphore semaphore;
 	auto index = this->run(
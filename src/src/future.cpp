@@ -0,0 +1,58 @@
+﻿
+#include "future.h"
+
+NetworkReplyPromise::NetworkReplyPromise() :
+	m_state(new State) {
+	m_state->promise.start();
+}
+
+NetworkReplyFuture NetworkReplyPromise::future() const {
+	return m_state->promise.future();
+}
+
+ConnectPointerAndPackageSharedPointerFunction NetworkReplyPromise::succeedCallback() const {
+	return [state = m_state](const ConnectPointer& connect, const PackageSharedPointer& package) {
+		state->finish({ connect, package });
+	};
+}
+
+ConnectPointerFunction NetworkReplyPromise::failCallback() const {
+	return [state = m_state](const ConnectPointer& connect) {
+		state->finish({ connect, nullptr });
+	};
+}
+
+void NetworkReplyPromise::fail(const ConnectPointer& connect) {
+	m_state->finish({ connect, nullptr });
+}
+
+void NetworkReplyPromise::State::finish(const NetworkReply& reply) {
+	mutex.lock();
+	if (finished) {
+		mutex.unlock();
+		return;
+	}
+	finished = true;
+	promise.addResult(reply);
+	promise.finish();
+	mutex.unlock();
+}
+
+QFuture<QList<NetworkReply>> NetworkFuture::whenAll(const QList<NetworkReplyFuture>& futures) {
+	return QtFuture::whenAll(futures.begin(), futures.end()).then(
+		[](const QList<NetworkReplyFuture>& settledFutures) {
+			QList<NetworkReply> replies;
+			replies.reserve(settledFutures.size());
+			for (const auto& future : settledFutures) {
+				replies.push_back((future.resultCount()) ? (future.result()) : (NetworkReply()));
+			}
+			return replies;
+		}
+	);
+}
+
+NetworkReplyFuture NetworkFuture::makeFailed(const ConnectPointer& connect) {
+	NetworkReplyPromise promise;
+	promise.fail(connect);
+	return promise.future();
+}
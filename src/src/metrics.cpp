@@ -0,0 +1,97 @@
+﻿
+#include "metrics.h"
+
+#include <chrono>
+
+void NetworkMetrics::observe(const Histogram& histogram, const qint64& microseconds) {
+	auto& histogramData = m_histograms[histogram];
+	auto bucket = 0;
+	while ((bucket < (HistogramBucketCount - 1)) && ((qint64(1) << bucket) < microseconds)) {
+		++bucket;
+	}
+	histogramData.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	histogramData.sum.fetch_add(qMax(qint64(0), microseconds), std::memory_order_relaxed);
+}
+
+qint64 NetworkMetrics::histogramCount(const Histogram& histogram) const {
+	qint64 count = 0;
+	for (const auto& bucket : m_histograms[histogram].buckets) {
+		count += bucket.load(std::memory_order_relaxed);
+	}
+	return count;
+}
+
+QByteArray NetworkMetrics::toPrometheusText(const QString& prefix) const {
+	QByteArray text;
+	const auto&& prefixData = prefix.toUtf8();
+	for (auto index = 0; index < CounterCount; ++index) {
+		const auto&& name = prefixData + "_" + counterName(static_cast<Counter>(index)) + "_total";
+		text += "# TYPE " + name + " counter\n";
+		text += name + " " + QByteArray::number(m_counters[index].load(std::memory_order_relaxed)) + "\n";
+	}
+	for (auto index = 0; index < GaugeCount; ++index) {
+		const auto&& name = prefixData + "_" + gaugeName(static_cast<Gauge>(index));
+		text += "# TYPE " + name + " gauge\n";
+		text += name + " " + QByteArray::number(m_gauges[index].load(std::memory_order_relaxed)) + "\n";
+	}
+	for (auto index = 0; index < HistogramCount; ++index) {
+		const auto& histogramData = m_histograms[index];
+		const auto&& name = prefixData + "_" + histogramName(static_cast<Histogram>(index)) + "_seconds";
+		text += "# TYPE " + name + " histogram\n";
+		// Prometheus buckets are cumulative
+		qint64 count = 0;
+		for (auto bucket = 0; bucket < HistogramBucketCount; ++bucket) {
+			count += histogramData.buckets[bucket].load(std::memory_order_relaxed);
+			const auto&& upperBound = (bucket < (HistogramBucketCount - 1))
+				? (QByteArray::number(static_cast<double>(qint64(1) << bucket) / 1000000.0, 'g', 9))
+				: (QByteArray("+Inf"));
+			text += name + "_bucket{le=\"" + upperBound + "\"} " + QByteArray::number(count) + "\n";
+		}
+		text += name + "_sum " + QByteArray::number(
+			static_cast<double>(histogramData.sum.load(std::memory_order_relaxed)) / 1000000.0, 'g', 12) + "\n";
+		text += name + "_count " + QByteArray::number(count) + "\n";
+	}
+	return text;
+}
+
+qint64 NetworkMetrics::nowMicroseconds() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* NetworkMetrics::counterName(const Counter& counter) {
+	switch (counter) {
+		case SentBytes: return "sent_bytes";
+		case ReceivedBytes: return "received_bytes";
+		case SentPackages: return "sent_packages";
+		case ReceivedPackages: return "received_packages";
+		case SentFileChunks: return "sent_file_chunks";
+		case ReceivedFileChunks: return "received_file_chunks";
+		case CompressedOriginalBytes: return "compressed_original_bytes";
+		case CompressedWireBytes: return "compressed_wire_bytes";
+		case ChecksumErrors: return "checksum_errors";
+		case CorruptedBytes: return "corrupted_bytes";
+		case ReplyTimeouts: return "reply_timeouts";
+		case SlowConsumerSkips: return "slow_consumer_skips";
+		default: return "unknown";
+	}
+}
+
+const char* NetworkMetrics::gaugeName(const Gauge& gauge) {
+	switch (gauge) {
+		case Connections: return "connections";
+		case SocketThreads: return "socket_threads";
+		case CallbackThreads: return "callback_threads";
+		case SocketThreadQueueDepth: return "socket_thread_queue_depth";
+		case CallbackThreadQueueDepth: return "callback_thread_queue_depth";
+		default: return "unknown";
+	}
+}
+
+const char* NetworkMetrics::histogramName(const Histogram& histogram) {
+	switch (histogram) {
+		case ReplyLatency: return "reply_latency";
+		case CallbackQueueLatency: return "callback_queue_latency";
+		default: return "unknown";
+	}
+}
@@ -4,8 +4,24 @@
 #include <QDebug>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QFile>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QCryptographicHash>
+
+#include <array>
+#include <cstring>
+
+#if ( defined __x86_64__ ) || ( defined _M_X64 )
+#   include <nmmintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#   define NETWORK_CRC32C_X86
+#elif ( defined __ARM_FEATURE_CRC32 )
+#   include <arm_acle.h>
+#   define NETWORK_CRC32C_ARM
+#endif
 
 #define BOOL_CHECK( actual, message )                           \
     if ( !( actual ) )                                          \
@@ -16,7 +32,76 @@
         return false;                                           \
     }
 
-qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData) {
+static quint32 crc32cSoftware(quint32 crc, const uchar* data, qint64 size) {
+	static const auto table = []() {
+		std::array<quint32, 256> table;
+		for (quint32 index = 0; index < 256; ++index) {
+			auto value = index;
+			for (auto bit = 0; bit < 8; ++bit) {
+				value = (value & 1) ? ((value >> 1) ^ 0x82f63b78) : (value >> 1);
+			}
+			table[index] = value;
+		}
+		return table;
+	}();
+	while (size-- > 0) {
+		crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if ( defined NETWORK_CRC32C_X86 ) && ( ( defined __GNUC__ ) || ( defined __clang__ ) )
+__attribute__((target("sse4.2")))
+#endif
+static quint32 crc32cHardware(quint32 crc, const uchar* data, qint64 size) {
+#if defined NETWORK_CRC32C_X86
+	quint64 wideCrc = crc;
+	for (; size >= 8; size -= 8, data += 8) {
+		quint64 value;
+		std::memcpy(&value, data, sizeof(value));
+		wideCrc = _mm_crc32_u64(wideCrc, value);
+	}
+	crc = static_cast<quint32>(wideCrc);
+	while (size-- > 0) {
+		crc = _mm_crc32_u8(crc, *data++);
+	}
+	return crc;
+#elif defined NETWORK_CRC32C_ARM
+	for (; size >= 8; size -= 8, data += 8) {
+		quint64 value;
+		std::memcpy(&value, data, sizeof(value));
+		crc = __crc32cd(crc, value);
+	}
+	while (size-- > 0) {
+		crc = __crc32cb(crc, *data++);
+	}
+	return crc;
+#else
+	return crc32cSoftware(crc, data, size);
+#endif
+}
+
+static bool crc32cHardwareSupported() {
+#if ( defined NETWORK_CRC32C_X86 ) && ( defined _MSC_VER )
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return (cpuInfo[2] & (1 << 20)) != 0;
+#elif defined NETWORK_CRC32C_X86
+	return __builtin_cpu_supports("sse4.2");
+#elif defined NETWORK_CRC32C_ARM
+	return true;
+#else
+	return false;
+#endif
+}
+
+quint32 Package::crc32c(const char* data, const qint64& size, const quint32& crc) {
+	static const auto hardwareSupported = crc32cHardwareSupported();
+	const auto* bytes = reinterpret_cast<const uchar*>(data);
+	return ~((hardwareSupported) ? (crc32cHardware(~crc, bytes, size)) : (crc32cSoftware(~crc, bytes, size)));
+}
+
+qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData, const bool& requireChecksum) {
 	/*
 	 * Return value:
 	 * > 0: Wait for more byte
@@ -26,11 +111,36 @@ qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData) {
 	if (rawData.size() < headSize()) {
 		return headSize() - rawData.size();
 	}
+	const auto&& checkedSize = checkedHeadSize(rawData.constData());
+	if (rawData.size() < checkedSize) {
+		return checkedSize - rawData.size();
+	}
+
+	if (!isValidHead(rawData.constData(), requireChecksum)) {
+		return -1;
+	}
 
 	const auto* head = reinterpret_cast<const Head*>(rawData.data());
 	auto dataSize = rawData.size() - headSize();
+	auto expectDataSize = (head->payloadDataFlag & NETWORKPACKAGE_CHECKSUMFLAG) ? (NETWORKPACKAGE_CHECKSUMSIZE) : (0);
+	if (head->metaDataCurrentSize > 0) {
+		expectDataSize += head->metaDataCurrentSize;
+	}
+	if (head->payloadDataCurrentSize > 0) {
+		expectDataSize += head->payloadDataCurrentSize;
+	}
+	if (dataSize < expectDataSize) {
+		return expectDataSize - dataSize;
+	}
+	return 0;
+}
+
+bool Package::isValidHead(const char* data, const bool& requireChecksum) {
+	Head headData;
+	std::memcpy(&headData, data, sizeof(headData));
+	const auto* head = &headData;
 	if (head->bootFlag != NETWORKPACKAGE_BOOTFLAG) {
-		return -1;
+		return false;
 	}
 
 	switch (head->packageFlag) {
@@ -41,17 +151,18 @@ qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData) {
 		}
 		case NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG:
 		case NETWORKPACKAGE_FILEDATAREQUESTPACKGEFLAG:
+		case NETWORKPACKAGE_HEARTBEATPACKGEFLAG:
 		{
 			break;
 		}
 		default:
 		{
-			return -1;
+			return false;
 		}
 	}
 
 	if (head->randomFlag <= 0) {
-		return -1;
+		return false;
 	}
 
 	switch (head->metaDataFlag) {
@@ -62,23 +173,23 @@ qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData) {
 		}
 		default:
 		{
-			return -1;
+			return false;
 		}
 	}
 
 	if (head->metaDataTotalSize < -1) {
-		return -1;
+		return false;
 	}
 
 	if (head->metaDataCurrentSize < -1) {
-		return -1;
+		return false;
 	}
 
 	if (head->metaDataTotalSize < head->metaDataCurrentSize) {
-		return -1;
+		return false;
 	}
 
-	switch (head->payloadDataFlag) {
+	switch (head->payloadDataFlag & ~NETWORKPACKAGE_CHECKSUMFLAG) {
 		case NETWORKPACKAGE_UNCOMPRESSEDFLAG:
 		case NETWORKPACKAGE_COMPRESSEDFLAG:
 		{
@@ -86,35 +197,62 @@ qint32 Package::checkDataIsReadyReceive(const QByteArray& rawData) {
 		}
 		default:
 		{
-			return -1;
+			return false;
 		}
 	}
 	if (head->payloadDataTotalSize < -1) {
-		return -1;
+		return false;
 	}
 	if (head->payloadDataCurrentSize < -1) {
-		return -1;
+		return false;
 	}
 	if (head->payloadDataTotalSize < head->payloadDataCurrentSize) {
-		return -1;
-	}
-	auto expectDataSize = 0;
-	if (head->metaDataCurrentSize > 0) {
-		expectDataSize += head->metaDataCurrentSize;
+		return false;
 	}
-	if (head->payloadDataCurrentSize > 0) {
-		expectDataSize += head->payloadDataCurrentSize;
+	if (head->payloadDataFlag & NETWORKPACKAGE_CHECKSUMFLAG) {
+		quint32 headChecksum = 0;
+		std::memcpy(&headChecksum, data + headSize(), NETWORKPACKAGE_HEADCHECKSUMSIZE);
+		return crc32c(data, headSize()) == headChecksum;
 	}
-	if (dataSize < expectDataSize) {
-		return expectDataSize - dataSize;
+	return !requireChecksum;
+}
+
+int Package::checkedHeadSize(const char* data) {
+	Head headData;
+	std::memcpy(&headData, data, sizeof(headData));
+	return headSize() + ((headData.payloadDataFlag & NETWORKPACKAGE_CHECKSUMFLAG) ? (NETWORKPACKAGE_HEADCHECKSUMSIZE) : (0));
+}
+
+int Package::nextHeadIndex(const QByteArray& rawData, const int& from, const bool& requireChecksum) {
+	const auto* begin = rawData.constData();
+	const auto* end = begin + rawData.size();
+	auto* candidate = begin + qMin(from, rawData.size());
+	// memchr is vectorized in every libc we build against, most of a corrupt buffer is skipped 16 or 32
+	// bytes at a time, only a boot flag costs a head check
+	while ((candidate = static_cast<const char*>(std::memchr(candidate, NETWORKPACKAGE_BOOTFLAG, end - candidate)))) {
+		if (((end - candidate) < headSize()) || ((end - candidate) < checkedHeadSize(candidate)) ||
+			isValidHead(candidate, requireChecksum)) {
+			// A head, or its checksum, cut off at the end of the buffer is kept until the rest arrives
+			return static_cast<int>(candidate - begin);
+		}
+		++candidate;
 	}
-	return 0;
+	return rawData.size();
 }
 
 QSharedPointer<Package> Package::readPackage(QByteArray& rawData) {
 	auto package = QSharedPointer<Package>(new Package);
 	auto data = rawData.data() + headSize();
 	package->m_head = *reinterpret_cast<const Head*>(rawData.data());
+	if (package->m_head.payloadDataFlag & NETWORKPACKAGE_CHECKSUMFLAG) {
+		package->m_head.payloadDataFlag &= ~NETWORKPACKAGE_CHECKSUMFLAG;
+		package->m_hasChecksum = true;
+		std::memcpy(&package->m_headChecksum, data, NETWORKPACKAGE_HEADCHECKSUMSIZE);
+		std::memcpy(&package->m_checksum, data + NETWORKPACKAGE_HEADCHECKSUMSIZE,
+			NETWORKPACKAGE_CHECKSUMSIZE - NETWORKPACKAGE_HEADCHECKSUMSIZE);
+		data += NETWORKPACKAGE_CHECKSUMSIZE;
+	}
+	const auto* checkedData = data;
 	if (package->metaDataCurrentSize() > 0) {
 		package->m_metaData.append(data, package->metaDataCurrentSize());
 		data += package->metaDataCurrentSize();
@@ -123,6 +261,14 @@ QSharedPointer<Package> Package::readPackage(QByteArray& rawData) {
 		package->m_payloadData.append(data, package->payloadDataCurrentSize());
 		data += package->payloadDataCurrentSize();
 	}
+	if (package->m_hasChecksum &&
+		(crc32c(checkedData, data - checkedData, package->m_headChecksum) != package->m_checksum)) {
+		// The length fields were plausible, so the stream is still in step, the connect decides what to drop
+		qDebug() << "Package::readPackage: checksum mismatch, randomFlag:" << package->randomFlag();
+		package->m_isAbandonPackage = true;
+		rawData.remove(0, static_cast<int>(data - rawData.data()));
+		return package;
+	}
 	rawData.remove(0, static_cast<int>(data - rawData.data()));
 	package->refreshPackage();
 	return package;
@@ -134,14 +280,18 @@ QList<QSharedPointer<Package>> Package::createPayloadTransportPackages(
 	const QVariantMap& appendData,
 	const qint32& randomFlag,
 	const qint64 cutPackageSize,
-	const bool& compressionData
+	const bool& compressionData,
+	const QVariantMap& fileBundle
 ) {
 	QList<QSharedPointer<Package>> result;
 	QByteArray metaData;
-	if (!targetActionFlag.isEmpty() || !appendData.isEmpty()) {
+	if (!targetActionFlag.isEmpty() || !appendData.isEmpty() || !fileBundle.isEmpty()) {
 		QVariantMap metaDataInVariantMap;
 		metaDataInVariantMap["targetActionFlag"] = targetActionFlag;
 		metaDataInVariantMap["appendData"] = appendData;
+		if (!fileBundle.isEmpty()) {
+			metaDataInVariantMap["fileBundle"] = fileBundle;
+		}
 		metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
 	}
 	if (payloadData.isEmpty()) {
@@ -229,7 +379,10 @@ QSharedPointer<Package> Package::createFileTransportPackage(
 	const QByteArray& fileData,
 	const QVariantMap& appendData,
 	const qint32& randomFlag,
-	const bool& compressionData
+	const bool& compressionData,
+	const qint64& fileOffset,
+	const QVariantMap& fileStripe,
+	const bool& fileDelta
 ) {
 	QSharedPointer<Package> package(new Package);
 	QByteArray metaData;
@@ -244,6 +397,22 @@ QSharedPointer<Package> Package::createFileTransportPackage(
 			metaDataInVariantMap["fileCreatedTime"] = fileInfo.birthTime().toMSecsSinceEpoch();
 			metaDataInVariantMap["fileLastReadTime"] = fileInfo.lastRead().toMSecsSinceEpoch();
 			metaDataInVariantMap["fileLastModifiedTime"] = fileInfo.lastModified().toMSecsSinceEpoch();
+			// Same file content version gives the same id, so a receiver can resume it after a reconnect
+			metaDataInVariantMap["fileTransferId"] = QCryptographicHash::hash(
+				QString("%1:%2:%3").arg(
+					fileInfo.fileName(),
+					QString::number(fileInfo.size()),
+					QString::number(fileInfo.lastModified().toMSecsSinceEpoch())
+				).toUtf8(), QCryptographicHash::Md5).toHex();
+		}
+		if (fileOffset != -1) {
+			metaDataInVariantMap["fileOffset"] = fileOffset;
+		}
+		if (!fileStripe.isEmpty()) {
+			metaDataInVariantMap["fileStripe"] = fileStripe;
+		}
+		if (fileDelta) {
+			metaDataInVariantMap["fileDelta"] = true;
 		}
 		metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
 	}
@@ -267,6 +436,35 @@ QSharedPointer<Package> Package::createFileTransportPackage(
 	return package;
 }
 
+QSharedPointer<Package> Package::createFileTransportPackage(
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const qint32& randomFlag,
+	const QSharedPointer<QFile>& payloadFile,
+	const qint64& payloadFileOffset,
+	const qint32& payloadSize,
+	const qint64& fileOffset,
+	const QVariantMap& fileStripe
+) {
+	auto package = createFileTransportPackage(
+		targetActionFlag,
+		fileInfo,
+		QByteArray(),
+		appendData,
+		randomFlag,
+		false,
+		fileOffset,
+		fileStripe
+	);
+	package->m_head.payloadDataTotalSize = payloadSize;
+	package->m_head.payloadDataCurrentSize = payloadSize;
+	package->m_payloadDataOriginalCurrentSize = payloadSize;
+	package->m_payloadFile = payloadFile;
+	package->m_payloadFileOffset = payloadFileOffset;
+	return package;
+}
+
 QSharedPointer<Package> Package::createPayloadDataRequestPackage(const qint32& randomFlag) {
 	auto package = QSharedPointer<Package>(new Package);
 	package->m_head.bootFlag = NETWORKPACKAGE_BOOTFLAG;
@@ -274,16 +472,109 @@ QSharedPointer<Package> Package::createPayloadDataRequestPackage(const qint32& r
 	package->m_head.randomFlag = randomFlag;
 	package->m_head.metaDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
 	package->m_head.payloadDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
+	package->m_sendPriority = NetworkPriority::Control;
+	return package;
+}
+
+QSharedPointer<Package> Package::createHeartbeatPackage(const bool& replyWanted) {
+	auto package = QSharedPointer<Package>(new Package);
+	package->m_head.bootFlag = NETWORKPACKAGE_BOOTFLAG;
+	package->m_head.packageFlag = NETWORKPACKAGE_HEARTBEATPACKGEFLAG;
+	package->m_head.randomFlag = (replyWanted) ? (NETWORKPACKAGE_HEARTBEATPING) : (NETWORKPACKAGE_HEARTBEATPONG);
+	package->m_head.metaDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
+	package->m_head.payloadDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
+	package->m_sendPriority = NetworkPriority::Control;
+	return package;
+}
+
+QSharedPointer<Package> Package::createChunkManifestPackage(
+	const qint8& packageFlag,
+	const QString& targetActionFlag,
+	const QFileInfo& fileInfo,
+	const QVariantMap& appendData,
+	const qint32& randomFlag,
+	const qint64& chunkedDataSize,
+	const QByteArray& chunkManifest
+) {
+	auto package = (packageFlag == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)
+		? (createFileTransportPackage(targetActionFlag, fileInfo, chunkManifest, appendData, randomFlag))
+		: (createPayloadTransportPackages(targetActionFlag, chunkManifest, appendData, randomFlag).first());
+	auto metaDataInVariantMap = QJsonDocument::fromJson(package->m_metaData).object().toVariantMap();
+	metaDataInVariantMap["chunkedDataSize"] = chunkedDataSize;
+	package->m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	package->m_head.metaDataTotalSize = package->m_metaData.size();
+	package->m_head.metaDataCurrentSize = package->m_metaData.size();
+	return package;
+}
+
+QSharedPointer<Package> Package::createChunkWantsPackage(
+	const qint8& packageFlag,
+	const qint32& randomFlag,
+	const QByteArray& chunkWants
+) {
+	auto package = (packageFlag == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)
+		? (createFileDataRequestPackage(randomFlag))
+		: (createPayloadDataRequestPackage(randomFlag));
+	package->m_payloadData = chunkWants;
+	package->m_head.payloadDataTotalSize = chunkWants.size();
+	package->m_head.payloadDataCurrentSize = chunkWants.size();
 	return package;
 }
 
-QSharedPointer<Package> Package::createFileDataRequestPackage(const qint32& randomFlag) {
+QSharedPointer<Package> Package::createFileDataRequestPackage(
+	const qint32& randomFlag,
+	const qint64& fileResumeOffset,
+	const QByteArray& fileResumeChecksum,
+	const qint64& fileDeltaBlockSize,
+	const QByteArray& fileDeltaSignatures
+) {
 	auto package = QSharedPointer<Package>(new Package);
 	package->m_head.bootFlag = NETWORKPACKAGE_BOOTFLAG;
 	package->m_head.packageFlag = NETWORKPACKAGE_FILEDATAREQUESTPACKGEFLAG;
 	package->m_head.randomFlag = randomFlag;
 	package->m_head.metaDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
 	package->m_head.payloadDataFlag = NETWORKPACKAGE_UNCOMPRESSEDFLAG;
+	package->m_sendPriority = NetworkPriority::Control;
+	if (fileResumeOffset > 0) {
+		QVariantMap metaDataInVariantMap;
+		metaDataInVariantMap["fileResumeOffset"] = fileResumeOffset;
+		metaDataInVariantMap["fileResumeChecksum"] = QString::fromLatin1(fileResumeChecksum);
+		package->m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+		package->m_head.metaDataTotalSize = package->m_metaData.size();
+		package->m_head.metaDataCurrentSize = package->m_metaData.size();
+	}
+	if (fileDeltaBlockSize > 0) {
+		QVariantMap metaDataInVariantMap;
+		metaDataInVariantMap["fileDeltaBlockSize"] = fileDeltaBlockSize;
+		package->m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+		package->m_head.metaDataTotalSize = package->m_metaData.size();
+		package->m_head.metaDataCurrentSize = package->m_metaData.size();
+		package->m_payloadData = fileDeltaSignatures;
+		package->m_head.payloadDataTotalSize = fileDeltaSignatures.size();
+		package->m_head.payloadDataCurrentSize = fileDeltaSignatures.size();
+	}
+	return package;
+}
+
+QSharedPointer<Package> Package::createFileDeltaResultPackage(const qint32& randomFlag, const bool& verified) {
+	auto package = createFileDataRequestPackage(randomFlag);
+	QVariantMap metaDataInVariantMap;
+	metaDataInVariantMap["fileDeltaVerified"] = verified;
+	package->m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	package->m_head.metaDataTotalSize = package->m_metaData.size();
+	package->m_head.metaDataCurrentSize = package->m_metaData.size();
+	return package;
+}
+
+QSharedPointer<Package> Package::createTransferAbortPackage(const qint8& packageFlag, const qint32& randomFlag) {
+	auto package = (packageFlag == NETWORKPACKAGE_FILEDATATRANSPORTPACKGEFLAG)
+		? (createFileDataRequestPackage(randomFlag))
+		: (createPayloadDataRequestPackage(randomFlag));
+	QVariantMap metaDataInVariantMap;
+	metaDataInVariantMap["transferAborted"] = true;
+	package->m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	package->m_head.metaDataTotalSize = package->m_metaData.size();
+	package->m_head.metaDataCurrentSize = package->m_metaData.size();
 	return package;
 }
 
@@ -305,6 +596,71 @@ QDateTime Package::fileLastModifiedTime() const {
 		: (QDateTime());
 }
 
+bool Package::loadPayloadFileRange() {
+	if (!m_payloadFile) {
+		return true;
+	}
+	const auto&& originalPos = m_payloadFile->pos();
+	if (!m_payloadFile->seek(m_payloadFileOffset)) {
+		qDebug() << "Package::loadPayloadFileRange: seek error, offset:" << m_payloadFileOffset;
+		return false;
+	}
+	m_payloadData = m_payloadFile->read(m_head.payloadDataCurrentSize);
+	m_payloadFile->seek(originalPos);
+	m_payloadFile.clear();
+	return m_payloadData.size() == m_head.payloadDataCurrentSize;
+}
+
+void Package::setFileChecksum(const quint32& fileChecksum) {
+	auto metaDataInVariantMap = QJsonDocument::fromJson(m_metaData).object().toVariantMap();
+	metaDataInVariantMap["fileChecksum"] = static_cast<qint64>(fileChecksum);
+	m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	m_head.metaDataTotalSize = m_metaData.size();
+	m_head.metaDataCurrentSize = m_metaData.size();
+	m_metaDataInVariantMap = metaDataInVariantMap;
+}
+
+void Package::setFileBundle(const QVariantMap& fileBundle) {
+	auto metaDataInVariantMap = QJsonDocument::fromJson(m_metaData).object().toVariantMap();
+	metaDataInVariantMap["fileBundle"] = fileBundle;
+	m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	m_head.metaDataTotalSize = m_metaData.size();
+	m_head.metaDataCurrentSize = m_metaData.size();
+	m_metaDataInVariantMap = metaDataInVariantMap;
+}
+
+void Package::setFileHash(const QByteArray& fileHash) {
+	auto metaDataInVariantMap = QJsonDocument::fromJson(m_metaData).object().toVariantMap();
+	metaDataInVariantMap["fileHash"] = QString::fromLatin1(fileHash);
+	m_metaData = QJsonDocument(QJsonObject::fromVariantMap(metaDataInVariantMap)).toJson(QJsonDocument::Compact);
+	m_head.metaDataTotalSize = m_metaData.size();
+	m_head.metaDataCurrentSize = m_metaData.size();
+	m_metaDataInVariantMap = metaDataInVariantMap;
+}
+
+void Package::computeChecksum() {
+	if (!m_encodedFrame.isEmpty()) {
+		return;
+	}
+	// The head is covered as it goes on the wire, with the checksum flag. Its own checksum lets a
+	// resynchronizing receiver reject a stray boot flag before waiting for the lengths it claims
+	auto head = m_head;
+	head.payloadDataFlag |= NETWORKPACKAGE_CHECKSUMFLAG;
+	m_headChecksum = crc32c(reinterpret_cast<const char*>(&head), headSize());
+	m_checksum = m_headChecksum;
+	if (m_head.metaDataCurrentSize > 0) {
+		m_checksum = crc32c(m_metaData, m_checksum);
+	}
+	if (m_head.payloadDataCurrentSize > 0) {
+		m_checksum = crc32c(m_payloadData, m_checksum);
+	}
+	m_hasChecksum = true;
+}
+
+void Package::encodeFrame() {
+	m_encodedFrame = this->toByteArray();
+}
+
 bool Package::mixPackage(const QSharedPointer<Package>& mixPackage) {
 	BOOL_CHECK(!this->isCompletePackage(), "current package is complete");
 	BOOL_CHECK(!mixPackage->isCompletePackage(), "mix package is complete");
@@ -332,7 +332,8 @@ QSet<QString> Processor::availableSlots() {
 			if (!invokeMethodReply) {
 				qDebug() << "Processor::availableSlots: invokeMethod slot error:" << methodName;
 			}
-			if (sendArgumentAnswer) {
+			const auto context = this->currentHandleContext();
+			if (sendArgumentAnswer && !(context && context->replyDeferred)) {
 				if (sendAppendArg) {
 					(*sendArgumentAnswer)(connect, package, sendArg,
 						*static_cast<const QVariantMap*>(sendAppendArg.get()));
@@ -347,38 +348,18 @@ QSet<QString> Processor::availableSlots() {
 }
 
 bool Processor::handlePackage(const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
-	qDebug() << "connect: " << connect;
-	auto currentThreadConnect = connectMapByThread_.find(QThread::currentThread());
-	if (currentThreadConnect == connectMapByThread_.end()) {
-		qDebug() << "Processor::onPackageReceived: expectation thread:" << QThread::currentThread();
-		return false;
-	}
-	*currentThreadConnect = connect;
 	const auto&& targetActionFlag = package->targetActionFlag();
-	QMap<QString, std::function<void(const QPointer<Connect>&, const QSharedPointer<Package>&)>>::iterator
-		itForCallback = onpackageReceivedCallbacks_.find(targetActionFlag);
-	qDebug() << "targetActionFlag: " << targetActionFlag;
-	qDebug() << "itForCallback: " << itForCallback.key();
-
+	const auto&& itForCallback = onpackageReceivedCallbacks_.find(targetActionFlag);
 	if (itForCallback == onpackageReceivedCallbacks_.end()) {
 		qDebug() << "Processor::onPackageReceived: expectation targetActionFlag:" << targetActionFlag;
-		*currentThreadConnect = nullptr;
-		return false;
-	}
-	if (!connect) {
 		return false;
 	}
+	HandleContext context = { this, connect, package, nullptr, false };
+	HandleContextScope contextScope(context);
 	(*itForCallback)(connect, package);
-	*currentThreadConnect = nullptr;
 	return true;
 }
 
-void Processor::setReceivedPossibleThreads(const QSet<QThread*>& threads) {
-	for (const auto& thread : threads) {
-		connectMapByThread_[thread] = nullptr;
-	}
-}
-
 bool Processor::checkMapContains(const QStringList& keys, const QVariantMap& received, QVariantMap& send) {
 	for (const auto& key : keys) {
 		if (!received.contains(key)) {
@@ -430,12 +411,45 @@ bool Processor::checkDataContasinsExpectedContent(const QString& key, const QVar
 }
 
 QPointer<Connect> Processor::currentThreadConnect() {
-	auto currentThreadConnect = connectMapByThread_.find(QThread::currentThread());
-	if (currentThreadConnect == connectMapByThread_.end()) {
-		qDebug() << "Processor::currentThreadConnect: expectation thread:" << QThread::currentThread();
+	const auto context = this->currentHandleContext();
+	if (!context) {
+		qDebug() << "Processor::currentThreadConnect: not handling package in thread:" << QThread::currentThread();
+		return nullptr;
+	}
+	return context->connect;
+}
+
+QSharedPointer<Package> Processor::currentThreadPackage() {
+	const auto context = this->currentHandleContext();
+	if (!context) {
+		qDebug() << "Processor::currentThreadPackage: not handling package in thread:" << QThread::currentThread();
 		return nullptr;
 	}
-	return *currentThreadConnect;
+	return context->package;
+}
+
+void Processor::deferReply() {
+	for (auto context = threadHandleContext(); context; context = context->previous) {
+		if (context->processor == this) {
+			context->replyDeferred = true;
+			return;
+		}
+	}
+	qDebug() << "Processor::deferReply: not handling package in thread:" << QThread::currentThread();
+}
+
+Processor::HandleContext*& Processor::threadHandleContext() {
+	static thread_local HandleContext* context = nullptr;
+	return context;
+}
+
+const Processor::HandleContext* Processor::currentHandleContext() const {
+	for (auto context = threadHandleContext(); context; context = context->previous) {
+		if (context->processor == this) {
+			return context;
+		}
+	}
+	return nullptr;
 }
 
 void Processor::deleteFileInfo(QFileInfo* ptr) {
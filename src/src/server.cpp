@@ -3,13 +3,18 @@
 
 #include <QDebug>
 #include <QTcpServer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpSocket>
 #include <QThread>
 #include <QMetaObject>
+#include <QHash>
 
 #include "package.h"
 #include "connectpool.h"
 #include "connect.h"
 #include "processor.h"
+#include "metrics.h"
 
 using namespace std;
 using namespace std::placeholders;
@@ -31,6 +36,24 @@ private:
 	std::function<void(qintptr socketDescriptor)> m_onIncomingConnectionCallback;
 };
 
+// LocalServerHelper
+// Hands the raw descriptor of an accepted Unix domain socket on, Connect wraps it like a TCP one
+class LocalServerHelper : public QLocalServer {
+public:
+	LocalServerHelper(const std::function<void(qintptr socketDescriptor)>& onIncomingConnectionCallback) :
+		m_onIncomingConnectionCallback(onIncomingConnectionCallback) {
+	}
+	~LocalServerHelper() override = default;
+
+private:
+	void incomingConnection(quintptr socketDescriptor) override {
+		m_onIncomingConnectionCallback(static_cast<qintptr>(socketDescriptor));
+	}
+
+private:
+	std::function<void(qintptr socketDescriptor)> m_onIncomingConnectionCallback;
+};
+
 // Server
 QWeakPointer<NetworkThreadPool> Server::m_globalServerThreadPool;
 QWeakPointer<NetworkThreadPool> Server::m_globalSocketThreadPool;
@@ -44,6 +67,11 @@ Server::Server(
 	m_serverSettings(serverSettings),
 	m_connectPoolSettings(connectPoolSettings),
 	m_connectSettings(connectSettings) {
+	if (!m_connectSettings->metrics) {
+		// A copy, the caller's settings may be shared with other servers or clients that keep no metrics
+		m_connectSettings.reset(new ConnectSettings(*connectSettings));
+		m_connectSettings->metrics.reset(new NetworkMetrics);
+	}
 }
 
 Server::~Server() {
@@ -56,6 +84,8 @@ Server::~Server() {
 		]() {
 			m_tcpServer->close();
 			m_tcpServer.clear();
+			m_metricsTcpServer.clear();
+			m_localServer.clear();
 		}
 			);
 	m_socketThreadPool->waitRunEach(
@@ -106,17 +136,6 @@ bool Server::begin() {
 		m_globalCallbackThreadPool = m_callbackThreadPool.toWeakRef();
 	}
 
-	if (!m_processors.isEmpty()) {
-		QSet<QThread*> receivedPossibleThreads;
-		m_callbackThreadPool->waitRunEach([&receivedPossibleThreads]() {
-			receivedPossibleThreads.insert(QThread::currentThread());
-			});
-
-		for (const auto& processor : m_processors) {
-			processor->setReceivedPossibleThreads(receivedPossibleThreads);
-		}
-	}
-
 	bool listenSucceed = false;
 	m_serverThreadPool->waitRun(
 		[this, &listenSucceed]() {
@@ -130,6 +149,54 @@ bool Server::begin() {
 		return false;
 	}
 
+#ifdef Q_OS_LINUX
+	if (m_serverSettings->localListenEnabled) {
+		auto localServerInUse = false;
+		m_serverThreadPool->waitRun(
+			[this, &listenSucceed, &localServerInUse]() {
+				const auto&& localServerName = Connect::localServerName(this->m_tcpServer->serverPort());
+				// Servers on other listenAddresses may share the TCP port, only a socket nobody answers on is stale
+				QLocalSocket probeSocket;
+				probeSocket.connectToServer(localServerName);
+				localServerInUse = probeSocket.waitForConnected(100);
+				if (localServerInUse) {
+					return;
+				}
+				QLocalServer::removeServer(localServerName);
+				this->m_localServer = QSharedPointer<QLocalServer>(new LocalServerHelper([this](auto socketDescriptor) {
+					this->incomingConnection(socketDescriptor);
+					}));
+				listenSucceed = this->m_localServer->listen(localServerName);
+			});
+		if (localServerInUse) {
+			qDebug() << "Server::begin: local socket served by another server, only TCP is used:"
+				<< Connect::localServerName(m_tcpServer->serverPort());
+		} else if (!listenSucceed) {
+			qDebug() << "Server::begin: local listen error:" << Connect::localServerName(m_tcpServer->serverPort());
+			return false;
+		}
+	}
+#endif
+
+	if (m_serverSettings->metricsPort) {
+		m_serverThreadPool->waitRun(
+			[this, &listenSucceed]() {
+				this->m_metricsTcpServer = QSharedPointer<QTcpServer>(new QTcpServer);
+				QObject::connect(this->m_metricsTcpServer.data(), &QTcpServer::newConnection,
+					this->m_metricsTcpServer.data(), [this]() {
+						this->onMetricsConnection();
+					});
+				listenSucceed = this->m_metricsTcpServer->listen(
+					this->m_serverSettings->listenAddress,
+					this->m_serverSettings->metricsPort
+				);
+			});
+		if (!listenSucceed) {
+			qDebug() << "Server::begin: metrics listen error, port:" << m_serverSettings->metricsPort;
+			return false;
+		}
+	}
+
 	m_socketThreadPool->waitRunEach(
 		[this]() {
 			QSharedPointer<ConnectPoolSettings> connectPoolSettings(
@@ -210,12 +277,269 @@ void Server::incomingConnection(const qintptr& socketDescriptor) {
 	);
 }
 
+bool Server::broadcast(
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData
+) {
+	NETWORK_THISNULL_CHECK("Server::broadcast", false);
+	if (!m_socketThreadPool) {
+		qDebug() << "Server::broadcast: this server need to begin:" << this;
+		return false;
+	}
+	const auto&& frame = this->encodeSharedFrame(targetActionFlag, payloadData, appendData);
+	if (!frame) {
+		return false;
+	}
+	m_socketThreadPool->runEach(
+		[
+			this,
+				frame
+		]() {
+			for (const auto& connect : this->m_connectPools[QThread::currentThread()]->connectedConnects()) {
+				if (!connect) {
+					continue;
+				}
+				connect->writeSharedFrame(
+					frame,
+					this->m_serverSettings->broadcastSlowConsumerBytes,
+					this->m_serverSettings->broadcastSlowConsumerPolicy
+				);
+			}
+		}
+			);
+	return true;
+}
+
+bool Server::multicast(
+	const QList<QPointer<Connect>>& connects,
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData
+) {
+	NETWORK_THISNULL_CHECK("Server::multicast", false);
+	if (!m_socketThreadPool) {
+		qDebug() << "Server::multicast: this server need to begin:" << this;
+		return false;
+	}
+	const auto&& frame = this->encodeSharedFrame(targetActionFlag, payloadData, appendData);
+	if (!frame) {
+		return false;
+	}
+	// Still one task per socket thread, each picks its own connects
+	QSharedPointer<QHash<QThread*, QList<QPointer<Connect>>>> connectsByThread(
+		new QHash<QThread*, QList<QPointer<Connect>>>);
+	for (const auto& connect : connects) {
+		if (connect) {
+			(*connectsByThread)[connect->thread()].push_back(connect);
+		}
+	}
+	m_socketThreadPool->runEach(
+		[
+			this,
+				frame,
+				connectsByThread
+		]() {
+			for (const auto& connect : connectsByThread->value(QThread::currentThread())) {
+				if (!connect) {
+					continue;
+				}
+				connect->writeSharedFrame(
+					frame,
+					this->m_serverSettings->broadcastSlowConsumerBytes,
+					this->m_serverSettings->broadcastSlowConsumerPolicy
+				);
+			}
+		}
+			);
+	return true;
+}
+
+void Server::subscribe(const QPointer<Connect>& connect, const QString& topic) {
+	NETWORK_THISNULL_CHECK("Server::subscribe");
+	if (!connect || !m_socketThreadPool) {
+		return;
+	}
+	const auto&& threadIndex = m_socketThreadPool->threadIndex(connect->thread());
+	const auto&& connectPool = m_connectPools.value(connect->thread());
+	if ((threadIndex == -1) || !connectPool) {
+		qDebug() << "Server::subscribe: connect not belongs to this server:" << connect.data();
+		return;
+	}
+	m_socketThreadPool->run(
+		[
+			connectPool,
+				connect,
+				topic
+		]() {
+			connectPool->subscribe(connect, topic);
+		},
+			threadIndex
+			);
+}
+
+void Server::unsubscribe(const QPointer<Connect>& connect, const QString& topic) {
+	NETWORK_THISNULL_CHECK("Server::unsubscribe");
+	if (!connect || !m_socketThreadPool) {
+		return;
+	}
+	const auto&& threadIndex = m_socketThreadPool->threadIndex(connect->thread());
+	const auto&& connectPool = m_connectPools.value(connect->thread());
+	if ((threadIndex == -1) || !connectPool) {
+		return;
+	}
+	m_socketThreadPool->run(
+		[
+			connectPool,
+				connect,
+				topic
+		]() {
+			connectPool->unsubscribe(connect, topic);
+		},
+			threadIndex
+			);
+}
+
+bool Server::publish(
+	const QString& topic,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData
+) {
+	NETWORK_THISNULL_CHECK("Server::publish", false);
+	if (!m_socketThreadPool) {
+		qDebug() << "Server::publish: this server need to begin:" << this;
+		return false;
+	}
+	const auto&& frame = this->encodeSharedFrame(topic, payloadData, appendData);
+	if (!frame) {
+		return false;
+	}
+	m_socketThreadPool->runEach(
+		[
+			this,
+				topic,
+				frame
+		]() {
+			const auto&& connectPool = this->m_connectPools.value(QThread::currentThread());
+			if (!connectPool) {
+				return;
+			}
+			for (const auto& connect : connectPool->topicSubscribers(topic)) {
+				connect->writeSharedFrame(
+					frame,
+					this->m_serverSettings->broadcastSlowConsumerBytes,
+					this->m_serverSettings->broadcastSlowConsumerPolicy
+				);
+			}
+		}
+			);
+	return true;
+}
+
+QSharedPointer<Package> Server::encodeSharedFrame(
+	const QString& targetActionFlag,
+	const QByteArray& payloadData,
+	const QVariantMap& appendData
+) {
+	// Compression follows the size limit only, the elapsed time threshold belongs to a single connect
+	const auto&& compressionPayloadData =
+		(m_connectSettings->packageCompressionThresholdForConnectSucceedElapsed != -1) &&
+		((m_connectSettings->packageCompressionMinimumBytes == -1) ||
+			(payloadData.size() >= m_connectSettings->packageCompressionMinimumBytes));
+	const auto&& packages = Package::createPayloadTransportPackages(
+		targetActionFlag,
+		payloadData,
+		appendData,
+		2000000001, // same randomFlag as putPayloadData, no reply is expected
+		-1, // one package, the receivers cannot pull the rest of a shared frame
+		compressionPayloadData
+	);
+	if (packages.size() != 1) {
+		qDebug() << "Server::encodeSharedFrame: createPayloadTransportPackages error";
+		return {};
+	}
+	const auto& frame = packages.first();
+	frame->setSendPriority(m_serverSettings->broadcastPriority);
+	if (m_connectSettings->packageChecksumEnabled) {
+		frame->computeChecksum();
+	}
+	frame->encodeFrame();
+	return frame;
+}
+
+QByteArray Server::metricsText() {
+	NETWORK_THISNULL_CHECK("Server::metricsText", QByteArray());
+	const auto& metrics = m_connectSettings->metrics;
+	auto connectCount = 0;
+	for (const auto& connectPool : m_connectPools) {
+		connectCount += connectPool->connectCount();
+	}
+	metrics->setGauge(NetworkMetrics::Connections, connectCount);
+	if (m_socketThreadPool) {
+		metrics->setGauge(NetworkMetrics::SocketThreads, m_socketThreadPool->threadCount());
+		metrics->setGauge(NetworkMetrics::SocketThreadQueueDepth, m_socketThreadPool->queuedCallbackCount());
+	}
+	if (m_callbackThreadPool) {
+		metrics->setGauge(NetworkMetrics::CallbackThreads, m_callbackThreadPool->threadCount());
+		metrics->setGauge(NetworkMetrics::CallbackThreadQueueDepth, m_callbackThreadPool->queuedCallbackCount());
+	}
+	return metrics->toPrometheusText();
+}
+
+void Server::onMetricsConnection() {
+	while (auto socket = m_metricsTcpServer->nextPendingConnection()) {
+		QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+			// One request per connection, answered once its header is complete
+			const auto&& request = socket->peek(socket->bytesAvailable());
+			if (!request.contains("\r\n\r\n")) {
+				if (request.size() > (16 * 1024)) {
+					socket->abort();
+				}
+				return;
+			}
+			socket->readAll();
+			const auto&& requestLine = request.left(request.indexOf("\r\n")).split(' ');
+			const auto&& path = requestLine.value(1);
+			const auto&& isMetricsRequest = (requestLine.value(0) == "GET") &&
+				((path == "/metrics") || path.startsWith("/metrics?"));
+			const auto&& body = (isMetricsRequest) ? (this->metricsText()) : (QByteArray("Not Found\n"));
+			socket->write(
+				"HTTP/1.1 " + QByteArray((isMetricsRequest) ? ("200 OK") : ("404 Not Found")) + "\r\n"
+				"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+				"Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+				"Connection: close\r\n"
+				"\r\n" + body
+			);
+			socket->disconnectFromHost();
+		});
+	}
+}
+
 void Server::onPackageReceived(const QPointer<Connect>& connect, const QPointer<ConnectPool>&, const QSharedPointer<Package>& package) {
 	if (m_processorCallbacks.isEmpty()) {
 		NETWORK_NULLPTR_CHECK(m_serverSettings->packageReceivedCallback);
+		if (m_connectSettings->tracer) {
+			m_connectSettings->tracer->trace(NetworkTracer::CallbackDispatched, package->randomFlag(), connect->connectId());
+		}
 		m_callbackThreadPool->run(
-			[connect, package, callback = m_serverSettings->packageReceivedCallback]() {
+			[
+				connect,
+				package,
+				callback = m_serverSettings->packageReceivedCallback,
+				metrics = m_connectSettings->metrics,
+				tracer = m_connectSettings->tracer,
+				connectId = connect->connectId(),
+				queuedTime = NetworkMetrics::nowMicroseconds()
+			]() {
+				metrics->observe(NetworkMetrics::CallbackQueueLatency, NetworkMetrics::nowMicroseconds() - queuedTime);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackStarted, package->randomFlag(), connectId);
+				}
 				callback(connect, package);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackFinished, package->randomFlag(), connectId);
+				}
 			});
 	} else {
 		if (package->targetActionFlag().isEmpty()) {
@@ -232,9 +556,27 @@ void Server::onPackageReceived(const QPointer<Connect>& connect, const QPointer<
 			return;
 		}
 
+		if (m_connectSettings->tracer) {
+			m_connectSettings->tracer->trace(NetworkTracer::CallbackDispatched, package->randomFlag(), connect->connectId());
+		}
 		m_callbackThreadPool->run(
-			[connect, package, callback = *it]() {
+			[
+				connect,
+				package,
+				callback = *it,
+				metrics = m_connectSettings->metrics,
+				tracer = m_connectSettings->tracer,
+				connectId = connect->connectId(),
+				queuedTime = NetworkMetrics::nowMicroseconds()
+			]() {
+				metrics->observe(NetworkMetrics::CallbackQueueLatency, NetworkMetrics::nowMicroseconds() - queuedTime);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackStarted, package->randomFlag(), connectId);
+				}
 				callback(connect, package);
+				if (tracer) {
+					tracer->trace(NetworkTracer::CallbackFinished, package->randomFlag(), connectId);
+				}
 			});
 	}
 }
@@ -0,0 +1,98 @@
+﻿
+#include "tracer.h"
+
+#include <algorithm>
+
+#include <QThread>
+
+#include "metrics.h"
+
+NetworkTracer::NetworkTracer(const int& capacity, const int& sampleInterval) :
+	m_capacity(1),
+	m_sampleInterval(qMax(1, sampleInterval)) {
+	while (m_capacity < static_cast<quint64>(qMax(1, capacity))) {
+		m_capacity <<= 1;
+	}
+	m_slots.reset(new Slot[m_capacity]);
+}
+
+QVector<NetworkTracer::Event> NetworkTracer::events() const {
+	QVector<Event> result;
+	const auto&& nextIndex = m_nextIndex.load(std::memory_order_acquire);
+	const auto&& firstIndex = (nextIndex > m_capacity) ? (nextIndex - m_capacity) : (0);
+	result.reserve(static_cast<int>(nextIndex - firstIndex));
+	for (auto index = firstIndex; index < nextIndex; ++index) {
+		const auto& slot = m_slots[index & (m_capacity - 1)];
+		const auto&& sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != (index + 1)) {
+			continue;
+		}
+		Event event;
+		event.time = slot.time.load(std::memory_order_relaxed);
+		event.threadId = slot.threadId.load(std::memory_order_relaxed);
+		event.connectId = slot.connectId.load(std::memory_order_relaxed);
+		event.randomFlag = slot.randomFlag.load(std::memory_order_relaxed);
+		event.stage = static_cast<Stage>(slot.stage.load(std::memory_order_relaxed));
+		// A writer that took the slot over while it was read leaves a different sequence behind
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+			continue;
+		}
+		result.push_back(event);
+	}
+	return result;
+}
+
+QByteArray NetworkTracer::toChromeTraceJson() const {
+	auto&& events = this->events();
+	std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+		if (a.connectId != b.connectId) {
+			return a.connectId < b.connectId;
+		}
+		return (a.randomFlag != b.randomFlag) ? (a.randomFlag < b.randomFlag) : (a.time < b.time);
+	});
+	QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (auto index = 0; index < events.size(); ++index) {
+		const auto& event = events[index];
+		const auto&& hasNext = ((index + 1) < events.size()) &&
+			(events[index + 1].connectId == event.connectId) && (events[index + 1].randomFlag == event.randomFlag);
+		const auto&& duration = (hasNext) ? (events[index + 1].time - event.time) : (0);
+		if (index) {
+			json += ",";
+		}
+		json += "{\"name\":\"" + QByteArray(stageName(event.stage)) + "\",\"cat\":\"network\",\"ph\":\"X\"";
+		json += ",\"ts\":" + QByteArray::number(event.time);
+		json += ",\"dur\":" + QByteArray::number(duration);
+		json += ",\"pid\":" + QByteArray::number(event.connectId) + ",\"tid\":" + QByteArray::number(event.randomFlag);
+		json += ",\"args\":{\"thread\":" + QByteArray::number(event.threadId) + "}}";
+	}
+	json += "]}";
+	return json;
+}
+
+const char* NetworkTracer::stageName(const Stage& stage) {
+	switch (stage) {
+		case Enqueued: return "enqueued";
+		case FirstByteWritten: return "first_byte_written";
+		case LastChunkWritten: return "last_chunk_written";
+		case FirstByteReceived: return "first_byte_received";
+		case ReassemblyComplete: return "reassembly_complete";
+		case CallbackDispatched: return "callback_dispatched";
+		case CallbackStarted: return "callback_started";
+		case CallbackFinished: return "callback_finished";
+		default: return "unknown";
+	}
+}
+
+void NetworkTracer::record(const Stage& stage, const qint32& randomFlag, const quint64& connectId) {
+	const auto&& index = m_nextIndex.fetch_add(1, std::memory_order_relaxed);
+	auto& slot = m_slots[index & (m_capacity - 1)];
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.time.store(NetworkMetrics::nowMicroseconds(), std::memory_order_relaxed);
+	slot.threadId.store(reinterpret_cast<quintptr>(QThread::currentThreadId()), std::memory_order_relaxed);
+	slot.connectId.store(connectId, std::memory_order_relaxed);
+	slot.randomFlag.store(randomFlag, std::memory_order_relaxed);
+	slot.stage.store(stage, std::memory_order_relaxed);
+	slot.sequence.store(index + 1, std::memory_order_release);
+}
@@ -5,6 +5,8 @@ NETWORK_COMPILE_MODE = SRC
 include( $$PWD/../../src/Network.pri )
 SOURCES += \
     $$PWD/cpp/main.cpp \
-    $$PWD/cpp/benchmark.cpp
+    $$PWD/cpp/benchmark.cpp \
+    $$PWD/cpp/latencyhistogram.cpp
 HEADERS += \
-    $$PWD/cpp/benchmark.h
+    $$PWD/cpp/benchmark.h \
+    $$PWD/cpp/latencyhistogram.h
@@ -1,260 +1,203 @@
 ﻿#include "benchmark.h"
 
-#include <QtTest>
-#include <QtConcurrent>
-#include <QTcpSocket>
+#include <chrono>
+
+#include <QSemaphore>
+#include <QThread>
 
 #include "network.h"
-void NetworkPersisteneTest::test1()
-{
-	auto server = Server::createServer(12345);
-	server->serverSettings()->packageReceivedCallback = [](const auto& connect, const auto& package)
-	{
-		connect->replyPayloadData(package->randomFlag(), "Test");
-	};
-	if (!server->begin())
-	{
-		qDebug() << "test1 error1";
-		return;
-	}
-	auto client = Client::createClient();
-	if (!client->begin())
-	{
-		qDebug() << "test1 error2";
-		return;
-	}
-	const auto&& waitForCreateConnectReply = client->waitForCreateConnect("127.0.0.1", 12345);
-	qDebug() << "waitForCreateConnect:" << waitForCreateConnectReply;
-	if (!waitForCreateConnectReply) { return; }
-	const auto&& startTime = QDateTime::currentMSecsSinceEpoch();
-	auto testCount = 1000000;
-	auto succeedCount = 0;
-	QSemaphore semaphore;
-	for (auto count = 0; count < testCount; ++count)
-	{
-		client->sendPayloadData(
-			"127.0.0.1",
-			12345,
-			"Test",
-			[ &testCount, &succeedCount, &semaphore ](const auto&, const auto&)
-			{
-				if (++succeedCount >= testCount)
-				{
-					semaphore.release(1);
-				}
-			},
-			nullptr
-		);
+
+namespace {
+
+enum BenchmarkPhase {
+	WarmupPhase = 0,
+	MeasurePhase,
+	StopPhase
+};
+
+struct BenchmarkState {
+	std::atomic<int> phase = { WarmupPhase };
+	std::atomic<qint64> inFlight = { 0 };
+	std::atomic<qint64> completed = { 0 };
+	std::atomic<qint64> errors = { 0 };
+	LatencyHistogram latency; // nanoseconds, measured requests only
+	QSemaphore drained;
+};
+
+inline qint64 nowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QByteArray benchmarkData(const int& size) {
+	// 16 symbols, compresses to roughly half, so --compression has something to do
+	QByteArray data(size, Qt::Uninitialized);
+	for (auto index = 0; index < size; ++index) {
+		data[index] = static_cast<char>('a' + (rand() % 16));
 	}
-	semaphore.acquire(1);
-	const auto&& finishTime = QDateTime::currentMSecsSinceEpoch();
-	qDebug() << QString("test1 finish: total: %1 ms, %2 count/s").
-	            arg(finishTime - startTime).
-	            arg(static_cast<int>(double(testCount) / ((finishTime - startTime) / 1000.0)));
+	return data;
 }
-void NetworkPersisteneTest::test2()
-{
-	QByteArray testData;
-	for (auto count = 0; count < 32 * 1024; ++count)
-	{
-		testData.append(static_cast<char>(rand() % 256));
+
+void applyConnectSettings(const QSharedPointer<ConnectSettings>& connectSettings, const BenchmarkOptions& options) {
+	connectSettings->packageCompressionThresholdForConnectSucceedElapsed = (options.compression) ? (0) : (-1);
+	connectSettings->packageCompressionMinimumBytes = (options.compression) ? (0) : (-1);
+	if (options.cutPackageSize > 0) {
+		connectSettings->cutPackageSize = options.cutPackageSize;
 	}
-	auto server = Server::createServer(23456);
-	server->serverSettings()->packageReceivedCallback = [ testData ](const auto& connect, const auto& package)
-	{
-		connect->replyPayloadData(package->randomFlag(), testData);
+	connectSettings->writeCoalescingEnabled = options.writeCoalescing;
+}
+
+void sendBenchmarkRequest(
+	const QSharedPointer<BenchmarkState>& state,
+	const QPointer<Connect>& connect,
+	const QByteArray& payloadData
+) {
+	const auto&& finish = [state, connect, payloadData]() {
+		if (state->phase.load(std::memory_order_relaxed) != StopPhase) {
+			sendBenchmarkRequest(state, connect, payloadData);
+			return;
+		}
+		if (state->inFlight.fetch_sub(1) == 1) {
+			state->drained.release(1);
+		}
 	};
-	if (!server->begin())
-	{
-		qDebug() << "test2 error1";
-		return;
-	}
-	auto client = Client::createClient();
-	if (!client->begin())
-	{
-		qDebug() << "test2 error2";
-		return;
-	}
-	const auto&& waitForCreateConnectReply = client->waitForCreateConnect("127.0.0.1", 23456);
-	qDebug() << "waitForCreateConnect:" << waitForCreateConnectReply;
-	if (!waitForCreateConnectReply) { return; }
-	const auto&& startTime = QDateTime::currentMSecsSinceEpoch();
-	auto testCount = 80000;
-	auto succeedCount = 0;
-	QSemaphore semaphore;
-	for (auto count = 0; count < testCount; ++count)
-	{
-		client->sendPayloadData(
-			"127.0.0.1",
-			23456,
-			testData,
-			[ &testCount, &succeedCount, &semaphore ](const auto&, const auto&)
-			{
-				if (++succeedCount >= testCount)
-				{
-					semaphore.release(1);
+	const auto&& sendTime = nowNanoseconds();
+	const auto&& randomFlag = (connect)
+		? (connect->sendPayloadData(
+			"benchmark",
+			payloadData,
+			QVariantMap(), // empty appendData
+			[state, finish, sendTime](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+				if (state->phase.load(std::memory_order_relaxed) == MeasurePhase) {
+					state->latency.record(nowNanoseconds() - sendTime);
+					state->completed.fetch_add(1, std::memory_order_relaxed);
 				}
+				finish();
 			},
-			nullptr
-		);
+			[state, finish](const QPointer<Connect>&) {
+				state->errors.fetch_add(1, std::memory_order_relaxed);
+				finish();
+			}))
+		: (0);
+	if (!randomFlag) {
+		// The connect is gone, this slot stops
+		state->errors.fetch_add(1, std::memory_order_relaxed);
+		if (state->inFlight.fetch_sub(1) == 1) {
+			state->drained.release(1);
+		}
 	}
-	semaphore.acquire(1);
-	const auto&& finishTime = QDateTime::currentMSecsSinceEpoch();
-	const auto&& result = static_cast<int>(double(testCount) / ((finishTime - startTime) / 1000.0));
-	qDebug() << QString("test2 finish: total: %1 ms, %2 count/s, payload transfer speed: %3 Mbit/s").
-	            arg(finishTime - startTime).
-	            arg(result).
-	            arg(result * 32 / 1024 * 8);
 }
-void NetworkPersisteneTest::test3()
-{
-	auto server = Server::createServer(34567);
-	server->serverSettings()->packageReceivedCallback = [](const auto& connect, const auto& package)
-	{
-		connect->replyPayloadData(package->randomFlag(), "Test");
+
+}
+
+QJsonObject BenchmarkOptions::toJson() const {
+	QJsonObject json;
+	json["mode"] = mode;
+	json["host"] = host;
+	json["port"] = port;
+	json["payloadSize"] = payloadSize;
+	json["replySize"] = replySize;
+	json["concurrency"] = concurrency;
+	json["connections"] = connections;
+	json["compression"] = compression;
+	json["cutPackageSize"] = cutPackageSize;
+	json["writeCoalescing"] = writeCoalescing;
+	json["warmupSeconds"] = warmupSeconds;
+	json["durationSeconds"] = durationSeconds;
+	return json;
+}
+
+NetworkBenchmark::NetworkBenchmark(const BenchmarkOptions& options) :
+	m_options(options) {
+}
+
+QSharedPointer<Server> NetworkBenchmark::startServer() const {
+	auto server = Server::createServer(m_options.port, QHostAddress::Any);
+	applyConnectSettings(server->connectSettings(), m_options);
+	server->serverSettings()->packageReceivedCallback = [replyData = benchmarkData(m_options.replySize)](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), replyData);
 	};
-	if (!server->begin())
-	{
-		qDebug() << "test3 error1";
-		return;
-	}
-	auto client = Client::createClient();
-	if (!client->begin())
-	{
-		qDebug() << "test3 error2";
-		return;
+	if (!server->begin()) {
+		qDebug() << "NetworkBenchmark::startServer: listen error, port:" << m_options.port;
+		return {};
 	}
-	const auto&& waitForCreateConnectReply = client->waitForCreateConnect("127.0.0.1", 34567);
-	qDebug() << "waitForCreateConnect:" << waitForCreateConnectReply;
-	if (!waitForCreateConnectReply) { return; }
-	const auto&& startTime = QDateTime::currentMSecsSinceEpoch();
-	auto testCount = 400000;
-	auto succeedCount = 0;
-	QSemaphore semaphore;
-	std::function<void()> ping;
-	ping = [ &testCount, &succeedCount, &semaphore, &ping, &client ]()
-	{
-		client->sendPayloadData(
-			"127.0.0.1",
-			34567,
-			"Test",
-			[ &testCount, &succeedCount, &semaphore, &ping ](const auto&, const auto&)
-			{
-				if (++succeedCount >= testCount)
-				{
-					semaphore.release(1);
-				}
-				else
-				{
-					ping();
-				}
-			},
-			nullptr
-		);
-	};
-	ping();
-	semaphore.acquire(1);
-	const auto&& finishTime = QDateTime::currentMSecsSinceEpoch();
-	qDebug() << QString("test3 finish: total: %1 ms, %2 PingPong/s").
-	            arg(finishTime - startTime).
-	            arg(static_cast<int>(double(testCount) / ((finishTime - startTime) / 1000.0)));
+	return server;
 }
-void NetworkPersisteneTest::test4()
-{
-	QByteArray testData;
-	for (auto count = 0; count < 32 * 1024; ++count)
-	{
-		testData.append(static_cast<char>(rand() % 256));
+
+QJsonObject NetworkBenchmark::run() const {
+	auto client = Client::createClient();
+	applyConnectSettings(client->connectSettings(), m_options);
+	if (!client->begin()) {
+		qDebug() << "NetworkBenchmark::run: client begin error";
+		return {};
 	}
-	auto server = Server::createServer(45678);
-	server->serverSettings()->packageReceivedCallback = [ testData ](const auto& connect, const auto& package)
-	{
-		connect->replyPayloadData(package->randomFlag(), testData);
-	};
-	if (!server->begin())
-	{
-		qDebug() << "test4 error1";
-		return;
+	QVector<QPointer<Connect>> connects;
+	for (auto connectIndex = 0; connectIndex < m_options.connections; ++connectIndex) {
+		if (!client->waitForCreateConnect(m_options.host, m_options.port, -1, connectIndex)) {
+			qDebug() << "NetworkBenchmark::run: connect error, index:" << connectIndex;
+			return {};
+		}
+		connects.push_back(client->getConnect(m_options.host, m_options.port, connectIndex));
 	}
-	auto client = Client::createClient();
-	if (!client->begin())
-	{
-		qDebug() << "test4 error2";
-		return;
+	const auto&& payloadData = benchmarkData(m_options.payloadSize);
+	QSharedPointer<BenchmarkState> state(new BenchmarkState);
+	state->inFlight = connects.size() * m_options.concurrency;
+	for (const auto& connect : connects) {
+		for (auto index = 0; index < m_options.concurrency; ++index) {
+			sendBenchmarkRequest(state, connect, payloadData);
+		}
 	}
-	const auto&& waitForCreateConnectReply = client->waitForCreateConnect("127.0.0.1", 45678);
-	qDebug() << "waitForCreateConnect:" << waitForCreateConnectReply;
-	if (!waitForCreateConnectReply) { return; }
-	const auto&& startTime = QDateTime::currentMSecsSinceEpoch();
-	auto testCount = 250000;
-	auto succeedCount = 0;
-	QSemaphore semaphore;
-	std::function<void()> ping;
-	ping = [ &testCount, &succeedCount, &semaphore, &ping, &client, testData ]()
-	{
-		client->sendPayloadData(
-			"127.0.0.1",
-			45678,
-			testData,
-			[ &testCount, &succeedCount, &semaphore, &ping ](const auto&, const auto&)
-			{
-				if (++succeedCount >= testCount)
-				{
-					semaphore.release(1);
-				}
-				else
-				{
-					ping();
-				}
-			},
-			nullptr
-		);
-	};
-	ping();
-	semaphore.acquire(1);
-	const auto&& finishTime = QDateTime::currentMSecsSinceEpoch();
-	const auto&& result = static_cast<int>(double(testCount) / ((finishTime - startTime) / 1000.0));
-	qDebug() << QString("test4 finish: total: %1 ms, %2 PingPong/s, payload transfer speed: %3 Mbit/s").
-	            arg(finishTime - startTime).
-	            arg(result).
-	            arg(result * 32 / 1024 * 8);
-}
-void NetworkPersisteneTest::test5()
-{
-	static QByteArray testData;
-	for (auto count = 0; count < 512 * 1024 * 1024; ++count)
-	{
-		testData.append(static_cast<char>(rand() % 256));
+	QThread::msleep(static_cast<unsigned long>(m_options.warmupSeconds) * 1000);
+	qint64 startSocketWriteCount = 0;
+	qint64 startSentPackageCount = 0;
+	for (const auto& connect : connects) {
+		if (connect) {
+			startSocketWriteCount += connect->socketWriteCount();
+			startSentPackageCount += connect->sentPackageCount();
+		}
 	}
-	auto server = Server::createServer(56789);
-	QSemaphore semaphore;
-	server->serverSettings()->packageReceivedCallback = [ &semaphore ](const auto&, const auto&)
-	{
-		semaphore.release(1);
-	};
-	if (!server->begin())
-	{
-		qDebug() << "test5 error1";
-		return;
+	const auto&& startTime = nowNanoseconds();
+	state->phase = MeasurePhase;
+	QThread::msleep(static_cast<unsigned long>(m_options.durationSeconds) * 1000);
+	state->phase = StopPhase;
+	const auto&& elapsedSeconds = static_cast<double>(nowNanoseconds() - startTime) / 1000000000.0;
+	qint64 socketWriteCount = -startSocketWriteCount;
+	qint64 sentPackageCount = -startSentPackageCount;
+	for (const auto& connect : connects) {
+		if (connect) {
+			socketWriteCount += connect->socketWriteCount();
+			sentPackageCount += connect->sentPackageCount();
+		}
 	}
-	auto client = Client::createClient();
-	if (!client->begin())
-	{
-		qDebug() << "test5 error2";
-		return;
+	if (!state->drained.tryAcquire(1, 30 * 1000)) {
+		qDebug() << "NetworkBenchmark::run: requests still in flight:" << state->inFlight.load();
 	}
-	const auto&& waitForCreateConnectReply = client->waitForCreateConnect("127.0.0.1", 56789);
-	qDebug() << "waitForCreateConnect:" << waitForCreateConnectReply;
-	if (!waitForCreateConnectReply) { return; }
-	const auto&& startTime = QDateTime::currentMSecsSinceEpoch();
-	client->sendPayloadData(
-		"127.0.0.1",
-		56789,
-		testData
-	);
-	semaphore.acquire(1);
-	const auto&& finishTime = QDateTime::currentMSecsSinceEpoch();
-	qDebug() << QString("test5 finish: total: %1 ms, payload transfer speed: %2 Mbit/s").
-	            arg(finishTime - startTime).
-	            arg(static_cast<int>(512.0 / ((finishTime - startTime) / 1000.0) * 8));
+	const auto&& completed = state->completed.load();
+	const auto& latency = state->latency;
+	const auto&& toMicroseconds = [](const qint64& nanoseconds) {
+		return static_cast<double>(nanoseconds) / 1000.0;
+	};
+	QJsonObject latencyJson;
+	latencyJson["min"] = toMicroseconds(latency.minimum());
+	latencyJson["mean"] = latency.mean() / 1000.0;
+	latencyJson["p50"] = toMicroseconds(latency.valueAtPercentile(50));
+	latencyJson["p90"] = toMicroseconds(latency.valueAtPercentile(90));
+	latencyJson["p99"] = toMicroseconds(latency.valueAtPercentile(99));
+	latencyJson["p99.9"] = toMicroseconds(latency.valueAtPercentile(99.9));
+	latencyJson["max"] = toMicroseconds(latency.maximum());
+	QJsonObject result;
+	result["version"] = NETWORK_VERSIONNUMBER.toString();
+	result["options"] = m_options.toJson();
+	result["elapsedSeconds"] = elapsedSeconds;
+	result["requests"] = completed;
+	result["errors"] = state->errors.load();
+	result["requestsPerSecond"] = completed / elapsedSeconds;
+	result["payloadMegabitsPerSecond"] =
+		(static_cast<double>(completed) * (m_options.payloadSize + m_options.replySize) * 8) / elapsedSeconds / 1000000.0;
+	result["socketWritesPerPackage"] = (sentPackageCount > 0)
+		? (static_cast<double>(socketWriteCount) / sentPackageCount)
+		: (0.0);
+	result["latencyMicroseconds"] = latencyJson;
+	return result;
 }
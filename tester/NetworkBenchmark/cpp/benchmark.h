@@ -1,17 +1,48 @@
 ﻿#ifndef __CPP_Network_BENCHMARK_H__
 #define __CPP_Network_BENCHMARK_H__
 
-#include <QObject>
-class NetworkPersisteneTest : public QObject {
-	Q_OBJECT
-	Q_DISABLE_COPY(NetworkPersisteneTest)
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "latencyhistogram.h"
+
+class Server;
+
+struct BenchmarkOptions {
+	QString mode = "both"; // both: server and client in this process, server: serve until killed, client: connect to host
+	QString host = "127.0.0.1";
+	quint16 port = 12345;
+	int payloadSize = 4; // request bytes
+	int replySize = 4; // reply bytes
+	int concurrency = 1; // requests in flight per connection, 1 is ping pong
+	int connections = 1;
+	bool compression = false;
+	qint64 cutPackageSize = -1; // -1: ConnectSettings default
+	bool writeCoalescing = false;
+	int warmupSeconds = 2;
+	int durationSeconds = 10;
+
+	QJsonObject toJson() const;
+};
+
+class NetworkBenchmark {
+	Q_DISABLE_COPY(NetworkBenchmark)
+
 public:
-	NetworkPersisteneTest() = default;
-	~NetworkPersisteneTest() override = default;
-	void test1();
-	void test2();
-	void test3();
-	void test4();
-	void test5();
+	explicit NetworkBenchmark(const BenchmarkOptions& options);
+
+	~NetworkBenchmark() = default;
+
+	// Replies replySize bytes to every request
+	QSharedPointer<Server> startServer() const;
+
+	// Keeps concurrency requests in flight on every connection for warmup plus duration seconds, only the
+	// duration is measured. Empty on a connect error
+	QJsonObject run() const;
+
+private:
+	BenchmarkOptions m_options;
 };
+
 #endif//__CPP_Network_BENCHMARK_H__
@@ -0,0 +1,60 @@
+﻿#include "latencyhistogram.h"
+
+#include <limits>
+
+#include <QtAlgorithms>
+
+LatencyHistogram::LatencyHistogram() :
+	m_counts(new std::atomic<qint64>[BucketCount]),
+	m_minimum(std::numeric_limits<qint64>::max()) {
+	for (auto index = 0; index < BucketCount; ++index) {
+		m_counts[index].store(0, std::memory_order_relaxed);
+	}
+}
+
+void LatencyHistogram::record(const qint64& value) {
+	const auto&& clampedValue = qMax(qint64(0), value);
+	m_counts[bucketIndex(clampedValue)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(clampedValue, std::memory_order_relaxed);
+	auto minimum = m_minimum.load(std::memory_order_relaxed);
+	while ((clampedValue < minimum) && !m_minimum.compare_exchange_weak(minimum, clampedValue, std::memory_order_relaxed)) {
+	}
+	auto maximum = m_maximum.load(std::memory_order_relaxed);
+	while ((clampedValue > maximum) && !m_maximum.compare_exchange_weak(maximum, clampedValue, std::memory_order_relaxed)) {
+	}
+}
+
+qint64 LatencyHistogram::valueAtPercentile(const double& percentile) const {
+	const auto&& count = this->count();
+	if (!count) {
+		return 0;
+	}
+	const auto&& targetCount = qMax(qint64(1), static_cast<qint64>((qBound(0.0, percentile, 100.0) / 100.0) * count + 0.5));
+	qint64 cumulativeCount = 0;
+	for (auto index = 0; index < BucketCount; ++index) {
+		cumulativeCount += m_counts[index].load(std::memory_order_relaxed);
+		if (cumulativeCount >= targetCount) {
+			return qMin(bucketHighestValue(index), this->maximum());
+		}
+	}
+	return this->maximum();
+}
+
+int LatencyHistogram::bucketIndex(const qint64& value) {
+	if (value < SubBucketCount) {
+		return static_cast<int>(value);
+	}
+	// Above the first bucket each power of two is split into SubBucketHalfCount linear steps
+	const auto&& shift = (64 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(value)))) - SubBucketBits;
+	return SubBucketCount + ((shift - 1) * SubBucketHalfCount) + static_cast<int>((value >> shift) - SubBucketHalfCount);
+}
+
+qint64 LatencyHistogram::bucketHighestValue(const int& index) {
+	if (index < SubBucketCount) {
+		return index;
+	}
+	const auto&& shift = ((index - SubBucketCount) / SubBucketHalfCount) + 1;
+	const auto&& subBucket = static_cast<qint64>(((index - SubBucketCount) % SubBucketHalfCount) + SubBucketHalfCount);
+	return ((subBucket + 1) << shift) - 1;
+}
@@ -0,0 +1,57 @@
+﻿#ifndef __CPP_Network_LATENCYHISTOGRAM_H__
+#define __CPP_Network_LATENCYHISTOGRAM_H__
+
+#include <atomic>
+#include <memory>
+
+#include <QtGlobal>
+
+// HDR style histogram, values keep 3 significant digits from 1 ns up to qint64 max. Recording is a few relaxed
+// atomic operations, safe from any number of callback threads
+class LatencyHistogram {
+	Q_DISABLE_COPY(LatencyHistogram)
+
+public:
+	LatencyHistogram();
+
+	~LatencyHistogram() = default;
+
+	void record(const qint64& value);
+
+	inline qint64 count() const {
+		return m_count.load(std::memory_order_relaxed);
+	}
+
+	inline qint64 minimum() const {
+		return (this->count()) ? (m_minimum.load(std::memory_order_relaxed)) : (0);
+	}
+
+	inline qint64 maximum() const {
+		return m_maximum.load(std::memory_order_relaxed);
+	}
+
+	inline double mean() const {
+		return (this->count()) ? (static_cast<double>(m_sum.load(std::memory_order_relaxed)) / this->count()) : (0);
+	}
+
+	// Highest value equivalent to the recorded value at percentile, 0..100
+	qint64 valueAtPercentile(const double& percentile) const;
+
+private:
+	static int bucketIndex(const qint64& value);
+
+	static qint64 bucketHighestValue(const int& index);
+
+	static constexpr int SubBucketBits = 11;
+	static constexpr int SubBucketCount = 1 << SubBucketBits;
+	static constexpr int SubBucketHalfCount = SubBucketCount / 2;
+	static constexpr int BucketCount = SubBucketCount + (64 - SubBucketBits - 1) * SubBucketHalfCount;
+
+	std::unique_ptr<std::atomic<qint64>[]> m_counts;
+	std::atomic<qint64> m_count = { 0 };
+	std::atomic<qint64> m_sum = { 0 };
+	std::atomic<qint64> m_minimum;
+	std::atomic<qint64> m_maximum = { 0 };
+};
+
+#endif//__CPP_Network_LATENCYHISTOGRAM_H__
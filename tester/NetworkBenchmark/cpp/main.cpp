@@ -1,48 +1,84 @@
 
+#include <QCommandLineParser>
 #include <QCoreApplication>
-#include <QtTest>
+#include <QFile>
+#include <QJsonDocument>
 
-#include "foundation.h"
+#include "network.h"
 
 #include "benchmark.h"
+// The former fixed tests as flags:
+//   pipelined 4 bytes:        --concurrency 1000
+//   pipelined 32 KB:          --concurrency 1000 --payload-size 32768 --reply-size 32768
+//   ping pong 4 bytes:        (defaults)
+//   ping pong 32 KB:          --payload-size 32768 --reply-size 32768
+//   write coalescing:         --concurrency 1000 --write-coalescing
 int main(int argc, char* argv[]) {
-    QCoreApplication app(argc, argv);
-    Network::printVersionInformation();
-    NetworkPersisteneTest benchmark;
-    qDebug() << "----- test1 start -----";
-    benchmark.test1();
-    qDebug() << "----- test1 end -----";
-    qDebug() << "----- test2 start -----";
-    benchmark.test2();
-    qDebug() << "----- test2 end -----";
-    qDebug() << "----- test3 start -----";
-    benchmark.test3();
-    qDebug() << "----- test3 end -----";
-    qDebug() << "----- test4 start -----";
-    benchmark.test4();
-    qDebug() << "----- test4 end -----";
-    qDebug() << "----- test5 start -----";
-    benchmark.test5();
-    qDebug() << "----- test5 end -----";
-    //    QFile file( "/Users/Jason/Desktop/Test.psd" );
-    //    file.open( QIODevice::ReadOnly );
-    //    const auto &&sourceData = file.readAll();
-    //    qDebug() << sourceData.size();
-    //    auto test = [ & ]( const int &level )
-    //    {
-    //        const auto &&startTime = QDateTime::currentMSecsSinceEpoch();
-    //        const auto &&result = qCompress( sourceData, level ).size();
-    //        qDebug() << "level:" << level << result << ( QDateTime::currentMSecsSinceEpoch() -
-    //        startTime );
-    //    };
-    //    test( -1 );
-    //    test( 1 );
-    //    test( 2 );
-    //    test( 3 );
-    //    test( 4 );
-    //    test( 5 );
-    //    test( 6 );
-    //    test( 7 );
-    //    test( 8 );
-    //    test( 9 );
+	QCoreApplication app(argc, argv);
+	Network::printVersionInformation();
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Request and reply benchmark, prints the result as JSON");
+	parser.addHelpOption();
+	BenchmarkOptions options;
+	parser.addOptions({
+		{ "mode", "both, server or client.", "mode", options.mode },
+		{ "host", "Server host in client mode.", "host", options.host },
+		{ "port", "Server port.", "port", QString::number(options.port) },
+		{ "payload-size", "Request payload bytes.", "bytes", QString::number(options.payloadSize) },
+		{ "reply-size", "Reply payload bytes.", "bytes", QString::number(options.replySize) },
+		{ "concurrency", "Requests in flight per connection.", "count", QString::number(options.concurrency) },
+		{ "connections", "Connections to the server.", "count", QString::number(options.connections) },
+		{ "compression", "Compress every payload." },
+		{ "cut-package-size", "Bytes per package, -1: default.", "bytes", QString::number(options.cutPackageSize) },
+		{ "write-coalescing", "Coalesce small writes." },
+		{ "warmup", "Seconds before measuring.", "seconds", QString::number(options.warmupSeconds) },
+		{ "duration", "Seconds measured.", "seconds", QString::number(options.durationSeconds) },
+		{ "output", "Write the JSON to this file instead of stdout.", "file" }
+	});
+	parser.process(app);
+	options.mode = parser.value("mode");
+	options.host = parser.value("host");
+	options.port = static_cast<quint16>(parser.value("port").toUInt());
+	options.payloadSize = qMax(0, parser.value("payload-size").toInt());
+	options.replySize = qMax(0, parser.value("reply-size").toInt());
+	options.concurrency = qMax(1, parser.value("concurrency").toInt());
+	options.connections = qMax(1, parser.value("connections").toInt());
+	options.compression = parser.isSet("compression");
+	options.cutPackageSize = parser.value("cut-package-size").toLongLong();
+	options.writeCoalescing = parser.isSet("write-coalescing");
+	options.warmupSeconds = qMax(0, parser.value("warmup").toInt());
+	options.durationSeconds = qMax(1, parser.value("duration").toInt());
+	if ((options.mode != "both") && (options.mode != "server") && (options.mode != "client")) {
+		qDebug() << "unknown mode:" << options.mode;
+		return 1;
+	}
+	NetworkBenchmark benchmark(options);
+	QSharedPointer<Server> server;
+	if (options.mode != "client") {
+		server = benchmark.startServer();
+		if (!server) {
+			return 1;
+		}
+		if (options.mode == "server") {
+			return app.exec();
+		}
+	}
+	const auto&& result = benchmark.run();
+	if (result.isEmpty()) {
+		return 1;
+	}
+	const auto&& json = QJsonDocument(result).toJson(QJsonDocument::Indented);
+	QFile output;
+	auto opened = false;
+	if (parser.isSet("output")) {
+		output.setFileName(parser.value("output"));
+		opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+	} else {
+		opened = output.open(stdout, QIODevice::WriteOnly);
+	}
+	if (!opened || (output.write(json) != json.size())) {
+		qDebug() << "write error:" << output.fileName();
+		return 1;
+	}
+	return 0;
 }
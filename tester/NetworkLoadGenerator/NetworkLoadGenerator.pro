@@ -0,0 +1,13 @@
+QT += core
+TEMPLATE = app
+NETWORK_COMPILE_MODE = SRC
+include( $$PWD/../../src/Network.pri )
+INCLUDEPATH += \
+    $$PWD/../NetworkBenchmark/cpp
+SOURCES += \
+    $$PWD/cpp/main.cpp \
+    $$PWD/cpp/loadgenerator.cpp \
+    $$PWD/../NetworkBenchmark/cpp/latencyhistogram.cpp
+HEADERS += \
+    $$PWD/cpp/loadgenerator.h \
+    $$PWD/../NetworkBenchmark/cpp/latencyhistogram.h
@@ -0,0 +1,257 @@
+﻿#include "loadgenerator.h"
+
+#include <chrono>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#   include <sys/resource.h>
+#endif
+
+#include "network.h"
+#include "latencyhistogram.h"
+
+namespace {
+
+struct StepState {
+	std::atomic<qint64> sent = { 0 };
+	std::atomic<qint64> replies = { 0 };
+	std::atomic<qint64> errors = { 0 };
+	LatencyHistogram latency; // nanoseconds
+};
+
+inline qint64 nowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QByteArray loadData(const int& size) {
+	QByteArray data(size, Qt::Uninitialized);
+	for (auto index = 0; index < size; ++index) {
+		data[index] = static_cast<char>('a' + (rand() % 16));
+	}
+	return data;
+}
+
+}
+
+QJsonObject LoadGeneratorOptions::toJson() const {
+	QJsonObject json;
+	json["mode"] = mode;
+	json["host"] = host;
+	json["port"] = port;
+	json["connections"] = connections;
+	json["connectionStep"] = connectionStep;
+	json["stepSeconds"] = stepSeconds;
+	json["thinkTime"] = thinkTime;
+	json["payloadSize"] = payloadSize;
+	json["replySize"] = replySize;
+	json["sourceAddress"] = sourceAddress;
+	json["sourceAddressCount"] = sourceAddressCount;
+	json["socketThreadCount"] = socketThreadCount;
+	return json;
+}
+
+NetworkLoadGenerator::NetworkLoadGenerator(const LoadGeneratorOptions& options) :
+	m_options(options),
+	m_payloadData(loadData(options.payloadSize)) {
+}
+
+NetworkLoadGenerator::~NetworkLoadGenerator() {
+	// Connects first, the server should not see them as failures while it is torn down
+	m_connects.clear();
+	m_clients.clear();
+	m_server.clear();
+}
+
+bool NetworkLoadGenerator::startServer() {
+	m_server = Server::createServer(m_options.port, QHostAddress::Any);
+	m_server->serverSettings()->packageReceivedCallback = [replyData = loadData(m_options.replySize)](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), replyData);
+	};
+	if (!m_server->begin()) {
+		qDebug() << "NetworkLoadGenerator::startServer: listen error, port:" << m_options.port;
+		m_server.clear();
+		return false;
+	}
+	return true;
+}
+
+bool NetworkLoadGenerator::begin() {
+	const QHostAddress firstSourceAddress(m_options.sourceAddress);
+	if (firstSourceAddress.protocol() != QAbstractSocket::IPv4Protocol) {
+		qDebug() << "NetworkLoadGenerator::begin: source address is not IPv4:" << m_options.sourceAddress;
+		return false;
+	}
+	for (auto index = 0; index < m_options.sourceAddressCount; ++index) {
+		auto client = Client::createClient();
+		client->clientSettings()->globalSocketThreadCount = m_options.socketThreadCount;
+		client->clientSettings()->autoCreateConnect = false;
+		client->connectSettings()->localAddress = QHostAddress(firstSourceAddress.toIPv4Address() + index);
+		client->connectSettings()->packageCompressionThresholdForConnectSucceedElapsed = -1;
+		if (!client->begin()) {
+			qDebug() << "NetworkLoadGenerator::begin: client begin error";
+			return false;
+		}
+		m_clients.push_back(client);
+	}
+	m_baselineResidentSetBytes = residentSetBytes(this->reportedPid());
+	return true;
+}
+
+int NetworkLoadGenerator::growTo(const int& connectionCount) {
+	// A failing source address is dropped instead of retried on every later step
+	QVector<bool> clientFailed(m_clients.size(), false);
+	auto failedClientCount = 0;
+	while ((m_connects.size() < connectionCount) && (failedClientCount < m_clients.size())) {
+		const auto&& clientIndex = m_nextConnectIndex % m_clients.size();
+		const auto&& connectIndex = m_nextConnectIndex / m_clients.size();
+		++m_nextConnectIndex;
+		if (clientFailed[clientIndex]) {
+			continue;
+		}
+		const auto& client = m_clients[clientIndex];
+		if (!client->waitForCreateConnect(m_options.host, m_options.port, -1, connectIndex)) {
+			++m_connectFailures;
+			clientFailed[clientIndex] = true;
+			++failedClientCount;
+			qDebug() << "NetworkLoadGenerator::growTo: connect error, source address:"
+				<< client->connectSettings()->localAddress.toString() << ", open connects:" << m_connects.size();
+			continue;
+		}
+		m_connects.push_back(client->getConnect(m_options.host, m_options.port, connectIndex));
+	}
+	return m_connects.size();
+}
+
+QJsonObject NetworkLoadGenerator::measure() {
+	QSharedPointer<StepState> state(new StepState);
+	const auto&& serverReceivedPackages = (m_server)
+		? (m_server->metrics()->counter(NetworkMetrics::ReceivedPackages))
+		: (0);
+	// Every connect sends once per thinkTime, spread evenly by walking the connects round robin
+	const auto&& requestsPerNanosecond = (m_options.thinkTime > 0)
+		? (static_cast<double>(m_connects.size()) / (static_cast<double>(m_options.thinkTime) * 1000000.0))
+		: (0.0);
+	auto sendCredit = 0.0;
+	auto lastTickTime = nowNanoseconds();
+	const auto&& startTime = lastTickTime;
+	QEventLoop eventLoop;
+	QTimer timerForSend;
+	QObject::connect(&timerForSend, &QTimer::timeout, [&]() {
+		const auto&& tickTime = nowNanoseconds();
+		sendCredit += static_cast<double>(tickTime - lastTickTime) * requestsPerNanosecond;
+		lastTickTime = tickTime;
+		for (; (sendCredit >= 1.0) && !m_connects.isEmpty(); sendCredit -= 1.0) {
+			const auto& connect = m_connects[m_sendIndex];
+			m_sendIndex = (m_sendIndex + 1) % m_connects.size();
+			if (!connect) {
+				state->errors.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			const auto&& sendTime = nowNanoseconds();
+			state->sent.fetch_add(1, std::memory_order_relaxed);
+			connect->sendPayloadData(
+				"load",
+				m_payloadData,
+				QVariantMap(), // empty appendData
+				[state, sendTime](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+					state->latency.record(nowNanoseconds() - sendTime);
+					state->replies.fetch_add(1, std::memory_order_relaxed);
+				},
+				[state](const QPointer<Connect>&) {
+					state->errors.fetch_add(1, std::memory_order_relaxed);
+				}
+			);
+		}
+	});
+	timerForSend.start(1);
+	QTimer::singleShot(m_options.stepSeconds * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	timerForSend.stop();
+	const auto&& elapsedSeconds = static_cast<double>(nowNanoseconds() - startTime) / 1000000000.0;
+	const auto& latency = state->latency;
+	const auto&& toMicroseconds = [](const qint64& nanoseconds) {
+		return static_cast<double>(nanoseconds) / 1000.0;
+	};
+	QJsonObject latencyJson;
+	latencyJson["p50"] = toMicroseconds(latency.valueAtPercentile(50));
+	latencyJson["p99"] = toMicroseconds(latency.valueAtPercentile(99));
+	latencyJson["p99.9"] = toMicroseconds(latency.valueAtPercentile(99.9));
+	latencyJson["max"] = toMicroseconds(latency.maximum());
+	const auto&& pid = this->reportedPid();
+	const auto&& currentResidentSetBytes = residentSetBytes(pid);
+	QJsonObject result;
+	result["connections"] = m_connects.size();
+	result["connectFailures"] = m_connectFailures;
+	result["elapsedSeconds"] = elapsedSeconds;
+	result["requestsPerSecond"] = state->sent.load() / elapsedSeconds;
+	result["repliesPerSecond"] = state->replies.load() / elapsedSeconds;
+	result["errors"] = state->errors.load();
+	if (m_server) {
+		result["serverPackagesPerSecond"] =
+			(m_server->metrics()->counter(NetworkMetrics::ReceivedPackages) - serverReceivedPackages) / elapsedSeconds;
+	}
+	result["latencyMicroseconds"] = latencyJson;
+	result["residentSetBytes"] = currentResidentSetBytes;
+	// Both ends of every connection when the server runs in this process, with --think-time 0 the idle cost
+	if ((currentResidentSetBytes != -1) && (m_baselineResidentSetBytes != -1) && !m_connects.isEmpty()) {
+		result["residentBytesPerConnection"] =
+			static_cast<double>(currentResidentSetBytes - m_baselineResidentSetBytes) / m_connects.size();
+	}
+	result["openFiles"] = openFileCount(pid);
+	return result;
+}
+
+qint64 NetworkLoadGenerator::residentSetBytes(const qint64& pid) {
+#ifdef Q_OS_LINUX
+	QFile file(QString("/proc/%1/status").arg(pid));
+	if (!file.open(QIODevice::ReadOnly)) {
+		return -1;
+	}
+	for (const auto& line : file.readAll().split('\n')) {
+		if (line.startsWith("VmRSS:")) {
+			// "VmRSS:	  123456 kB"
+			return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+		}
+	}
+#else
+	Q_UNUSED(pid)
+#endif
+	return -1;
+}
+
+int NetworkLoadGenerator::openFileCount(const qint64& pid) {
+#ifdef Q_OS_LINUX
+	const QDir dir(QString("/proc/%1/fd").arg(pid));
+	if (!dir.exists()) {
+		return -1;
+	}
+	return static_cast<int>(dir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).size());
+#else
+	Q_UNUSED(pid)
+	return -1;
+#endif
+}
+
+qint64 NetworkLoadGenerator::raiseOpenFileLimit() {
+#ifdef Q_OS_LINUX
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit)) {
+		return -1;
+	}
+	limit.rlim_cur = limit.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &limit)) {
+		qDebug() << "NetworkLoadGenerator::raiseOpenFileLimit: setrlimit error";
+	}
+	getrlimit(RLIMIT_NOFILE, &limit);
+	return static_cast<qint64>(limit.rlim_cur);
+#else
+	return -1;
+#endif
+}
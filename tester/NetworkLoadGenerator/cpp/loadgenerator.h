@@ -0,0 +1,78 @@
+﻿#ifndef __CPP_Network_LOADGENERATOR_H__
+#define __CPP_Network_LOADGENERATOR_H__
+
+#include <QCoreApplication>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class Client;
+class Connect;
+class Server;
+
+struct LoadGeneratorOptions {
+	QString mode = "both"; // both: server and clients in this process, server: serve until killed, client: connect to host
+	QString host = "127.0.0.1";
+	quint16 port = 12350;
+	int connections = 10000; // final connection count
+	int connectionStep = 1000; // connections added before every measurement
+	int stepSeconds = 5; // measured per step
+	int thinkTime = 1000; // ms between two requests of one connection, open loop, 0: no requests
+	int payloadSize = 64;
+	int replySize = 64;
+	QString sourceAddress = "127.0.0.1"; // first source address, the following ones count up from it
+	int sourceAddressCount = 1; // one Client per address, each address has its own ephemeral port range
+	int socketThreadCount = 2; // per Client
+	qint64 serverPid = 0; // client mode, process whose RSS and open files are reported, 0: this process
+
+	QJsonObject toJson() const;
+};
+
+// Opens many long lived connects from one process and drives them with an open loop request rate, the reply
+// of one request never delays the next one. Every step reports what the server sustained at that size
+class NetworkLoadGenerator {
+	Q_DISABLE_COPY(NetworkLoadGenerator)
+
+public:
+	explicit NetworkLoadGenerator(const LoadGeneratorOptions& options);
+
+	~NetworkLoadGenerator();
+
+	// Replies replySize bytes to every request
+	bool startServer();
+
+	bool begin();
+
+	// Opens connects until connectionCount are open or every source address failed, returns the open count
+	int growTo(const int& connectionCount);
+
+	// Sends for stepSeconds and returns the step report
+	QJsonObject measure();
+
+	// Linux, -1 elsewhere or when the process is gone
+	static qint64 residentSetBytes(const qint64& pid);
+
+	static int openFileCount(const qint64& pid);
+
+	// Raises the soft open file limit to the hard limit, returns the new soft limit
+	static qint64 raiseOpenFileLimit();
+
+private:
+	inline qint64 reportedPid() const {
+		return (m_options.serverPid) ? (m_options.serverPid) : (QCoreApplication::applicationPid());
+	}
+
+	LoadGeneratorOptions m_options;
+	QSharedPointer<Server> m_server;
+	QVector<QSharedPointer<Client>> m_clients; // one per source address
+	QVector<QPointer<Connect>> m_connects;
+	int m_connectFailures = 0;
+	int m_nextConnectIndex = 0;
+	int m_sendIndex = 0; // round robin position of the open loop
+	QByteArray m_payloadData;
+	qint64 m_baselineResidentSetBytes = -1; // before the first connect
+};
+
+#endif//__CPP_Network_LOADGENERATOR_H__
@@ -0,0 +1,80 @@
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include "network.h"
+
+#include "loadgenerator.h"
+// Linux example, 50k connects from 4 loopback source addresses, one request per connect every 5 s:
+//   NetworkLoadGenerator --connections 50000 --step 5000 --source-addresses 4 --think-time 5000
+// Every step prints one JSON line to stdout. Bytes per idle connection:
+//   NetworkLoadGenerator --connections 50000 --step 10000 --source-addresses 4 --think-time 0
+int main(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	Network::printVersionInformation();
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Many connect load generator, prints one JSON line per connection step");
+	parser.addHelpOption();
+	LoadGeneratorOptions options;
+	parser.addOptions({
+		{ "mode", "both, server or client.", "mode", options.mode },
+		{ "host", "Server host.", "host", options.host },
+		{ "port", "Server port.", "port", QString::number(options.port) },
+		{ "connections", "Final connection count.", "count", QString::number(options.connections) },
+		{ "step", "Connections added per step.", "count", QString::number(options.connectionStep) },
+		{ "step-duration", "Seconds measured per step.", "seconds", QString::number(options.stepSeconds) },
+		{ "think-time", "Milliseconds between two requests of one connection, 0: idle.", "ms", QString::number(options.thinkTime) },
+		{ "payload-size", "Request payload bytes.", "bytes", QString::number(options.payloadSize) },
+		{ "reply-size", "Reply payload bytes.", "bytes", QString::number(options.replySize) },
+		{ "source-address", "First source address.", "address", options.sourceAddress },
+		{ "source-addresses", "Source addresses counting up from the first.", "count", QString::number(options.sourceAddressCount) },
+		{ "socket-threads", "Socket threads per source address.", "count", QString::number(options.socketThreadCount) },
+		{ "server-pid", "Client mode, report RSS and open files of this process.", "pid" }
+	});
+	parser.process(app);
+	options.mode = parser.value("mode");
+	options.host = parser.value("host");
+	options.port = static_cast<quint16>(parser.value("port").toUInt());
+	options.connections = qMax(1, parser.value("connections").toInt());
+	options.connectionStep = qMax(1, parser.value("step").toInt());
+	options.stepSeconds = qMax(1, parser.value("step-duration").toInt());
+	options.thinkTime = qMax(0, parser.value("think-time").toInt());
+	options.payloadSize = qMax(0, parser.value("payload-size").toInt());
+	options.replySize = qMax(0, parser.value("reply-size").toInt());
+	options.sourceAddress = parser.value("source-address");
+	options.sourceAddressCount = qMax(1, parser.value("source-addresses").toInt());
+	options.socketThreadCount = qMax(1, parser.value("socket-threads").toInt());
+	options.serverPid = parser.value("server-pid").toLongLong();
+	if ((options.mode != "both") && (options.mode != "server") && (options.mode != "client")) {
+		qDebug() << "unknown mode:" << options.mode;
+		return 1;
+	}
+	qDebug() << "open file limit:" << NetworkLoadGenerator::raiseOpenFileLimit();
+	NetworkLoadGenerator loadGenerator(options);
+	if (options.mode != "client") {
+		if (!loadGenerator.startServer()) {
+			return 1;
+		}
+		if (options.mode == "server") {
+			return app.exec();
+		}
+	}
+	if (!loadGenerator.begin()) {
+		return 1;
+	}
+	QTextStream output(stdout);
+	for (auto connectionCount = qMin(options.connectionStep, options.connections); ;
+		connectionCount = qMin(connectionCount + options.connectionStep, options.connections)) {
+		const auto&& openCount = loadGenerator.growTo(connectionCount);
+		auto step = loadGenerator.measure();
+		step["options"] = options.toJson();
+		output << QJsonDocument(step).toJson(QJsonDocument::Compact) << "\n";
+		output.flush();
+		if ((openCount < connectionCount) || (connectionCount >= options.connections)) {
+			break;
+		}
+	}
+	return 0;
+}
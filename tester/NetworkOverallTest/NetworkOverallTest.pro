@@ -3,6 +3,7 @@ QT += core testlib qml
 TEMPLATE = app
 NETWORK_COMPILE_MODE = SRC
 include( $$PWD/../../src/Network.pri )
+CONFIG *= c++20
 SOURCES += \
     $$PWD/cpp/overalltest.cpp \
     $$PWD/cpp/main.cpp
@@ -12,3 +13,4 @@ HEADERS += \
     $$PWD/cpp/fusiontest2.hpp \
     $$PWD/cpp/processortest1.hpp \
     $$PWD/cpp/processortest2.hpp \
+    $$PWD/cpp/coroutinetest.hpp \
@@ -0,0 +1,44 @@
+﻿#ifndef CPP_COROUTINETEST_HPP_
+#define CPP_COROUTINETEST_HPP_
+
+#include "network.h"
+
+namespace CoroutineTest
+{
+	// Answers "relay" by asking a backend first, the reply leaves once the backend answered
+	class GatewayProcessor : public Processor
+	{
+		Q_OBJECT
+		Q_DISABLE_COPY(GatewayProcessor)
+	public:
+		GatewayProcessor() = default;
+		~GatewayProcessor() override = default;
+	public slots:
+		void relay(const QByteArray& received, QByteArray& send)
+		{
+#ifdef __cpp_impl_coroutine
+			Q_UNUSED(send);
+			this->deferReply();
+			this->relayLater(this->currentThreadConnect(), this->currentThreadPackage()->randomFlag(), received);
+#else
+			send = received;
+#endif
+		}
+	public:
+#ifdef __cpp_impl_coroutine
+		NetworkTask relayLater(QPointer<Connect> connect, qint32 randomFlag, QByteArray received)
+		{
+			const auto handleThread = QThread::currentThread();
+			const auto reply = co_await backend_->sendPayloadDataAsync("127.0.0.1", 12470, "backend", received);
+			resumedOnHandleThread_ = (QThread::currentThread() == handleThread);
+			if (connect) {
+				connect->replyPayloadData(randomFlag, (reply.succeed()) ? (reply.package->payloadData()) : (QByteArray("failed")));
+			}
+		}
+#endif
+	public:
+		QSharedPointer<Client> backend_;
+		bool resumedOnHandleThread_ = false;
+	};
+}
+#endif//CPP_COROUTINETEST_HPP_
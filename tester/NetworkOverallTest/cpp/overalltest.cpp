@@ -1,11 +1,15 @@
 ﻿#include "overalltest.h"
 
+#include <algorithm>
+#include <numeric>
+
 #include <QtTest>
 #include <QElapsedTimer>
 #include <QTime>
 #include <QtConcurrent>
 #include <QTcpSocket>
 #include <QTcpServer>
+#include <QJsonArray>
 
 #include "network.h"
 
@@ -13,6 +17,99 @@
 #include "processortest2.hpp"
 #include "fusiontest1.hpp"
 #include "fusiontest2.hpp"
+#include "coroutinetest.hpp"
+
+// Shared source of the file transfer tests, 64 MB under NetworkTestFile in the temp dir, empty on error
+static QString prepareTestFile() {
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	if (!QDir(testFileDir).exists() && !QDir().mkdir(testFileDir)) {
+		return {};
+	}
+	const auto&& testSourceFilePath = QString("%1/testfile").arg(testFileDir);
+	const auto&& testSourceFileInfo = QFileInfo(testSourceFilePath);
+	if (!testSourceFileInfo.exists() || (testSourceFileInfo.size() != (64 * 1024 * 1024))) {
+		QFile testSourceFile(testSourceFilePath);
+		if (!testSourceFile.open(QIODevice::WriteOnly) || !testSourceFile.resize(64 * 1024 * 1024)) {
+			return {};
+		}
+	}
+	return testSourceFilePath;
+}
+
+// Incompressible, so compression and deduplication cannot shrink what the tests count
+static QByteArray randomTestData(const int& size) {
+	QByteArray data;
+	data.reserve(size);
+	for (auto index = 0; index < (size / 4); ++index) {
+		const auto&& value = static_cast<quint32>(QRandomGenerator::global()->generate());
+		data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	return data;
+}
+
+// Polls condition with mutex held until it holds or timeout ms passed, the test thread keeps its events running
+static bool waitFor(QMutex& mutex, const std::function<bool()>& condition, const int& timeout = 10 * 1000) {
+	QEventLoop eventLoop;
+	QElapsedTimer time;
+	time.start();
+	forever {
+		mutex.lock();
+		const auto&& reached = condition();
+		mutex.unlock();
+		if (reached || (time.elapsed() > timeout)) {
+			return reached;
+		}
+		QTimer::singleShot(20, &eventLoop, &QEventLoop::quit);
+		eventLoop.exec();
+	}
+}
+
+// Server collecting its connects and clients connected to it, each counting the received packages of
+// targetActionFlag, shared by the fan out tests
+struct FanOutFixture {
+	QMutex mutex;
+	QSharedPointer<Server> server;
+	QList<QPointer<Connect>> serverConnects;
+	QVector<QSharedPointer<Client>> clients;
+	QVector<int> receivedCounts;
+
+	// Returns once the server knows every client connect
+	bool begin(const quint16& port, const QString& targetActionFlag, const int& clientCount) {
+		server = Server::createServer(port);
+		server->serverSettings()->connectToHostSucceedCallback = [this](const QPointer<Connect>& connect) {
+			mutex.lock();
+			serverConnects.push_back(connect);
+			mutex.unlock();
+		};
+		if (!server->begin()) {
+			return false;
+		}
+		receivedCounts.fill(0, clientCount);
+		for (auto index = 0; index < clientCount; ++index) {
+			auto client = Client::createClient();
+			client->clientSettings()->packageReceivedCallback = [this, targetActionFlag, index](
+				const QPointer<Connect>&, const QString&, const quint16&, const QSharedPointer<Package>& package) {
+					if (package->targetActionFlag() != targetActionFlag) {
+						return;
+					}
+					mutex.lock();
+					++receivedCounts[index];
+					mutex.unlock();
+			};
+			if (!client->begin() || !client->waitForCreateConnect("127.0.0.1", port)) {
+				return false;
+			}
+			clients.push_back(client);
+		}
+		return waitFor(mutex, [this, clientCount]() { return serverConnects.size() == clientCount; });
+	}
+
+	// Caller holds mutex
+	inline int receivedCount() const {
+		return std::accumulate(receivedCounts.begin(), receivedCounts.end(), 0);
+	}
+};
 void NetworkOverallTest::NetworkThreadPoolTest() {
 	QMutex mutex;
 	QMap<QThread*, int> flag;
@@ -779,8 +876,6 @@ void NetworkOverallTest::NetworkProcessorTest1() {
 			package
 		);
 	};
-	QCOMPARE(test(), false);
-	myProcessor.setReceivedPossibleThreads({ QThread::currentThread() });
 	QCOMPARE(test(), true);
 	QCOMPARE(myProcessor.testData_, QVariantMap({ { "key", "value" } }));
 	QCOMPARE(myProcessor.testData2_, QThread::currentThread());
@@ -869,22 +964,1192 @@ void NetworkOverallTest::NetworkSendFile() {
 	auto client = Client::createClient(true);
 	QCOMPARE(client->begin(), true);
 	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12457), true);
+	const auto&& testSourceFilePath = prepareTestFile();
+	QCOMPARE(testSourceFilePath.isEmpty(), false);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12457, QFileInfo(testSourceFilePath)) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(flag1, true);
+}
+void NetworkOverallTest::NetworkSendScheduler() {
+	QMutex mutex;
+	auto bulkReplyCount = 0;
+	auto bulkReplyCountAtInteractiveReply = -1;
+	auto server = Server::createServer(12479);
+	server->serverSettings()->packageReceivedCallback = [](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), package->targetActionFlag().toUtf8());
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient();
+	client->connectSettings()->sendSchedulerWatermark = 64 * 1024;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12479), true);
+	// Hold the connect thread until every send is queued to it, so they reach the scheduler back to back and the
+	// socket cannot drain in between. One package per message, the first bulk one alone is far above the watermark
+	auto connect = client->getConnect("127.0.0.1", 12479);
+	QCOMPARE(connect.isNull(), false);
+	QSemaphore connectThreadHeld;
+	QSemaphore sendsQueued;
+	QMetaObject::invokeMethod(connect.data(), [&connectThreadHeld, &sendsQueued]() {
+		connectThreadHeld.release();
+		sendsQueued.acquire();
+		});
+	connectThreadHeld.acquire();
+	const auto&& bulkData = randomTestData(1024 * 1024);
+	const auto bulkCount = 16;
+	for (auto index = 0; index < bulkCount; ++index) {
+		QCOMPARE(client->sendPayloadData("127.0.0.1", 12479, "bulk", bulkData, {},
+			[&mutex, &bulkReplyCount](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+				mutex.lock();
+				++bulkReplyCount;
+				mutex.unlock();
+			}, nullptr, NetworkPriority::Bulk) > 0, true);
+	}
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12479, "interactive", QByteArray("ping"), {},
+		[&mutex, &bulkReplyCount, &bulkReplyCountAtInteractiveReply](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			mutex.lock();
+			bulkReplyCountAtInteractiveReply = bulkReplyCount;
+			mutex.unlock();
+		}, nullptr, NetworkPriority::Interactive) > 0, true);
+	sendsQueued.release();
+	QCOMPARE(waitFor(mutex, [&bulkReplyCount]() { return bulkReplyCount == bulkCount; }), true);
+	// Only the first bulk message was written before the request overtook the other 15 in the scheduler,
+	// the slack covers replies reordered by the server's callback threads
+	mutex.lock();
+	QCOMPARE(bulkReplyCountAtInteractiveReply >= 0, true);
+	QCOMPARE(bulkReplyCountAtInteractiveReply <= (bulkCount / 4), true);
+	mutex.unlock();
+}
+void NetworkOverallTest::NetworkSendFileResume() {
+	QMutex mutex;
+	auto receivedCount = 0;
+	auto serverConnectDeleted = false;
 	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
 		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
-	if (!QDir(testFileDir).exists()) {
-		QCOMPARE(QDir().mkdir(testFileDir), true);
+	const auto&& testReceiveDir = QString("%1/resume").arg(testFileDir);
+	QDir(testReceiveDir).removeRecursively();
+	QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	const auto&& sourceData = randomTestData(64 * 1024 * 1024);
+	const auto&& testSourceFilePath = QString("%1/resumefile").arg(testFileDir);
+	{
+		QFile sourceFile(testSourceFilePath);
+		QCOMPARE(sourceFile.open(QIODevice::WriteOnly), true);
+		QCOMPARE(sourceFile.write(sourceData), sourceData.size());
 	}
-	const auto&& testSourceFilePath = QString("%1/testfile").arg(testFileDir);
-	const auto&& testSourceFileInfo = QFileInfo(testSourceFilePath);
-	if (!testSourceFileInfo.exists() || (testSourceFileInfo.size() != (64 * 1024 * 1024))) {
-		QFile testSourceFile(testSourceFilePath);
+	const auto&& sidecarPath = QString("%1/resumefile.resume").arg(testReceiveDir);
+	auto server = Server::createServer(12478, QHostAddress::Any, true);
+	server->connectSettings()->fileTransferResumeEnabled = true;
+	server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+	server->serverSettings()->readyToDeleteCallback = [&mutex, &serverConnectDeleted](const QPointer<Connect>&) {
+		mutex.lock();
+		serverConnectDeleted = true;
+		mutex.unlock();
+	};
+	server->serverSettings()->packageReceivedCallback = [&mutex, &receivedCount](
+		const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			mutex.lock();
+			++receivedCount;
+			mutex.unlock();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->cutPackageSize = 64 * 1024;
+	// Drop the connect once 8 MB went out, the receiver asked for every chunk after saving the sidecar
+	auto dropRequested = false;
+	client->clientSettings()->packageSendingCallback = [&mutex, &dropRequested](
+		const QPointer<Connect>& connect, const QString&, const quint16&, const qint32&,
+		const qint64& sentIndex, const qint64&, const qint64&) {
+			mutex.lock();
+			const auto&& dropNow = !dropRequested && (sentIndex >= (8 * 1024 * 1024));
+			dropRequested = dropRequested || dropNow;
+			mutex.unlock();
+			if (!dropNow || !connect) {
+				return;
+			}
+			QMetaObject::invokeMethod(connect.data(), [connect]() {
+				if (connect) {
+					connect->close();
+				}
+				});
+	};
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12478), true);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12478, QFileInfo(testSourceFilePath)) > 0, true);
+	QCOMPARE(waitFor(mutex, [&serverConnectDeleted]() { return serverConnectDeleted; }), true);
+	mutex.lock();
+	QCOMPARE(receivedCount, 0);
+	mutex.unlock();
+	QCOMPARE(QFileInfo::exists(sidecarPath), true);
+	// Sent again, the receiver continues from the sidecar offset
+	QCOMPARE(waitFor(mutex, [&client]() { return !client->containsConnect("127.0.0.1", 12478); }), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12478), true);
+	auto secondConnect = client->getConnect("127.0.0.1", 12478);
+	QCOMPARE(secondConnect.isNull(), false);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12478, QFileInfo(testSourceFilePath)) > 0, true);
+	QCOMPARE(waitFor(mutex, [&receivedCount]() { return receivedCount == 1; }), true);
+	QFile receivedFile(QString("%1/resumefile").arg(testReceiveDir));
+	QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+	QCOMPARE(receivedFile.readAll() == sourceData, true);
+	QCOMPARE(QFileInfo::exists(sidecarPath), false);
+	QCOMPARE(secondConnect->alreadyWrittenBytes() < sourceData.size(), true);
+}
+void NetworkOverallTest::NetworkSendFileAsyncWrite() {
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	auto server = Server::createServer(12458, QHostAddress::Any, true);
+	server->connectSettings()->fileWriteThreadCount = 2;
+	server->connectSettings()->maximumPendingFileWriteBytes = 4 * 1024 * 1024;
+	server->serverSettings()->packageReceivedCallback = [&flag1, &eventLoop](
+		const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			eventLoop.quit();
+			flag1 = true;
+			QCOMPARE(package->containsFile(), true);
+			QCOMPARE(QFileInfo(package->localFilePath()).size(), 64 * 1024 * 1024);
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->cutPackageSize = 1024 * 1024;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12458), true);
+	const auto&& testSourceFilePath = prepareTestFile();
+	QCOMPARE(testSourceFilePath.isEmpty(), false);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12458, QFileInfo(testSourceFilePath)) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(flag1, true);
+}
+void NetworkOverallTest::NetworkSendFileStriped() {
+	QMutex mutex;
+	auto receivedCount = 0;
+	QString receivedFilePath;
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	const auto&& testReceiveDir = QString("%1/striped").arg(testFileDir);
+	QDir(testReceiveDir).removeRecursively();
+	QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	// Random, so a stripe written at the wrong offset can not go unnoticed
+	const auto&& sourceData = randomTestData(16 * 1024 * 1024 + 12345);
+	const auto&& testSourceFilePath = QString("%1/stripedfile").arg(testFileDir);
+	{
+		QFile sourceFile(testSourceFilePath);
+		QCOMPARE(sourceFile.open(QIODevice::WriteOnly), true);
+		QCOMPARE(sourceFile.write(sourceData), sourceData.size());
+	}
+	auto server = Server::createServer(12459, QHostAddress::Any, true);
+	server->serverSettings()->globalSocketThreadCount = 4;
+	server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+	server->serverSettings()->packageReceivedCallback = [&mutex, &receivedCount, &receivedFilePath](
+		const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			mutex.lock();
+			++receivedCount;
+			receivedFilePath = package->localFilePath();
+			mutex.unlock();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->clientSettings()->globalSocketThreadCount = 4;
+	client->connectSettings()->cutPackageSize = 1024 * 1024;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->sendFileDataStriped("127.0.0.1", 12459, {}, QFileInfo(testSourceFilePath), {}, 4) > 0, true);
+	QCOMPARE(client->containsConnect("127.0.0.1", 12459, 3), true);
+	QCOMPARE(waitFor(mutex, [&receivedCount]() { return receivedCount == 1; }), true);
+	QTest::qWait(500);
+	mutex.lock();
+	QCOMPARE(receivedCount, 1);
+	QFile receivedFile(receivedFilePath);
+	mutex.unlock();
+	QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+	QCOMPARE(receivedFile.readAll() == sourceData, true);
+}
+void NetworkOverallTest::NetworkSendCancel() {
+	QMutex mutex;
+	auto failedCount = 0;
+	auto receivedCount = 0;
+	auto receivingStarted = false;
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	const auto&& testReceiveDir = QString("%1/cancel").arg(testFileDir);
+	QDir(testReceiveDir).removeRecursively();
+	QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	auto server = Server::createServer(12481, QHostAddress::Any, true);
+	server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+	server->serverSettings()->packageReceivingCallback = [&mutex, &receivingStarted](
+		const QPointer<Connect>&, const qint32&, const qint64&, const qint64&, const qint64&) {
+			mutex.lock();
+			receivingStarted = true;
+			mutex.unlock();
+	};
+	server->serverSettings()->packageReceivedCallback = [&mutex, &receivedCount](
+		const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			mutex.lock();
+			++receivedCount;
+			mutex.unlock();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->cutPackageSize = 64 * 1024;
+	// Cancel on the connect thread once 1 MB went out, well before the file is through
+	auto cancelRequested = false;
+	client->clientSettings()->packageSendingCallback = [&mutex, &cancelRequested](
+		const QPointer<Connect>& connect, const QString&, const quint16&, const qint32& randomFlag,
+		const qint64& sentIndex, const qint64&, const qint64&) {
+			mutex.lock();
+			const auto&& cancelNow = !cancelRequested && (sentIndex >= (1024 * 1024));
+			cancelRequested = cancelRequested || cancelNow;
+			mutex.unlock();
+			if (!cancelNow || !connect) {
+				return;
+			}
+			connect->cancelSend(randomFlag);
+	};
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12481), true);
+	const auto&& testSourceFilePath = prepareTestFile();
+	QCOMPARE(testSourceFilePath.isEmpty(), false);
+	const auto&& randomFlag = client->sendFileData(
+		"127.0.0.1",
+		12481,
+		QFileInfo(testSourceFilePath),
+		nullptr,
+		[&mutex, &failedCount](const QPointer<Connect>&) {
+			mutex.lock();
+			++failedCount;
+			mutex.unlock();
+		}
+	);
+	QCOMPARE(randomFlag > 0, true);
+	QCOMPARE(waitFor(mutex, [&failedCount, &receivingStarted]() { return (failedCount == 1) && receivingStarted; }), true);
+	// The receiver drops the transfer and its partial file, the connect stays usable
+	const auto&& receivedFilePath = QString("%1/%2").arg(testReceiveDir, QFileInfo(testSourceFilePath).fileName());
+	QCOMPARE(waitFor(mutex, [&receivedFilePath]() { return !QFileInfo::exists(receivedFilePath); }), true);
+	QTest::qWait(500);
+	QCOMPARE(QFileInfo::exists(receivedFilePath), false);
+	mutex.lock();
+	QCOMPARE(failedCount, 1);
+	QCOMPARE(receivedCount, 0);
+	mutex.unlock();
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12481, "after cancel") > 0, true);
+	QCOMPARE(waitFor(mutex, [&receivedCount]() { return receivedCount == 1; }), true);
+}
+void NetworkOverallTest::NetworkSendFileZeroCopy() {
+	QMutex mutex;
+	auto receivedCount = 0;
+	QString receivedFilePath;
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	const auto&& testReceiveDir = QString("%1/zerocopy").arg(testFileDir);
+	QDir(testReceiveDir).removeRecursively();
+	QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	// Random, so a range sent twice or skipped where sendfile stopped can not go unnoticed
+	const auto&& sourceData = randomTestData(8 * 1024 * 1024 + 777);
+	const auto&& testSourceFilePath = QString("%1/zerocopyfile").arg(testFileDir);
+	{
+		QFile sourceFile(testSourceFilePath);
+		QCOMPARE(sourceFile.open(QIODevice::WriteOnly), true);
+		QCOMPARE(sourceFile.write(sourceData), sourceData.size());
+	}
+	auto server = Server::createServer(12483, QHostAddress::Any, true);
+	server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+	server->serverSettings()->packageReceivedCallback = [&mutex, &receivedCount, &receivedFilePath](
+		const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			mutex.lock();
+			++receivedCount;
+			receivedFilePath = package->localFilePath();
+			mutex.unlock();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	// Uncompressed chunks of 1 MB into a send buffer of a few KB, sendfile always stops partway and the
+	// rest of the chunk goes through QTcpSocket
+	client->connectSettings()->fileZeroCopyEnabled = true;
+	client->connectSettings()->packageCompressionThresholdForConnectSucceedElapsed = -1;
+	client->connectSettings()->cutPackageSize = 1024 * 1024;
+	client->connectSettings()->socketSendBufferSize = 4096;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12483), true);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12483, QFileInfo(testSourceFilePath)) > 0, true);
+	QCOMPARE(waitFor(mutex, [&receivedCount]() { return receivedCount == 1; }, 30 * 1000), true);
+	mutex.lock();
+	QFile receivedFile(receivedFilePath);
+	mutex.unlock();
+	QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+	QCOMPARE(receivedFile.size(), qint64(sourceData.size()));
+	QCOMPARE(receivedFile.readAll() == sourceData, true);
+}
+void NetworkOverallTest::NetworkSendFileBundle() {
+	QMutex mutex;
+	QList<int> receivedBundleIndexes;
+	QString localBundleRootPath;
+	auto succeedCount = 0;
+	auto failedCount = 0;
+	auto server = Server::createServer(12460, QHostAddress::Any, true);
+	server->serverSettings()->packageReceivedCallback = [&mutex, &receivedBundleIndexes, &localBundleRootPath](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			mutex.lock();
+			receivedBundleIndexes.push_back(package->fileBundleIndex());
+			if (package->fileBundle().contains("files")) {
+				localBundleRootPath = package->localFilePath();
+			}
+			mutex.unlock();
+			connect->replyPayloadData(package->randomFlag(), "OK");
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->fileBundleMaximumFileCount = 100;
+	client->connectSettings()->fileBundleMaximumBytes = 64 * 1024;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12460), true);
+	const auto&& testBundleDir = QString("%1/NetworkTestFile/bundle").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	QDir(testBundleDir).removeRecursively();
+	for (auto index = 0; index < 300; ++index) {
+		const auto&& testSubDir = QString("%1/dir%2").arg(testBundleDir).arg(index % 3);
+		if (!QDir(testSubDir).exists()) {
+			QCOMPARE(QDir().mkpath(testSubDir), true);
+		}
+		QFile testSourceFile(QString("%1/file%2").arg(testSubDir).arg(index));
 		QCOMPARE(testSourceFile.open(QIODevice::WriteOnly), true);
-		QCOMPARE(testSourceFile.resize(64 * 1024 * 1024), true);
+		testSourceFile.write(QByteArray::number(index));
 	}
-	QCOMPARE(client->sendFileData("127.0.0.1", 12457, QFileInfo(testSourceFilePath)) > 0, true);
+	// Above fileBundleMaximumBytes, goes as a file transfer of its own and counts as a bundle
+	const auto&& bigFileData = randomTestData(1024 * 1024);
+	{
+		QFile bigFile(QString("%1/dir1/bigfile").arg(testBundleDir));
+		QCOMPARE(bigFile.open(QIODevice::WriteOnly), true);
+		QCOMPARE(bigFile.write(bigFileData), bigFileData.size());
+	}
+	QCOMPARE(client->sendDirectory(
+		"127.0.0.1",
+		12460,
+		{},
+		QDir(testBundleDir),
+		{},
+		[&mutex, &succeedCount](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			mutex.lock();
+			++succeedCount;
+			mutex.unlock();
+		},
+		[&mutex, &failedCount](const QPointer<Connect>&) {
+			mutex.lock();
+			++failedCount;
+			mutex.unlock();
+		}
+	) > 0, true);
+	QCOMPARE(waitFor(mutex, [&succeedCount]() { return succeedCount == 1; }), true);
+	QTest::qWait(500);
+	mutex.lock();
+	auto sortedBundleIndexes = receivedBundleIndexes;
+	std::sort(sortedBundleIndexes.begin(), sortedBundleIndexes.end());
+	QCOMPARE(sortedBundleIndexes, QList<int>({ 0, 1, 2, 3 }));
+	QCOMPARE(succeedCount, 1);
+	QCOMPARE(failedCount, 0);
+	const auto rootPath = localBundleRootPath;
+	mutex.unlock();
+	QFile receivedFile(QString("%1/dir2/file299").arg(rootPath));
+	QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+	QCOMPARE(receivedFile.readAll(), QByteArray("299"));
+	QFile receivedBigFile(QString("%1/dir1/bigfile").arg(rootPath));
+	QCOMPARE(receivedBigFile.open(QIODevice::ReadOnly), true);
+	QCOMPARE(receivedBigFile.readAll() == bigFileData, true);
+	// A bundle that can not be read fails the whole send once, the bundles after it are not sent
+	client->connectSettings()->fileBundleMaximumFileCount = 10;
+	mutex.lock();
+	receivedBundleIndexes.clear();
+	mutex.unlock();
+	QList<QFileInfo> fileInfos;
+	for (auto index = 0; index < 30; ++index) {
+		fileInfos.push_back(QFileInfo(QString("%1/dir%2/file%3").arg(testBundleDir).arg(index % 3).arg(index)));
+		QCOMPARE(fileInfos.last().isFile(), true);
+	}
+	// QFileInfo keeps what it has read, the removed file still passes the checks when the bundles are split
+	QCOMPARE(QFile::remove(fileInfos[15].filePath()), true);
+	QCOMPARE(client->sendFileBundle(
+		"127.0.0.1",
+		12460,
+		{},
+		QDir(testBundleDir),
+		fileInfos,
+		{},
+		nullptr,
+		[&mutex, &failedCount](const QPointer<Connect>&) {
+			mutex.lock();
+			++failedCount;
+			mutex.unlock();
+		}
+	) > 0, true);
+	QCOMPARE(waitFor(mutex, [&failedCount]() { return failedCount == 1; }), true);
+	QTest::qWait(500);
+	mutex.lock();
+	QCOMPARE(failedCount, 1);
+	QCOMPARE(receivedBundleIndexes.contains(2), false);
+	mutex.unlock();
+}
+void NetworkOverallTest::NetworkSendFileDelta() {
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	const auto&& testReceiveDir = QString("%1/delta").arg(testFileDir);
+	if (!QDir(testReceiveDir).exists()) {
+		QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	}
+	const auto&& sourceData = randomTestData(4 * 1024 * 1024);
+	// The receiver's copy is an older version, a few bytes changed and a shifted region
+	auto oldData = sourceData;
+	oldData.replace(1000, 100, QByteArray(100, 'x'));
+	oldData.insert(2 * 1024 * 1024, QByteArray(777, 'y'));
+	// Once applied on the socket thread, once handed to the file writer pool, and once with the old copy
+	// changed under the receiver after its signatures went out, which the whole-file hash has to catch
+	for (const auto& deltaRun: QVector<QPair<int, bool>>{ { 0, false }, { 2, false }, { 2, true } }) {
+		const auto fileWriteThreadCount = deltaRun.first;
+		const auto changeOldCopy = deltaRun.second;
+		flag1 = false;
+		const quint16 port = (changeOldCopy) ? (12482) : ((fileWriteThreadCount) ? (12480) : (12461));
+		{
+			QFile sourceFile(QString("%1/deltafile").arg(testFileDir));
+			QCOMPARE(sourceFile.open(QIODevice::WriteOnly), true);
+			QCOMPARE(sourceFile.write(sourceData), sourceData.size());
+			QFile oldFile(QString("%1/deltafile").arg(testReceiveDir));
+			QCOMPARE(oldFile.open(QIODevice::WriteOnly), true);
+			QCOMPARE(oldFile.write(oldData), oldData.size());
+		}
+		auto server = Server::createServer(port, QHostAddress::Any, true);
+		server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+		server->connectSettings()->fileWriteThreadCount = fileWriteThreadCount;
+		server->serverSettings()->packageReceivedCallback = [&flag1, &eventLoop, &sourceData](
+			const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+				eventLoop.quit();
+				flag1 = true;
+				QCOMPARE(package->containsFile(), true);
+				QFile receivedFile(package->localFilePath());
+				QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+				QCOMPARE(receivedFile.readAll() == sourceData, true);
+		};
+		QCOMPARE(server->begin(), true);
+		auto client = Client::createClient(true);
+		client->connectSettings()->cutPackageSize = 256 * 1024;
+		client->connectSettings()->fileDeltaMinimumBytes = 0;
+		auto oldCopyChanged = false;
+		if (changeOldCopy) {
+			// The first delta package covers at most one cut, the region near the end is copied much later
+			client->connectSettings()->packageSendingCallback = [&oldCopyChanged, &testReceiveDir](
+				const QPointer<Connect>&, const qint32&, const qint64&, const qint64&, const qint64&) {
+					if (oldCopyChanged) {
+						return;
+					}
+					oldCopyChanged = true;
+					QFile oldFile(QString("%1/deltafile").arg(testReceiveDir));
+					QCOMPARE(oldFile.open(QIODevice::ReadWrite), true);
+					QCOMPARE(oldFile.seek(3 * 1024 * 1024), true);
+					QCOMPARE(oldFile.write(QByteArray(4096, 'z')), qint64(4096));
+			};
+		}
+		QCOMPARE(client->begin(), true);
+		QCOMPARE(client->waitForCreateConnect("127.0.0.1", port), true);
+		QCOMPARE(client->sendFileData("127.0.0.1", port, QFileInfo(QString("%1/deltafile").arg(testFileDir))) > 0, true);
+		QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+		eventLoop.exec();
+		QCOMPARE(flag1, true);
+		QCOMPARE(QFile::exists(QString("%1/deltafile.delta").arg(testReceiveDir)), false);
+		if (changeOldCopy) {
+			// The rebuilt file was thrown away and the whole file sent after it
+			QCOMPARE(oldCopyChanged, true);
+			QCOMPARE(client->getConnect("127.0.0.1", port)->alreadyWrittenBytes() > sourceData.size(), true);
+		} else {
+			// Only the changed regions travel, not the whole 4 MB
+			QCOMPARE(client->getConnect("127.0.0.1", port)->alreadyWrittenBytes() < (512 * 1024), true);
+		}
+	}
+}
+void NetworkOverallTest::NetworkChunkDeduplication() {
+	QEventLoop eventLoop;
+	auto receivedCount = 0;
+	const auto&& chunkStoreDir = QString("%1/NetworkTestFile/chunks").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	QDir(chunkStoreDir).removeRecursively();
+	const auto&& sourceData = randomTestData(4 * 1024 * 1024);
+	// The second payload shares everything but a shifted region with the first one
+	auto secondData = sourceData;
+	secondData.insert(2 * 1024 * 1024, QByteArray(777, 'y'));
+	auto server = Server::createServer(12462, QHostAddress::Any, true);
+	server->connectSettings()->chunkStoreDir = chunkStoreDir;
+	server->serverSettings()->packageReceivedCallback = [&receivedCount, &eventLoop, &sourceData, &secondData](
+		const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			++receivedCount;
+			QCOMPARE(package->targetActionFlag(), QString("chunked"));
+			QCOMPARE(package->payloadData() == ((receivedCount == 1) ? (sourceData) : (secondData)), true);
+			eventLoop.quit();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->chunkDeduplicationMinimumBytes = 0;
+	// The second payload is mostly put together from stored chunks, the whole-payload checksum covers that
+	client->connectSettings()->packageChecksumEnabled = true;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12462), true);
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12462, "chunked", sourceData) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(receivedCount, 1);
+	const auto&& firstWrittenBytes = client->getConnect("127.0.0.1", 12462)->alreadyWrittenBytes();
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12462, "chunked", secondData) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(receivedCount, 2);
+	// Only the chunks around the insertion travel again
+	QCOMPARE((client->getConnect("127.0.0.1", 12462)->alreadyWrittenBytes() - firstWrittenBytes) < (1024 * 1024), true);
+	// A damaged chunk in the store is caught by its hash, the send fails instead of delivering it
+	QDirIterator chunkIterator(chunkStoreDir, QDir::Files, QDirIterator::Subdirectories);
+	auto damagedChunkCount = 0;
+	while (chunkIterator.hasNext()) {
+		QFile chunkFile(chunkIterator.next());
+		QCOMPARE(chunkFile.open(QIODevice::ReadWrite), true);
+		QCOMPARE(chunkFile.write(QByteArray(16, 'z')), qint64(16));
+		++damagedChunkCount;
+	}
+	QCOMPARE(damagedChunkCount > 0, true);
+	QMutex mutex;
+	auto failedCount = 0;
+	QCOMPARE(client->sendPayloadData(
+		"127.0.0.1",
+		12462,
+		"chunked",
+		secondData,
+		nullptr,
+		[&mutex, &failedCount](const QPointer<Connect>&) {
+			mutex.lock();
+			++failedCount;
+			mutex.unlock();
+		}
+	) > 0, true);
+	QCOMPARE(waitFor(mutex, [&failedCount]() { return failedCount == 1; }), true);
+	QTest::qWait(500);
+	QCOMPARE(receivedCount, 2);
+}
+void NetworkOverallTest::NetworkPackageChecksum() {
+	QCOMPARE(Package::crc32c(QByteArray("123456789")), quint32(0xe3069283));
+	QCOMPARE(Package::crc32c(QByteArray("6789"), Package::crc32c(QByteArray("12345"))), quint32(0xe3069283));
+	{
+		auto package = Package::createPayloadTransportPackages("checksum", QByteArray(1000, 'a'), {}, 1).first();
+		package->computeChecksum();
+		auto rawData = package->toByteArray();
+		QCOMPARE(Package::checkDataIsReadyReceive(rawData), 0);
+		const auto&& receivedPackage = Package::readPackage(rawData);
+		QCOMPARE(receivedPackage->isAbandonPackage(), false);
+		QCOMPARE(receivedPackage->hasChecksum(), true);
+		QCOMPARE(receivedPackage->payloadData(), QByteArray(1000, 'a'));
+		QCOMPARE(rawData.isEmpty(), true);
+		rawData = package->toByteArray();
+		rawData[rawData.size() - 1] = 'b';
+		QCOMPARE(Package::checkDataIsReadyReceive(rawData), 0);
+		QCOMPARE(Package::readPackage(rawData)->isAbandonPackage(), true);
+	}
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	const auto&& testFileDir = QString("%1/NetworkTestFile").arg(
+		QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+	const auto&& testReceiveDir = QString("%1/checksum").arg(testFileDir);
+	if (!QDir(testReceiveDir).exists()) {
+		QCOMPARE(QDir().mkpath(testReceiveDir), true);
+	}
+	const auto&& sourceData = randomTestData(3 * 1024 * 1024);
+	{
+		QFile sourceFile(QString("%1/checksumfile").arg(testFileDir));
+		QCOMPARE(sourceFile.open(QIODevice::WriteOnly), true);
+		QCOMPARE(sourceFile.write(sourceData), sourceData.size());
+	}
+	auto server = Server::createServer(12463, QHostAddress::Any, true);
+	server->connectSettings()->setFilePathProviderToDir(QDir(testReceiveDir));
+	server->serverSettings()->packageReceivedCallback = [&flag1, &eventLoop, &sourceData](
+		const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			eventLoop.quit();
+			flag1 = true;
+			QCOMPARE(package->containsFile(), true);
+			QFile receivedFile(package->localFilePath());
+			QCOMPARE(receivedFile.open(QIODevice::ReadOnly), true);
+			QCOMPARE(receivedFile.readAll() == sourceData, true);
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient(true);
+	client->connectSettings()->cutPackageSize = 256 * 1024;
+	client->connectSettings()->packageChecksumEnabled = true;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12463), true);
+	QCOMPARE(client->sendFileData("127.0.0.1", 12463, QFileInfo(QString("%1/checksumfile").arg(testFileDir))) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(flag1, true);
+}
+void NetworkOverallTest::NetworkPackageResync() {
+	const auto&& package = Package::createPayloadTransportPackages("resync", QByteArray(1000, 'a'), {}, 1).first();
+	// Stray boot flags and random bytes in front of a valid package
+	QByteArray rawData(64 * 1024, static_cast<char>(NETWORKPACKAGE_BOOTFLAG));
+	for (auto index = 0; index < (1024 * 1024); ++index) {
+		rawData.append(static_cast<char>(QRandomGenerator::global()->bounded(0, 0x7d)));
+	}
+	const auto&& packageIndex = rawData.size();
+	rawData.append(package->toByteArray());
+	QCOMPARE(Package::checkDataIsReadyReceive(rawData) < 0, true);
+	QCOMPARE(Package::nextHeadIndex(rawData, 1), packageIndex);
+	rawData.remove(0, packageIndex);
+	QCOMPARE(Package::checkDataIsReadyReceive(rawData), 0);
+	QCOMPARE(Package::readPackage(rawData)->payloadData(), QByteArray(1000, 'a'));
+	// A boot flag too close to the end is kept until the rest of its head arrives
+	QByteArray tailData(100, 'x');
+	tailData.append(static_cast<char>(NETWORKPACKAGE_BOOTFLAG));
+	QCOMPARE(Package::nextHeadIndex(tailData, 1), 100);
+	QCOMPARE(Package::nextHeadIndex(QByteArray(100, 'x'), 1), 100);
+	// A checksummed head is rejected by its own checksum, before its lengths are waited for
+	const auto&& checkedPackage = Package::createPayloadTransportPackages("resync", QByteArray(1000, 'b'), {}, 2).first();
+	checkedPackage->computeChecksum();
+	const auto&& checkedData = checkedPackage->toByteArray();
+	auto falseHead = checkedData.left(Package::headSize() + NETWORKPACKAGE_HEADCHECKSUMSIZE);
+	// Claims a 16 MB payload, a receiver trusting it would stall until the connect is closed
+	falseHead[Package::headSize() - 5] = static_cast<char>(0x01);
+	falseHead[Package::headSize() - 1] = static_cast<char>(0x01);
+	QCOMPARE(Package::isValidHead(falseHead.constData()), false);
+	QByteArray checkedRawData("xx");
+	checkedRawData.append(falseHead);
+	const auto&& checkedIndex = checkedRawData.size();
+	checkedRawData.append(checkedData);
+	QCOMPARE(Package::checkDataIsReadyReceive(checkedRawData) < 0, true);
+	QCOMPARE(Package::nextHeadIndex(checkedRawData, 1), checkedIndex);
+	checkedRawData.remove(0, checkedIndex);
+	QCOMPARE(Package::checkDataIsReadyReceive(checkedRawData, true), 0);
+	QCOMPARE(Package::readPackage(checkedRawData)->payloadData(), QByteArray(1000, 'b'));
+	// A head cut off inside its checksum waits for the rest
+	QCOMPARE(Package::nextHeadIndex(checkedData.left(Package::headSize() + 2), 0), 0);
+	// Once the peer is known to send checksums, a head without one is not taken for a package
+	auto plainData = package->toByteArray();
+	QCOMPARE(Package::checkDataIsReadyReceive(plainData, true) < 0, true);
+	QCOMPARE(Package::nextHeadIndex(plainData, 0, true), plainData.size());
+}
+void NetworkOverallTest::NetworkMetricsTest() {
+	{
+		NetworkMetrics metrics;
+		metrics.add(NetworkMetrics::SentBytes, 100);
+		metrics.add(NetworkMetrics::SentBytes);
+		metrics.observe(NetworkMetrics::ReplyLatency, 3);
+		metrics.observe(NetworkMetrics::ReplyLatency, 1000000000);
+		QCOMPARE(metrics.counter(NetworkMetrics::SentBytes), qint64(101));
+		QCOMPARE(metrics.histogramCount(NetworkMetrics::ReplyLatency), qint64(2));
+		const auto&& text = metrics.toPrometheusText();
+		QCOMPARE(text.contains("network_sent_bytes_total 101\n"), true);
+		QCOMPARE(text.contains("network_reply_latency_seconds_bucket{le=\"2e-06\"} 0\n"), true);
+		QCOMPARE(text.contains("network_reply_latency_seconds_bucket{le=\"4e-06\"} 1\n"), true);
+		QCOMPARE(text.contains("network_reply_latency_seconds_bucket{le=\"+Inf\"} 2\n"), true);
+		QCOMPARE(text.contains("network_reply_latency_seconds_count 2\n"), true);
+	}
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	auto server = Server::createServer(12464);
+	server->serverSettings()->metricsPort = 12465;
+	server->serverSettings()->packageReceivedCallback = [&flag1, &eventLoop](
+		const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			flag1 = true;
+			eventLoop.quit();
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient();
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12464), true);
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12464, "metrics", QByteArray(1000, 'a')) > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(flag1, true);
+	QCOMPARE(server->metrics()->counter(NetworkMetrics::ReceivedPackages) >= 1, true);
+	QCOMPARE(server->metrics()->counter(NetworkMetrics::ReceivedBytes) > 1000, true);
+	QCOMPARE(client->getConnect("127.0.0.1", 12464)->metricCounter(NetworkMetrics::SentPackages) >= 1, true);
+	QTcpSocket socket;
+	socket.connectToHost("127.0.0.1", 12465);
+	QCOMPARE(socket.waitForConnected(), true);
+	socket.write("GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+	QByteArray response;
+	while (socket.waitForReadyRead(3000)) {
+		response += socket.readAll();
+	}
+	response += socket.readAll();
+	QCOMPARE(response.startsWith("HTTP/1.1 200 OK\r\n"), true);
+	QCOMPARE(response.contains("network_connections 1\n"), true);
+	QCOMPARE(response.contains("network_received_packages_total"), true);
+}
+void NetworkOverallTest::NetworkTracing() {
+	{
+		NetworkTracer tracer(3, 2);
+		tracer.trace(NetworkTracer::Enqueued, 1, 1);
+		QCOMPARE(tracer.events().isEmpty(), true);
+		for (auto stage = 0; stage < NetworkTracer::StageCount; ++stage) {
+			tracer.trace(static_cast<NetworkTracer::Stage>(stage), 2, 1);
+		}
+		const auto&& events = tracer.events();
+		QCOMPARE(events.size(), 4);
+		QCOMPARE(events.first().stage, NetworkTracer::ReassemblyComplete);
+		QCOMPARE(events.last().stage, NetworkTracer::CallbackFinished);
+		QCOMPARE(events.first().time <= events.last().time, true);
+	}
+	{
+		// Same randomFlag on two connects, two rows whose slices never span from one connect to the other
+		NetworkTracer tracer;
+		tracer.trace(NetworkTracer::Enqueued, 2, 1);
+		tracer.trace(NetworkTracer::Enqueued, 2, 2);
+		tracer.trace(NetworkTracer::FirstByteWritten, 2, 1);
+		const auto&& traceEvents = QJsonDocument::fromJson(tracer.toChromeTraceJson()).object()["traceEvents"].toArray();
+		QCOMPARE(traceEvents.size(), 3);
+		QCOMPARE(traceEvents[0].toObject()["pid"].toInt(), 1);
+		QCOMPARE(traceEvents[1].toObject()["pid"].toInt(), 1);
+		QCOMPARE(traceEvents[1].toObject()["name"].toString(), QString("first_byte_written"));
+		QCOMPARE(traceEvents[2].toObject()["pid"].toInt(), 2);
+		QCOMPARE(traceEvents[2].toObject()["dur"].toInt(), 0);
+	}
+	QSharedPointer<NetworkTracer> tracer(new NetworkTracer);
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	auto server = Server::createServer(12466);
+	server->connectSettings()->tracer = tracer;
+	server->serverSettings()->packageReceivedCallback = [](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), "reply");
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient();
+	client->connectSettings()->tracer = tracer;
+	client->connectSettings()->cutPackageSize = 1024;
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12466), true);
+	const auto&& randomFlag = client->sendPayloadData(
+		"127.0.0.1",
+		12466,
+		"tracing",
+		QByteArray(8 * 1024, 'a'),
+		[&flag1, &eventLoop](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			flag1 = true;
+			eventLoop.quit();
+		}
+	);
+	QCOMPARE(randomFlag > 0, true);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(flag1, true);
+	// The last callback_finished lands right after the reply callback returned
+	QTimer::singleShot(200, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QVector<int> stageCounts(NetworkTracer::StageCount, 0);
+	QSet<quint64> connectIds;
+	for (const auto& event : tracer->events()) {
+		QCOMPARE(event.randomFlag, randomFlag);
+		++stageCounts[event.stage];
+		connectIds.insert(event.connectId);
+	}
+	// The client connect and the server connect
+	QCOMPARE(connectIds.size(), 2);
+	// Request and reply share the randomFlag and each pass every stage once
+	QCOMPARE(stageCounts[NetworkTracer::Enqueued], 2);
+	QCOMPARE(stageCounts[NetworkTracer::FirstByteWritten], 2);
+	QCOMPARE(stageCounts[NetworkTracer::LastChunkWritten], 2);
+	QCOMPARE(stageCounts[NetworkTracer::FirstByteReceived], 2);
+	QCOMPARE(stageCounts[NetworkTracer::ReassemblyComplete], 2);
+	QCOMPARE(stageCounts[NetworkTracer::CallbackDispatched], 2);
+	QCOMPARE(stageCounts[NetworkTracer::CallbackStarted], 2);
+	QCOMPARE(stageCounts[NetworkTracer::CallbackFinished], 2);
+	const auto&& json = QJsonDocument::fromJson(tracer->toChromeTraceJson()).object();
+	const auto&& traceEvents = json["traceEvents"].toArray();
+	QCOMPARE(traceEvents.size(), NetworkTracer::StageCount * 2);
+	QCOMPARE(traceEvents.first().toObject()["name"].toString(), QString("enqueued"));
+	QCOMPARE(traceEvents.first().toObject()["tid"].toInt(), randomFlag);
+}
+void NetworkOverallTest::NetworkHeartbeat() {
+	{
+		const auto&& heartbeat = Package::createHeartbeatPackage(true)->toByteArray();
+		QCOMPARE(heartbeat.size(), Package::headSize());
+		QCOMPARE(Package::isValidHead(heartbeat.constData()), true);
+	}
+	QEventLoop eventLoop;
+	auto flag1 = false;
+	auto server = Server::createServer(12467);
+	server->connectSettings()->heartbeatInterval = 200;
+	server->connectSettings()->heartbeatTimeout = 600;
+	server->serverSettings()->packageReceivedCallback = [&flag1, &eventLoop](
+		const QPointer<Connect>&, const QSharedPointer<Package>&) {
+			flag1 = true;
+			eventLoop.quit();
+	};
+	QCOMPARE(server->begin(), true);
+	// Answers the heartbeats of the server without any heartbeat setting of its own
+	auto client = Client::createClient();
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12467), true);
+	QTimer::singleShot(1500, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12467, "heartbeat", QByteArray("data")) > 0, true);
 	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
 	eventLoop.exec();
 	QCOMPARE(flag1, true);
+	// A peer that never answers may be an older version without heartbeats, it stays connected
+	QTcpSocket oldSocket;
+	oldSocket.connectToHost("127.0.0.1", 12467);
+	QCOMPARE(oldSocket.waitForConnected(), true);
+	QElapsedTimer time;
+	time.start();
+	while ((oldSocket.state() == QAbstractSocket::ConnectedState) && (time.elapsed() < 1500)) {
+		oldSocket.waitForReadyRead(100);
+	}
+	QCOMPARE(oldSocket.state() == QAbstractSocket::ConnectedState, true);
+	// A peer that answered once and then falls silent is closed after the timeout
+	QTcpSocket silentSocket;
+	silentSocket.connectToHost("127.0.0.1", 12467);
+	QCOMPARE(silentSocket.waitForConnected(), true);
+	QCOMPARE(silentSocket.waitForReadyRead(), true);
+	silentSocket.write(Package::createHeartbeatPackage(false)->toByteArray());
+	QCOMPARE(silentSocket.waitForBytesWritten(), true);
+	time.start();
+	while ((silentSocket.state() == QAbstractSocket::ConnectedState) && (time.elapsed() < 5000)) {
+		silentSocket.waitForReadyRead(100);
+	}
+	QCOMPARE(silentSocket.state() != QAbstractSocket::ConnectedState, true);
+	QCOMPARE(time.elapsed() >= 500, true);
+}
+void NetworkOverallTest::NetworkAutoReconnect() {
+	QMutex mutex;
+	QStringList received;
+	auto remoteHostClosed = false;
+	auto client = Client::createClient();
+	client->clientSettings()->autoReconnect = true;
+	client->clientSettings()->reconnectInitialBackoff = 50;
+	client->clientSettings()->reconnectMaximumBackoff = 200;
+	client->clientSettings()->reconnectQueueSize = 2;
+	client->clientSettings()->remoteHostClosedCallback = [&mutex, &remoteHostClosed](
+		const QPointer<Connect>&, const QString&, const quint16&) {
+			mutex.lock();
+			remoteHostClosed = true;
+			mutex.unlock();
+	};
+	QCOMPARE(client->begin(), true);
+	const auto&& createServer = [&mutex, &received]() {
+		auto server = Server::createServer(12468);
+		server->serverSettings()->packageReceivedCallback = [&mutex, &received](
+			const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+				mutex.lock();
+				received.push_back(QString::fromUtf8(package->payloadData()));
+				mutex.unlock();
+				connect->replyPayloadData(package->randomFlag(), package->payloadData());
+		};
+		return server;
+	};
+	// Nothing listens yet, sends are queued without blocking and fail once the queue is full
+	{
+		QElapsedTimer time;
+		time.start();
+		// Held sends still answer with the randomFlag they will go out with
+		const auto&& firstRandomFlag = client->sendPayloadData("127.0.0.1", 12468, "reconnect", QByteArray("1"));
+		const auto&& secondRandomFlag = client->sendPayloadData("127.0.0.1", 12468, "reconnect", QByteArray("2"));
+		QCOMPARE(firstRandomFlag > 0, true);
+		QCOMPARE(secondRandomFlag > 0, true);
+		QCOMPARE(firstRandomFlag != secondRandomFlag, true);
+		QCOMPARE(client->pendingSendCount("127.0.0.1", 12468), 2);
+		auto flag1 = false;
+		QCOMPARE(client->sendPayloadData("127.0.0.1", 12468, "reconnect", QByteArray("3"), nullptr,
+			[&flag1](const QPointer<Connect>& connect) { flag1 = !connect; }), 0);
+		QCOMPARE(flag1, true);
+		QCOMPARE(time.elapsed() < 1000, true);
+	}
+	// The queue is flushed in order once the server comes up
+	auto server = createServer();
+	QCOMPARE(server->begin(), true);
+	QCOMPARE(waitFor(mutex, [&received]() { return received.size() == 2; }), true);
+	QCOMPARE(received, QStringList({ "1", "2" }));
+	QCOMPARE(client->pendingSendCount("127.0.0.1", 12468), 0);
+	QCOMPARE(client->sendPayloadData("127.0.0.1", 12468, "reconnect", QByteArray("3")) > 0, true);
+	QCOMPARE(waitFor(mutex, [&received]() { return received.size() == 3; }), true);
+	// Restarted server, the dropped host is reconnected in the background and the held send delivered
+	server.clear();
+	QCOMPARE(waitFor(mutex, [&remoteHostClosed]() { return remoteHostClosed; }), true);
+	qint32 repliedRandomFlag = 0;
+	const auto&& heldRandomFlag = client->sendPayloadData("127.0.0.1", 12468, "reconnect", QByteArray("4"), {},
+		[&mutex, &repliedRandomFlag](const QPointer<Connect>&, const QSharedPointer<Package>& package) {
+			mutex.lock();
+			repliedRandomFlag = package->randomFlag();
+			mutex.unlock();
+		});
+	QCOMPARE(heldRandomFlag > 0, true);
+	QCOMPARE(client->pendingSendCount("127.0.0.1", 12468), 1);
+	server = createServer();
+	QCOMPARE(server->begin(), true);
+	QCOMPARE(waitFor(mutex, [&received]() { return received.size() == 4; }), true);
+	QCOMPARE(received.last(), QString("4"));
+	// The reply is matched by the randomFlag returned while the send was held
+	QCOMPARE(waitFor(mutex, [&repliedRandomFlag]() { return repliedRandomFlag != 0; }), true);
+	QCOMPARE(repliedRandomFlag, heldRandomFlag);
+}
+void NetworkOverallTest::NetworkFutureTest() {
+	auto server = Server::createServer(12469);
+	server->serverSettings()->packageReceivedCallback = [](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), "reply:" + package->payloadData());
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient();
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12469), true);
+	// Fan out, every reply lands at the index of its request
+	{
+		QList<NetworkReplyFuture> futures;
+		for (auto index = 0; index < 100; ++index) {
+			futures.push_back(client->sendPayloadDataAsync("127.0.0.1", 12469, "future", QByteArray::number(index)));
+		}
+		auto allFuture = NetworkFuture::whenAll(futures);
+		allFuture.waitForFinished();
+		const auto&& replies = allFuture.result();
+		QCOMPARE(replies.size(), 100);
+		for (auto index = 0; index < replies.size(); ++index) {
+			QCOMPARE(replies[index].succeed(), true);
+			QCOMPARE(replies[index].package->payloadData(), "reply:" + QByteArray::number(index));
+		}
+	}
+	// A chained request, the continuation runs on the thread of the context object
+	{
+		QEventLoop eventLoop;
+		QThread* continuationThread = nullptr;
+		QByteArray chainedReply;
+		client->sendPayloadDataAsync("127.0.0.1", 12469, "future", "first").then(
+			&eventLoop,
+			[client, &continuationThread](const NetworkReply& reply) {
+				continuationThread = QThread::currentThread();
+				return client->sendPayloadDataAsync("127.0.0.1", 12469, "future", reply.package->payloadData());
+			}
+		).unwrap().then(
+			&eventLoop,
+			[&eventLoop, &chainedReply](const NetworkReply& reply) {
+				chainedReply = reply.package->payloadData();
+				eventLoop.quit();
+			}
+		);
+		QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+		eventLoop.exec();
+		QCOMPARE(continuationThread, QThread::currentThread());
+		QCOMPARE(chainedReply, QByteArray("reply:reply:first"));
+	}
+	// Refused sends settle right away with a null package
+	{
+		auto offlineClient = Client::createClient();
+		offlineClient->clientSettings()->autoCreateConnect = false;
+		QCOMPARE(offlineClient->begin(), true);
+		auto future = offlineClient->sendPayloadDataAsync("127.0.0.1", 12469, "future", "data");
+		QCOMPARE(future.isFinished(), true);
+		QCOMPARE(future.result().succeed(), false);
+	}
+}
+void NetworkOverallTest::NetworkCoroutineTest() {
+#ifdef __cpp_impl_coroutine
+	auto backend = Server::createServer(12470);
+	backend->serverSettings()->packageReceivedCallback = [](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			connect->replyPayloadData(package->randomFlag(), "backend:" + package->payloadData());
+	};
+	QCOMPARE(backend->begin(), true);
+	CoroutineTest::GatewayProcessor gatewayProcessor;
+	gatewayProcessor.backend_ = Client::createClient();
+	QCOMPARE(gatewayProcessor.backend_->begin(), true);
+	auto gateway = Server::createServer(12471);
+	gateway->registerProcessor(&gatewayProcessor);
+	QCOMPARE(gateway->begin(), true);
+	auto client = Client::createClient();
+	QCOMPARE(client->begin(), true);
+	QEventLoop eventLoop;
+	auto connected = false;
+	auto refused = true;
+	NetworkReply reply;
+	QThread* resumeThread = nullptr;
+	// Kept alive until the event loop returns, the coroutine refers to its captures after every co_await
+	auto task = [&]() -> NetworkTask {
+		connected = co_await client->createConnectAsync("127.0.0.1", 12471);
+		refused = co_await client->createConnectAsync("127.0.0.1", 12472, 1000);
+		reply = co_await client->sendPayloadDataAsync("127.0.0.1", 12471, "relay", "data");
+		resumeThread = QThread::currentThread();
+		eventLoop.quit();
+	};
+	task();
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(connected, true);
+	QCOMPARE(refused, false);
+	QCOMPARE(resumeThread, QThread::currentThread());
+	QCOMPARE(reply.succeed(), true);
+	QCOMPARE(reply.package->payloadData(), QByteArray("backend:data"));
+	QCOMPARE(gatewayProcessor.resumedOnHandleThread_, true);
+#else
+	QSKIP("coroutines need C++20");
+#endif
+}
+void NetworkOverallTest::NetworkSendBatch() {
+	QMutex mutex;
+	QList<QByteArray> putReceived;
+	auto server = Server::createServer(12473);
+	server->serverSettings()->packageReceivedCallback = [&mutex, &putReceived](
+		const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+			if (package->targetActionFlag() == "put") {
+				mutex.lock();
+				putReceived.push_back(package->payloadData());
+				mutex.unlock();
+				return;
+			}
+			connect->replyPayloadData(package->randomFlag(), "reply:" + package->payloadData());
+	};
+	QCOMPARE(server->begin(), true);
+	auto client = Client::createClient();
+	QCOMPARE(client->begin(), true);
+	QCOMPARE(client->waitForCreateConnect("127.0.0.1", 12473), true);
+	auto connect = client->getConnect("127.0.0.1", 12473);
+	QCOMPARE(connect.isNull(), false);
+	QEventLoop eventLoop;
+	QList<NetworkBatchMessage> messages;
+	auto messageSucceedCount = 0;
+	for (auto index = 0; index < 200; ++index) {
+		messages.push_back({ "batch", QByteArray::number(index), {},
+			[&mutex, &messageSucceedCount](const QPointer<Connect>&, const QSharedPointer<Package>&) {
+				mutex.lock();
+				++messageSucceedCount;
+				mutex.unlock();
+			} });
+	}
+	QList<QSharedPointer<Package>> replies;
+	const auto&& socketWriteCount = connect->socketWriteCount();
+	const auto&& randomFlags = client->sendBatch(
+		"127.0.0.1",
+		12473,
+		messages,
+		[&eventLoop, &replies](const QPointer<Connect>&, const QList<QSharedPointer<Package>>& packages) {
+			replies = packages;
+			eventLoop.quit();
+		}
+	);
+	QCOMPARE(randomFlags.size(), 200);
+	QTimer::singleShot(10 * 1000, &eventLoop, &QEventLoop::quit);
+	eventLoop.exec();
+	QCOMPARE(replies.size(), 200);
+	for (auto index = 0; index < replies.size(); ++index) {
+		QCOMPARE(replies[index]->randomFlag(), randomFlags[index]);
+		QCOMPARE(replies[index]->payloadData(), "reply:" + QByteArray::number(index));
+	}
+	mutex.lock();
+	QCOMPARE(messageSucceedCount, 200);
+	mutex.unlock();
+	// One hop, the whole batch leaves in a few 64 KB writes at most
+	QCOMPARE(connect->socketWriteCount() - socketWriteCount <= 2, true);
+	// Batches without replies
+	QCOMPARE(connect->putBatch({ { "put", "1" }, { "put", "2" }, { "put", "3" } }), true);
+	QCOMPARE(waitFor(mutex, [&putReceived]() { return putReceived.size() == 3; }), true);
+	QCOMPARE(putReceived, QList<QByteArray>({ "1", "2", "3" }));
+	// Several messages of many chunks each, their chunks must not mix
+	mutex.lock();
+	putReceived.clear();
+	mutex.unlock();
+	QList<NetworkBatchMessage> bigMessages;
+	for (auto index = 0; index < 3; ++index) {
+		bigMessages.push_back({ "put", QByteArray(static_cast<int>(3 * NETWORKPACKAGE_ADVISE_CUTPACKAGESIZE) + index, char('a' + index)) });
+	}
+	QCOMPARE(connect->putBatch(bigMessages), true);
+	QCOMPARE(waitFor(mutex, [&putReceived]() { return putReceived.size() == 3; }), true);
+	mutex.lock();
+	std::sort(putReceived.begin(), putReceived.end());
+	QCOMPARE(putReceived.size(), 3);
+	for (auto index = 0; index < putReceived.size(); ++index) {
+		QCOMPARE(putReceived[index], bigMessages[index].payloadData);
+	}
+	mutex.unlock();
+}
+void NetworkOverallTest::NetworkBroadcast() {
+	FanOutFixture fixture;
+	QCOMPARE(fixture.begin(12474, "notice", 3), true);
+	auto& server = fixture.server;
+	QCOMPARE(server->broadcast("notice", "notice"), true);
+	QCOMPARE(waitFor(fixture.mutex, [&fixture]() { return fixture.receivedCounts == QVector<int>({ 1, 1, 1 }); }), true);
+	// Only the chosen connect
+	fixture.mutex.lock();
+	const auto&& firstConnect = fixture.serverConnects.first();
+	fixture.mutex.unlock();
+	QCOMPARE(server->multicast({ firstConnect }, "notice", "notice"), true);
+	QCOMPARE(waitFor(fixture.mutex, [&fixture]() { return fixture.receivedCount() == 4; }), true);
+	// Every connect counts as a slow consumer and is skipped
+	server->serverSettings()->broadcastSlowConsumerBytes = 0;
+	QCOMPARE(server->broadcast("notice", "notice"), true);
+	QCOMPARE(waitFor(fixture.mutex, [&server]() { return server->metrics()->counter(NetworkMetrics::SlowConsumerSkips) == 3; }), true);
+	QTest::qWait(200);
+	fixture.mutex.lock();
+	QCOMPARE(fixture.receivedCount(), 4);
+	fixture.mutex.unlock();
+}
+void NetworkOverallTest::NetworkPublishSubscribe() {
+	FanOutFixture fixture;
+	QCOMPARE(fixture.begin(12475, "prices", 3), true);
+	auto& server = fixture.server;
+	fixture.mutex.lock();
+	const auto&& connects = fixture.serverConnects;
+	fixture.mutex.unlock();
+	// Published right after subscribe, the subscription is queued ahead of it on the socket thread
+	server->subscribe(connects[0], "prices");
+	server->subscribe(connects[1], "prices");
+	server->subscribe(connects[1], "news");
+	QCOMPARE(server->publish("prices", "tick"), true);
+	QCOMPARE(waitFor(fixture.mutex, [&fixture]() { return fixture.receivedCount() == 2; }), true);
+	server->unsubscribe(connects[1], "prices");
+	QCOMPARE(server->publish("prices", "tick"), true);
+	QCOMPARE(server->publish("weather", "tick"), true);
+	QCOMPARE(waitFor(fixture.mutex, [&fixture]() { return fixture.receivedCount() == 3; }), true);
+	QTest::qWait(200);
+	fixture.mutex.lock();
+	QCOMPARE(fixture.receivedCounts, QVector<int>({ 2, 1, 0 }));
+	fixture.mutex.unlock();
+}
+void NetworkOverallTest::NetworkLocalTransport() {
+	QMutex mutex;
+	QMap<quint16, bool> clientLocalTransports;
+	QMap<quint16, bool> serverLocalTransports;
+	QMap<quint16, QByteArray> received;
+	// 12476 also listens on its Unix domain socket, 12477 only on TCP
+	QVector<QSharedPointer<Server>> servers;
+	for (const auto& port : { quint16(12476), quint16(12477) }) {
+		auto server = Server::createServer(port);
+		server->serverSettings()->localListenEnabled = (port == 12476);
+		server->serverSettings()->packageReceivedCallback = [&mutex, &serverLocalTransports, &received, port](
+			const QPointer<Connect>& connect, const QSharedPointer<Package>& package) {
+				mutex.lock();
+				serverLocalTransports[port] = connect->isLocalTransport();
+				received[port] = package->payloadData();
+				mutex.unlock();
+		};
+		QCOMPARE(server->begin(), true);
+		servers.push_back(server);
+	}
+#ifdef Q_OS_LINUX
+	QCOMPARE(QFileInfo::exists(Connect::localServerName(12476)), true);
+#endif
+	auto client = Client::createClient();
+	client->connectSettings()->localTransportEnabled = true;
+	client->clientSettings()->connectToHostSucceedCallback = [&mutex, &clientLocalTransports](
+		const QPointer<Connect>& connect, const QString&, const quint16& port) {
+			mutex.lock();
+			clientLocalTransports[port] = connect->isLocalTransport();
+			mutex.unlock();
+	};
+	QCOMPARE(client->begin(), true);
+	for (const auto& port : { quint16(12476), quint16(12477) }) {
+		QCOMPARE(client->waitForCreateConnect("127.0.0.1", port), true);
+		QCOMPARE(client->sendPayloadData("127.0.0.1", port, "local", QByteArray("data")) > 0, true);
+	}
+	QCOMPARE(waitFor(mutex, [&received, &clientLocalTransports]() {
+		return (received.size() == 2) && (clientLocalTransports.size() == 2);
+		}), true);
+	mutex.lock();
+	QCOMPARE(received.value(12476), QByteArray("data"));
+	QCOMPARE(received.value(12477), QByteArray("data"));
+#ifdef Q_OS_LINUX
+	QCOMPARE(clientLocalTransports.value(12476), true);
+	QCOMPARE(serverLocalTransports.value(12476), true);
+#endif
+	QCOMPARE(clientLocalTransports.value(12477), false);
+	QCOMPARE(serverLocalTransports.value(12477), false);
+	mutex.unlock();
 }
 void NetworkOverallTest::fusionTest1() {
 	auto server = Server::createServer(24680);
@@ -41,6 +41,48 @@ public:
 	PRIVATEMACRO slots :
 	void NetworkSendFile();
 	PRIVATEMACRO slots :
+	void NetworkSendScheduler();
+	PRIVATEMACRO slots :
+	void NetworkSendFileResume();
+	PRIVATEMACRO slots :
+	void NetworkSendFileAsyncWrite();
+	PRIVATEMACRO slots :
+	void NetworkSendFileStriped();
+
+	void NetworkSendCancel();
+
+	void NetworkSendFileZeroCopy();
+	PRIVATEMACRO slots :
+	void NetworkSendFileBundle();
+	PRIVATEMACRO slots :
+	void NetworkSendFileDelta();
+	PRIVATEMACRO slots :
+	void NetworkChunkDeduplication();
+	PRIVATEMACRO slots :
+	void NetworkPackageChecksum();
+	PRIVATEMACRO slots :
+	void NetworkPackageResync();
+	PRIVATEMACRO slots :
+	void NetworkMetricsTest();
+	PRIVATEMACRO slots :
+	void NetworkTracing();
+	PRIVATEMACRO slots :
+	void NetworkHeartbeat();
+	PRIVATEMACRO slots :
+	void NetworkAutoReconnect();
+	PRIVATEMACRO slots :
+	void NetworkFutureTest();
+	PRIVATEMACRO slots :
+	void NetworkCoroutineTest();
+	PRIVATEMACRO slots :
+	void NetworkSendBatch();
+	PRIVATEMACRO slots :
+	void NetworkBroadcast();
+	PRIVATEMACRO slots :
+	void NetworkPublishSubscribe();
+	PRIVATEMACRO slots :
+	void NetworkLocalTransport();
+	PRIVATEMACRO slots :
 	void fusionTest1();
 	PRIVATEMACRO slots :
 	void fusionTest2();
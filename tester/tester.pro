@@ -2,4 +2,5 @@
 TEMPLATE = subdirs
 SUBDIRS += NetworkOverallTest
 SUBDIRS += NetworkBenchmark
+SUBDIRS += NetworkLoadGenerator
 SUBDIRS += NetworkPersisteneTest